@@ -8,6 +8,7 @@
 #include "Shader.h"
 #include <vector>
 #include <sstream>
+#include <cstring>
 
 
 std::vector<std::string> &split(const std::string &s, char delim, std::vector<std::string> &elems) {
@@ -42,13 +43,60 @@ char* Shader::readFile(const char* filename)
     return contents;
 }
 
+// Replaces every line '#include "file"' with that file, read from the directory of the
+// shader that includes it. One level only, snippets include nothing themselves.
+static char* resolveIncludes(char* source, const char* filename)
+{
+    std::string directory(filename);
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+
+    std::stringstream lines(source);
+    std::string line, result;
+    bool included = false;
+    while (std::getline(lines, line)) {
+        if (line.compare(0, 10, "#include \"") == 0) {
+            size_t end = line.find('"', 10);
+            std::string path = directory + line.substr(10, end == std::string::npos ? std::string::npos : end - 10);
+            char* snippet = Shader::readFile(path.c_str());
+            result += snippet;
+            result += "\n";
+            delete[] snippet;
+            included = true;
+        }
+        else result += line + "\n";
+    }
+    if (!included) return source;
+
+    delete[] source;
+    char* resolved = new char[result.size() + 1];
+    strcpy(resolved, result.c_str());
+    return resolved;
+}
+
 Shader::Shader(const char* vertSource, const char* fragSource) {
     
-    char* vertexShaderSourceCode=readFile(vertSource);
-    char* fragmentShaderSourceCode=readFile(fragSource);
+    char* vertexShaderSourceCode=resolveIncludes(readFile(vertSource), vertSource);
+    char* fragmentShaderSourceCode=resolveIncludes(readFile(fragSource), fragSource);
     makeShaderProgram(makeVertexShader(vertexShaderSourceCode), makeFragmentShader(fragmentShaderSourceCode));
 }
 
+Shader::Shader(const char* computeSource) {
+    
+    char* computeShaderSourceCode=resolveIncludes(readFile(computeSource), computeSource);
+    GLuint computeShaderID=makeComputeShader(computeShaderSourceCode);
+    program=glCreateProgram();
+    glAttachShader(program, computeShaderID);
+    
+    glLinkProgram(program);
+    GLint link_ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+    if (!link_ok) {
+        fprintf(stderr, "glLinkProgram:");
+        saveProgramInfoLog(program);
+    }
+}
+
 GLuint Shader::makeVertexShader(const char* shaderSource)
 {
     GLuint vertexShaderID=glCreateShader(GL_VERTEX_SHADER);
@@ -97,6 +145,30 @@ GLuint Shader::makeFragmentShader(const char* shaderSource)
     return fragmentShaderID;
 }
 
+GLuint Shader::makeComputeShader(const char* shaderSource)
+{
+    GLuint computeShaderID=glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderID,1,(const GLchar**)&shaderSource, NULL);
+    glCompileShader(computeShaderID);
+    
+    GLint compile=0;
+    glGetShaderiv(computeShaderID,GL_COMPILE_STATUS,&compile);
+    
+    //we want to see the compile log if we are in debug (to check warnings)
+    if (!compile)
+    {
+        saveShaderInfoLog(computeShaderID);
+        std::cout << "Shader code:\n " << std::endl;
+        std::string code = shaderSource;
+        std::vector<std::string> lines = split( code, '\n' );
+        for( size_t i = 0; i < lines.size(); ++i)
+            std::cout << i << "  " << lines[i] << std::endl;
+        
+    }
+    
+    return computeShaderID;
+}
+
 void Shader::saveShaderInfoLog(GLuint obj)
 {
     int len = 0;
@@ -8,9 +8,11 @@ public:
     GLuint program;
     
     Shader(const char* vertSource, const char* fragSource);
+    Shader(const char* computeSource); // compute program, needs GL 4.3
     static char* readFile(const char* filename);
     GLuint makeVertexShader(const char* shaderSource);
     GLuint makeFragmentShader(const char* shaderSource);
+    GLuint makeComputeShader(const char* shaderSource);
     void makeShaderProgram(GLuint vertexShaderID, GLuint fragmentShaderID);
     GLint bindAttribute(const char* attribute_name);
     GLint bindUniform(const char* uniform_name);
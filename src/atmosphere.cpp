@@ -0,0 +1,530 @@
+#include "atmosphere.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "jobs.h"
+
+// Texels per job
+#define ATMOSPHERE_GRAIN 64
+// Integration steps
+#define TRANSMITTANCE_SAMPLES 250
+#define SCATTERING_SAMPLES 50
+#define IRRADIANCE_SAMPLES_THETA 16
+#define IRRADIANCE_SAMPLES_PHI 32
+
+static const float PI = 3.14159265358979f;
+
+using glm::vec3;
+using glm::vec4;
+
+AtmosphereParams atmosphere_default_params() {
+	AtmosphereParams p;
+	memset(&p, 0, sizeof(p)); //padding too, the cache compares bytes
+	p.bottom_radius = 6360.0f;
+	p.top_radius = 6420.0f;
+	p.rayleigh_scattering[0] = 5.802e-3f;
+	p.rayleigh_scattering[1] = 13.558e-3f;
+	p.rayleigh_scattering[2] = 33.1e-3f;
+	p.rayleigh_scale_height = 8.0f;
+	p.mie_scattering = 3.996e-3f;
+	p.mie_extinction = 4.44e-3f;
+	p.mie_scale_height = 1.2f;
+	p.mie_g = 0.8f;
+	p.ozone_absorption[0] = 0.65e-3f;
+	p.ozone_absorption[1] = 1.881e-3f;
+	p.ozone_absorption[2] = 0.085e-3f;
+	p.ozone_center = 25.0f;
+	p.ozone_width = 30.0f;
+	p.sun_angular_radius = 0.004675f;
+	p.mu_s_min = -0.2f; //102 degrees, enough for twilight
+	return p;
+}
+
+// ------------------------------------------------------------------------------------------
+// Geometry and parameterization, after Bruneton's reference implementation (2017)
+// ------------------------------------------------------------------------------------------
+static inline float clamp_cosine(float mu) { return std::max(-1.0f, std::min(1.0f, mu)); }
+static inline float safe_sqrt(float a) { return sqrtf(std::max(a, 0.0f)); }
+
+static inline float distance_to_top(const AtmosphereParams& p, float r, float mu) {
+	return std::max(0.0f, -r * mu + safe_sqrt(r * r * (mu * mu - 1.0f) + p.top_radius * p.top_radius));
+}
+
+static inline float distance_to_bottom(const AtmosphereParams& p, float r, float mu) {
+	return std::max(0.0f, -r * mu - safe_sqrt(r * r * (mu * mu - 1.0f) + p.bottom_radius * p.bottom_radius));
+}
+
+static inline bool ray_intersects_ground(const AtmosphereParams& p, float r, float mu) {
+	return mu < 0.0f && r * r * (mu * mu - 1.0f) + p.bottom_radius * p.bottom_radius >= 0.0f;
+}
+
+static inline float coord_from_unit(float x, int size) { return 0.5f / size + x * (1.0f - 1.0f / size); }
+static inline float unit_from_coord(float u, int size) { return (u - 0.5f / size) / (1.0f - 1.0f / size); }
+
+static inline float horizon_distance(const AtmosphereParams& p) {
+	return sqrtf(p.top_radius * p.top_radius - p.bottom_radius * p.bottom_radius);
+}
+
+static void transmittance_uv(const AtmosphereParams& p, float r, float mu, float& u, float& v) {
+	float H = horizon_distance(p);
+	float rho = safe_sqrt(r * r - p.bottom_radius * p.bottom_radius);
+	float d = distance_to_top(p, r, mu);
+	float d_min = p.top_radius - r;
+	float d_max = rho + H;
+	u = coord_from_unit((d - d_min) / (d_max - d_min), ATMOSPHERE_TRANSMITTANCE_W);
+	v = coord_from_unit(rho / H, ATMOSPHERE_TRANSMITTANCE_H);
+}
+
+static void transmittance_r_mu(const AtmosphereParams& p, float u, float v, float& r, float& mu) {
+	float H = horizon_distance(p);
+	float rho = H * unit_from_coord(v, ATMOSPHERE_TRANSMITTANCE_H);
+	r = sqrtf(rho * rho + p.bottom_radius * p.bottom_radius);
+	float d_min = p.top_radius - r;
+	float d_max = rho + H;
+	float d = d_min + unit_from_coord(u, ATMOSPHERE_TRANSMITTANCE_W) * (d_max - d_min);
+	mu = d == 0.0f ? 1.0f : clamp_cosine((H * H - rho * rho - d * d) / (2.0f * r * d));
+}
+
+// (nu, mu_s, mu, r) texture coordinates; mu's half depends on whether the ray hits the ground
+static vec4 scattering_uvwz(const AtmosphereParams& p, float r, float mu, float mu_s, float nu, bool ground) {
+	float H = horizon_distance(p);
+	float rho = safe_sqrt(r * r - p.bottom_radius * p.bottom_radius);
+	float u_r = coord_from_unit(rho / H, ATMOSPHERE_SCATTERING_R);
+
+	float r_mu = r * mu;
+	float discriminant = r_mu * r_mu - r * r + p.bottom_radius * p.bottom_radius;
+	float u_mu;
+	if (ground) {
+		float d = -r_mu - safe_sqrt(discriminant);
+		float d_min = r - p.bottom_radius;
+		float d_max = rho;
+		u_mu = 0.5f - 0.5f * coord_from_unit(d_max == d_min ? 0.0f : (d - d_min) / (d_max - d_min), ATMOSPHERE_SCATTERING_MU / 2);
+	}
+	else {
+		float d = -r_mu + safe_sqrt(discriminant + H * H);
+		float d_min = p.top_radius - r;
+		float d_max = rho + H;
+		u_mu = 0.5f + 0.5f * coord_from_unit((d - d_min) / (d_max - d_min), ATMOSPHERE_SCATTERING_MU / 2);
+	}
+
+	float d = distance_to_top(p, p.bottom_radius, mu_s);
+	float d_min = p.top_radius - p.bottom_radius;
+	float d_max = H;
+	float a = (d - d_min) / (d_max - d_min);
+	float A = (distance_to_top(p, p.bottom_radius, p.mu_s_min) - d_min) / (d_max - d_min);
+	float u_mu_s = coord_from_unit(std::max(1.0f - a / A, 0.0f) / (1.0f + a), ATMOSPHERE_SCATTERING_MU_S);
+
+	return vec4((nu + 1.0f) * 0.5f, u_mu_s, u_mu, u_r);
+}
+
+static void scattering_r_mu_mu_s_nu(const AtmosphereParams& p, const vec4& uvwz, float& r, float& mu, float& mu_s, float& nu, bool& ground) {
+	float H = horizon_distance(p);
+	float rho = H * unit_from_coord(uvwz.w, ATMOSPHERE_SCATTERING_R);
+	r = sqrtf(rho * rho + p.bottom_radius * p.bottom_radius);
+
+	if (uvwz.z < 0.5f) {
+		float d_min = r - p.bottom_radius;
+		float d_max = rho;
+		float d = d_min + (d_max - d_min) * unit_from_coord(1.0f - 2.0f * uvwz.z, ATMOSPHERE_SCATTERING_MU / 2);
+		mu = d == 0.0f ? -1.0f : clamp_cosine(-(rho * rho + d * d) / (2.0f * r * d));
+		ground = true;
+	}
+	else {
+		float d_min = p.top_radius - r;
+		float d_max = rho + H;
+		float d = d_min + (d_max - d_min) * unit_from_coord(2.0f * uvwz.z - 1.0f, ATMOSPHERE_SCATTERING_MU / 2);
+		mu = d == 0.0f ? 1.0f : clamp_cosine((H * H - rho * rho - d * d) / (2.0f * r * d));
+		ground = false;
+	}
+
+	float x_mu_s = unit_from_coord(uvwz.y, ATMOSPHERE_SCATTERING_MU_S);
+	float d_min = p.top_radius - p.bottom_radius;
+	float d_max = H;
+	float A = (distance_to_top(p, p.bottom_radius, p.mu_s_min) - d_min) / (d_max - d_min);
+	float a = (A - x_mu_s * A) / (1.0f + x_mu_s * A);
+	float d = d_min + std::min(a, A) * (d_max - d_min);
+	mu_s = d == 0.0f ? 1.0f : clamp_cosine((H * H - d * d) / (2.0f * p.bottom_radius * d));
+
+	nu = clamp_cosine(uvwz.x * 2.0f - 1.0f);
+}
+
+// ------------------------------------------------------------------------------------------
+// Densities and filtered reads of the tables, as the GPU does them (linear, clamp to edge)
+// ------------------------------------------------------------------------------------------
+static inline float rayleigh_density(const AtmosphereParams& p, float altitude) {
+	return std::min(1.0f, expf(-altitude / p.rayleigh_scale_height));
+}
+
+static inline float mie_density(const AtmosphereParams& p, float altitude) {
+	return std::min(1.0f, expf(-altitude / p.mie_scale_height));
+}
+
+static inline float ozone_density(const AtmosphereParams& p, float altitude) {
+	return std::max(0.0f, 1.0f - fabsf(altitude - p.ozone_center) / (0.5f * p.ozone_width));
+}
+
+static inline void texel_lerp(float u, int size, int& i0, int& i1, float& t) {
+	float x = u * size - 0.5f;
+	float f = floorf(x);
+	t = x - f;
+	i0 = std::max(0, std::min(size - 1, (int)f));
+	i1 = std::max(0, std::min(size - 1, (int)f + 1));
+}
+
+static vec3 sample_2d(const std::vector<float>& data, int width, int height, float u, float v) {
+	int x0, x1, y0, y1;
+	float tx, ty;
+	texel_lerp(u, width, x0, x1, tx);
+	texel_lerp(v, height, y0, y1, ty);
+	const float* a = &data[(y0 * width + x0) * 3];
+	const float* b = &data[(y0 * width + x1) * 3];
+	const float* c = &data[(y1 * width + x0) * 3];
+	const float* d = &data[(y1 * width + x1) * 3];
+	vec3 top = glm::mix(vec3(a[0], a[1], a[2]), vec3(b[0], b[1], b[2]), tx);
+	vec3 bottom = glm::mix(vec3(c[0], c[1], c[2]), vec3(d[0], d[1], d[2]), tx);
+	return glm::mix(top, bottom, ty);
+}
+
+static vec3 sample_3d(const std::vector<float>& data, int width, int height, int depth, float u, float v, float w) {
+	int x0, x1, y0, y1, z0, z1;
+	float tx, ty, tz;
+	texel_lerp(u, width, x0, x1, tx);
+	texel_lerp(v, height, y0, y1, ty);
+	texel_lerp(w, depth, z0, z1, tz);
+	vec3 corners[2];
+	for (int k = 0; k < 2; k++) {
+		int z = k == 0 ? z0 : z1;
+		const float* a = &data[((z * height + y0) * width + x0) * 3];
+		const float* b = &data[((z * height + y0) * width + x1) * 3];
+		const float* c = &data[((z * height + y1) * width + x0) * 3];
+		const float* d = &data[((z * height + y1) * width + x1) * 3];
+		vec3 top = glm::mix(vec3(a[0], a[1], a[2]), vec3(b[0], b[1], b[2]), tx);
+		vec3 bottom = glm::mix(vec3(c[0], c[1], c[2]), vec3(d[0], d[1], d[2]), tx);
+		corners[k] = glm::mix(top, bottom, ty);
+	}
+	return glm::mix(corners[0], corners[1], tz);
+}
+
+static vec3 transmittance_to_top(const AtmosphereParams& p, const std::vector<float>& table, float r, float mu) {
+	float u, v;
+	transmittance_uv(p, r, mu, u, v);
+	return sample_2d(table, ATMOSPHERE_TRANSMITTANCE_W, ATMOSPHERE_TRANSMITTANCE_H, u, v);
+}
+
+// Between the point at (r, mu) and the one d further along the ray
+static vec3 transmittance(const AtmosphereParams& p, const std::vector<float>& table, float r, float mu, float d, bool ground) {
+	float r_d = std::max(p.bottom_radius, std::min(p.top_radius, sqrtf(d * d + 2.0f * r * mu * d + r * r)));
+	float mu_d = clamp_cosine((r * mu + d) / r_d);
+	vec3 ratio = ground ?
+		transmittance_to_top(p, table, r_d, -mu_d) / transmittance_to_top(p, table, r, -mu) :
+		transmittance_to_top(p, table, r, mu) / transmittance_to_top(p, table, r_d, mu_d);
+	return glm::min(ratio, vec3(1.0f));
+}
+
+// Fraction of the sun's disc above the horizon, times the transmittance towards it
+static vec3 transmittance_to_sun(const AtmosphereParams& p, const std::vector<float>& table, float r, float mu_s) {
+	float sin_h = p.bottom_radius / r;
+	float cos_h = -safe_sqrt(1.0f - sin_h * sin_h);
+	float edge = sin_h * p.sun_angular_radius;
+	float x = std::max(0.0f, std::min(1.0f, (mu_s - cos_h + edge) / (2.0f * edge)));
+	return transmittance_to_top(p, table, r, mu_s) * (x * x * (3.0f - 2.0f * x));
+}
+
+static vec3 scattering_lookup(const AtmosphereParams& p, const std::vector<float>& table, float r, float mu, float mu_s, float nu, bool ground) {
+	vec4 uvwz = scattering_uvwz(p, r, mu, mu_s, nu, ground);
+	float x = uvwz.x * (ATMOSPHERE_SCATTERING_NU - 1);
+	float cell = floorf(x);
+	float t = x - cell;
+	const int width = ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S;
+	vec3 a = sample_3d(table, width, ATMOSPHERE_SCATTERING_MU, ATMOSPHERE_SCATTERING_R,
+		(cell + uvwz.y) / ATMOSPHERE_SCATTERING_NU, uvwz.z, uvwz.w);
+	vec3 b = sample_3d(table, width, ATMOSPHERE_SCATTERING_MU, ATMOSPHERE_SCATTERING_R,
+		(cell + 1.0f + uvwz.y) / ATMOSPHERE_SCATTERING_NU, uvwz.z, uvwz.w);
+	return glm::mix(a, b, t);
+}
+
+static inline float rayleigh_phase(float nu) {
+	return 3.0f / (16.0f * PI) * (1.0f + nu * nu);
+}
+
+static inline float mie_phase(float g, float nu) {
+	float k = 3.0f / (8.0f * PI) * (1.0f - g * g) / (2.0f + g * g);
+	return k * (1.0f + nu * nu) / powf(1.0f + g * g - 2.0f * g * nu, 1.5f);
+}
+
+// ------------------------------------------------------------------------------------------
+// The three passes
+// ------------------------------------------------------------------------------------------
+static void compute_transmittance(const AtmosphereParams& p, std::vector<float>& table) {
+	table.assign(ATMOSPHERE_TRANSMITTANCE_W * ATMOSPHERE_TRANSMITTANCE_H * 3, 0.0f);
+	vec3 rayleigh(p.rayleigh_scattering[0], p.rayleigh_scattering[1], p.rayleigh_scattering[2]);
+	vec3 ozone(p.ozone_absorption[0], p.ozone_absorption[1], p.ozone_absorption[2]);
+
+	parallel_for(0, ATMOSPHERE_TRANSMITTANCE_W * ATMOSPHERE_TRANSMITTANCE_H, ATMOSPHERE_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			int x = (int)(i % ATMOSPHERE_TRANSMITTANCE_W), y = (int)(i / ATMOSPHERE_TRANSMITTANCE_W);
+			float r, mu;
+			transmittance_r_mu(p, (x + 0.5f) / ATMOSPHERE_TRANSMITTANCE_W, (y + 0.5f) / ATMOSPHERE_TRANSMITTANCE_H, r, mu);
+
+			//optical lengths to the top, trapezoidal rule
+			float dx = distance_to_top(p, r, mu) / TRANSMITTANCE_SAMPLES;
+			float length_r = 0.0f, length_m = 0.0f, length_o = 0.0f;
+			for (int k = 0; k <= TRANSMITTANCE_SAMPLES; k++) {
+				float d = k * dx;
+				float altitude = sqrtf(d * d + 2.0f * r * mu * d + r * r) - p.bottom_radius;
+				float weight = k == 0 || k == TRANSMITTANCE_SAMPLES ? 0.5f : 1.0f;
+				length_r += rayleigh_density(p, altitude) * weight * dx;
+				length_m += mie_density(p, altitude) * weight * dx;
+				length_o += ozone_density(p, altitude) * weight * dx;
+			}
+			vec3 t = glm::exp(-(rayleigh * length_r + vec3(p.mie_extinction * length_m) + ozone * length_o));
+			table[i * 3 + 0] = t.x;
+			table[i * 3 + 1] = t.y;
+			table[i * 3 + 2] = t.z;
+		}
+	});
+}
+
+static void compute_single_scattering(const AtmosphereParams& p, const std::vector<float>& transmittance_table,
+	std::vector<float>& rayleigh_table, std::vector<float>& mie_table) {
+	const int width = ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S;
+	const int texels = width * ATMOSPHERE_SCATTERING_MU * ATMOSPHERE_SCATTERING_R;
+	rayleigh_table.assign(texels * 3, 0.0f);
+	mie_table.assign(texels * 3, 0.0f);
+	vec3 rayleigh_scattering(p.rayleigh_scattering[0], p.rayleigh_scattering[1], p.rayleigh_scattering[2]);
+
+	parallel_for(0, texels, ATMOSPHERE_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			int x = (int)(i % width);
+			int y = (int)((i / width) % ATMOSPHERE_SCATTERING_MU);
+			int z = (int)(i / (width * ATMOSPHERE_SCATTERING_MU));
+			vec4 uvwz((x / ATMOSPHERE_SCATTERING_MU_S) / (float)(ATMOSPHERE_SCATTERING_NU - 1),
+				(x % ATMOSPHERE_SCATTERING_MU_S + 0.5f) / ATMOSPHERE_SCATTERING_MU_S,
+				(y + 0.5f) / ATMOSPHERE_SCATTERING_MU,
+				(z + 0.5f) / ATMOSPHERE_SCATTERING_R);
+			float r, mu, mu_s, nu;
+			bool ground;
+			scattering_r_mu_mu_s_nu(p, uvwz, r, mu, mu_s, nu, ground);
+
+			//nu is only free within what mu and mu_s allow
+			float spread = sqrtf((1.0f - mu * mu) * (1.0f - mu_s * mu_s));
+			nu = std::max(mu * mu_s - spread, std::min(mu * mu_s + spread, nu));
+
+			float length = ground ? distance_to_bottom(p, r, mu) : distance_to_top(p, r, mu);
+			float dx = length / SCATTERING_SAMPLES;
+			vec3 rayleigh(0.0f), mie(0.0f);
+			for (int k = 0; k <= SCATTERING_SAMPLES; k++) {
+				float d = k * dx;
+				float r_d = std::max(p.bottom_radius, std::min(p.top_radius, sqrtf(d * d + 2.0f * r * mu * d + r * r)));
+				float mu_s_d = clamp_cosine((r * mu_s + d * nu) / r_d);
+				vec3 t = transmittance(p, transmittance_table, r, mu, d, ground) * transmittance_to_sun(p, transmittance_table, r_d, mu_s_d);
+				float weight = k == 0 || k == SCATTERING_SAMPLES ? 0.5f : 1.0f;
+				rayleigh += t * rayleigh_density(p, r_d - p.bottom_radius) * weight;
+				mie += t * mie_density(p, r_d - p.bottom_radius) * weight;
+			}
+			rayleigh *= rayleigh_scattering * dx;
+			mie *= p.mie_scattering * dx;
+			for (int c = 0; c < 3; c++) {
+				rayleigh_table[i * 3 + c] = rayleigh[c];
+				mie_table[i * 3 + c] = mie[c];
+			}
+		}
+	});
+}
+
+// Light reaching the ground from the sky, over the upper hemisphere
+static void compute_irradiance(const AtmosphereParams& p, const std::vector<float>& rayleigh_table,
+	const std::vector<float>& mie_table, std::vector<float>& table) {
+	table.assign(ATMOSPHERE_IRRADIANCE_W * ATMOSPHERE_IRRADIANCE_H * 3, 0.0f);
+
+	parallel_for(0, ATMOSPHERE_IRRADIANCE_W * ATMOSPHERE_IRRADIANCE_H, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			int x = (int)(i % ATMOSPHERE_IRRADIANCE_W), y = (int)(i / ATMOSPHERE_IRRADIANCE_W);
+			float mu_s = clamp_cosine(2.0f * unit_from_coord((x + 0.5f) / ATMOSPHERE_IRRADIANCE_W, ATMOSPHERE_IRRADIANCE_W) - 1.0f);
+			float r = p.bottom_radius + unit_from_coord((y + 0.5f) / ATMOSPHERE_IRRADIANCE_H, ATMOSPHERE_IRRADIANCE_H) *
+				(p.top_radius - p.bottom_radius);
+			vec3 sun(sqrtf(1.0f - mu_s * mu_s), 0.0f, mu_s);
+
+			const float d_theta = PI / (2.0f * IRRADIANCE_SAMPLES_THETA);
+			const float d_phi = 2.0f * PI / IRRADIANCE_SAMPLES_PHI;
+			vec3 irradiance(0.0f);
+			for (int j = 0; j < IRRADIANCE_SAMPLES_THETA; j++) {
+				float theta = (j + 0.5f) * d_theta;
+				for (int k = 0; k < IRRADIANCE_SAMPLES_PHI; k++) {
+					float phi = (k + 0.5f) * d_phi;
+					vec3 omega(cosf(phi) * sinf(theta), sinf(phi) * sinf(theta), cosf(theta));
+					float nu = glm::dot(omega, sun);
+					vec3 radiance = scattering_lookup(p, rayleigh_table, r, omega.z, mu_s, nu, false) * rayleigh_phase(nu) +
+						scattering_lookup(p, mie_table, r, omega.z, mu_s, nu, false) * mie_phase(p.mie_g, nu);
+					irradiance += radiance * omega.z * sinf(theta) * d_theta * d_phi;
+				}
+			}
+			table[i * 3 + 0] = irradiance.x;
+			table[i * 3 + 1] = irradiance.y;
+			table[i * 3 + 2] = irradiance.z;
+		}
+	});
+}
+
+void atmosphere_precompute(const AtmosphereParams& params, AtmosphereLuts& luts) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	std::vector<float> rayleigh, mie;
+	compute_transmittance(params, luts.transmittance);
+	compute_single_scattering(params, luts.transmittance, rayleigh, mie);
+	compute_irradiance(params, rayleigh, mie, luts.irradiance);
+
+	//one RGBA texture: Rayleigh in rgb, the red channel of Mie in alpha (the shader
+	//extrapolates the other two from the Rayleigh ratios)
+	size_t texels = rayleigh.size() / 3;
+	luts.scattering.resize(texels * 4);
+	for (size_t i = 0; i < texels; i++) {
+		luts.scattering[i * 4 + 0] = rayleigh[i * 3 + 0];
+		luts.scattering[i * 4 + 1] = rayleigh[i * 3 + 1];
+		luts.scattering[i * 4 + 2] = rayleigh[i * 3 + 2];
+		luts.scattering[i * 4 + 3] = mie[i * 3 + 0];
+	}
+
+	luts.from_cache = false;
+	luts.compute_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// ------------------------------------------------------------------------------------------
+// Binary cache: a header with the parameters, then the three tables
+// ------------------------------------------------------------------------------------------
+struct AtmosphereCacheHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int sizes[8]; //table dimensions, as compiled
+	AtmosphereParams params;
+};
+
+static void cache_header(AtmosphereCacheHeader& header, const AtmosphereParams& params) {
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "ATML", 4);
+	header.version = ATMOSPHERE_CACHE_VERSION;
+	unsigned int sizes[8] = { ATMOSPHERE_TRANSMITTANCE_W, ATMOSPHERE_TRANSMITTANCE_H, ATMOSPHERE_SCATTERING_R,
+		ATMOSPHERE_SCATTERING_MU, ATMOSPHERE_SCATTERING_MU_S, ATMOSPHERE_SCATTERING_NU, ATMOSPHERE_IRRADIANCE_W, ATMOSPHERE_IRRADIANCE_H };
+	memcpy(header.sizes, sizes, sizeof(sizes));
+	header.params = params;
+}
+
+static void cache_counts(size_t counts[3]) {
+	counts[0] = ATMOSPHERE_TRANSMITTANCE_W * ATMOSPHERE_TRANSMITTANCE_H * 3;
+	counts[1] = ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S * ATMOSPHERE_SCATTERING_MU * ATMOSPHERE_SCATTERING_R * 4;
+	counts[2] = ATMOSPHERE_IRRADIANCE_W * ATMOSPHERE_IRRADIANCE_H * 3;
+}
+
+static void cache_tables(AtmosphereLuts& luts, std::vector<float>* tables[3], size_t counts[3]) {
+	tables[0] = &luts.transmittance;
+	tables[1] = &luts.scattering;
+	tables[2] = &luts.irradiance;
+	cache_counts(counts);
+}
+
+static void cache_tables(const AtmosphereLuts& luts, const std::vector<float>* tables[3], size_t counts[3]) {
+	tables[0] = &luts.transmittance;
+	tables[1] = &luts.scattering;
+	tables[2] = &luts.irradiance;
+	cache_counts(counts);
+}
+
+bool atmosphere_write_cache(const char* cache_path, const AtmosphereParams& params, const AtmosphereLuts& luts) {
+	FILE* file = fopen(cache_path, "wb");
+	if (!file) return false;
+
+	AtmosphereCacheHeader header;
+	cache_header(header, params);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	const std::vector<float>* tables[3];
+	size_t counts[3];
+	cache_tables(luts, tables, counts);
+	for (int k = 0; k < 3 && ok; k++) {
+		ok = tables[k]->size() == counts[k] && fwrite(&(*tables[k])[0], sizeof(float), counts[k], file) == counts[k];
+	}
+	fclose(file);
+	if (!ok) remove(cache_path);
+	return ok;
+}
+
+bool atmosphere_read_cache(const char* cache_path, const AtmosphereParams& params, AtmosphereLuts& luts) {
+	FILE* file = fopen(cache_path, "rb");
+	if (!file) return false;
+
+	AtmosphereCacheHeader expected, header;
+	cache_header(expected, params);
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(&header, &expected, sizeof(header)) == 0;
+	if (ok) {
+		std::vector<float>* tables[3];
+		size_t counts[3];
+		cache_tables(luts, tables, counts);
+		for (int k = 0; k < 3 && ok; k++) {
+			tables[k]->resize(counts[k]);
+			ok = fread(&(*tables[k])[0], sizeof(float), counts[k], file) == counts[k];
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+void atmosphere_load(const char* cache_path, const AtmosphereParams& params, AtmosphereLuts& luts) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	if (atmosphere_read_cache(cache_path, params, luts)) {
+		luts.from_cache = true;
+		luts.compute_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		return;
+	}
+	atmosphere_precompute(params, luts);
+	if (!atmosphere_write_cache(cache_path, params, luts)) {
+		fprintf(stderr, "Could not write atmosphere cache %s\n", cache_path);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Textures
+// ------------------------------------------------------------------------------------------
+static void linear_clamp_parameters(GLenum target) {
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+void atmosphere_create_textures(Atmosphere& atmosphere, const AtmosphereLuts& luts) {
+	atmosphere_destroy(atmosphere);
+
+	glGenTextures(1, &atmosphere.transmittance_texture);
+	glBindTexture(GL_TEXTURE_2D, atmosphere.transmittance_texture);
+	linear_clamp_parameters(GL_TEXTURE_2D);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, ATMOSPHERE_TRANSMITTANCE_W, ATMOSPHERE_TRANSMITTANCE_H, 0,
+		GL_RGB, GL_FLOAT, &luts.transmittance[0]);
+
+	glGenTextures(1, &atmosphere.irradiance_texture);
+	glBindTexture(GL_TEXTURE_2D, atmosphere.irradiance_texture);
+	linear_clamp_parameters(GL_TEXTURE_2D);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, ATMOSPHERE_IRRADIANCE_W, ATMOSPHERE_IRRADIANCE_H, 0,
+		GL_RGB, GL_FLOAT, &luts.irradiance[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenTextures(1, &atmosphere.scattering_texture);
+	glBindTexture(GL_TEXTURE_3D, atmosphere.scattering_texture);
+	linear_clamp_parameters(GL_TEXTURE_3D);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S, ATMOSPHERE_SCATTERING_MU,
+		ATMOSPHERE_SCATTERING_R, 0, GL_RGBA, GL_FLOAT, &luts.scattering[0]);
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void atmosphere_destroy(Atmosphere& atmosphere) {
+	GLuint textures[3] = { atmosphere.transmittance_texture, atmosphere.scattering_texture, atmosphere.irradiance_texture };
+	for (int k = 0; k < 3; k++) {
+		if (textures[k]) glDeleteTextures(1, &textures[k]);
+	}
+	atmosphere.transmittance_texture = atmosphere.scattering_texture = atmosphere.irradiance_texture = 0;
+}
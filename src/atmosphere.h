@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+
+// Version of the LUT cache layout, bump when it or the precomputation changes
+#define ATMOSPHERE_CACHE_VERSION 1
+
+// Lookup table sizes (Bruneton's): transmittance over (mu, r), scattering over
+// (nu, mu_s, mu, r) with nu and mu_s packed along x of a 3D texture, irradiance over (mu_s, r)
+#define ATMOSPHERE_TRANSMITTANCE_W 256
+#define ATMOSPHERE_TRANSMITTANCE_H 64
+#define ATMOSPHERE_SCATTERING_R 32
+#define ATMOSPHERE_SCATTERING_MU 128
+#define ATMOSPHERE_SCATTERING_MU_S 32
+#define ATMOSPHERE_SCATTERING_NU 8
+#define ATMOSPHERE_IRRADIANCE_W 64
+#define ATMOSPHERE_IRRADIANCE_H 16
+
+// Earth's atmosphere, lengths in km. Plain floats so the cache can compare it byte for byte;
+// atmosphere_default_params() gives the Earth's values.
+struct AtmosphereParams {
+	float bottom_radius, top_radius;
+	float rayleigh_scattering[3]; //per km, at sea level
+	float rayleigh_scale_height;
+	float mie_scattering, mie_extinction; //grey
+	float mie_scale_height;
+	float mie_g; //phase function asymmetry
+	float ozone_absorption[3]; //per km, at the peak of the layer
+	float ozone_center, ozone_width; //tent profile
+	float sun_angular_radius; //radians
+	float mu_s_min; //cosine of the lowest sun zenith angle tabulated
+};
+
+AtmosphereParams atmosphere_default_params();
+
+// Precomputed scattering in the style of Bruneton and Neyret: transmittance to the top of
+// the atmosphere, single Rayleigh and Mie scattering (Mie in alpha, red channel only) and
+// the sky irradiance on the ground lit by that scattering. Multiple scattering is left out.
+struct AtmosphereLuts {
+	std::vector<float> transmittance; //rgb
+	std::vector<float> scattering; //rgba
+	std::vector<float> irradiance; //rgb
+	bool from_cache;
+	double compute_ms;
+
+	AtmosphereLuts() : from_cache(false), compute_ms(0.0) {}
+};
+
+// The LUTs on the GPU
+struct Atmosphere {
+	GLuint transmittance_texture;
+	GLuint scattering_texture; //3D
+	GLuint irradiance_texture;
+
+	Atmosphere() : transmittance_texture(0), scattering_texture(0), irradiance_texture(0) {}
+};
+
+// Computes all three tables with parallel_for (transmittance first, the others read it)
+void atmosphere_precompute(const AtmosphereParams& params, AtmosphereLuts& luts);
+
+// Reads the tables from cache_path if it was written for the same parameters, otherwise
+// computes them and writes the cache
+void atmosphere_load(const char* cache_path, const AtmosphereParams& params, AtmosphereLuts& luts);
+
+bool atmosphere_write_cache(const char* cache_path, const AtmosphereParams& params, const AtmosphereLuts& luts);
+bool atmosphere_read_cache(const char* cache_path, const AtmosphereParams& params, AtmosphereLuts& luts);
+
+// Uploads the tables as half float textures
+void atmosphere_create_textures(Atmosphere& atmosphere, const AtmosphereLuts& luts);
+void atmosphere_destroy(Atmosphere& atmosphere);
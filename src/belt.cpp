@@ -0,0 +1,140 @@
+#include "belt.h"
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "glfunctions.h"
+
+// Low-poly rock: an icosahedron, squashed per body in the vertex shader
+static void icosahedron(std::vector<float>& vertices, std::vector<GLuint>& indices) {
+	const float t = (1.0f + sqrtf(5.0f)) * 0.5f;
+	float v[12][3] = {
+		{ -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+		{ 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+		{ t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+	};
+	GLuint f[20][3] = {
+		{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+		{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+		{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+		{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+	};
+	float length = sqrtf(1.0f + t * t);
+	for (int i = 0; i < 12; i++) {
+		for (int k = 0; k < 3; k++) vertices.push_back(v[i][k] / length);
+	}
+	for (int i = 0; i < 20; i++) {
+		for (int k = 0; k < 3; k++) indices.push_back(f[i][k]);
+	}
+}
+
+static GLuint create_static_buffer(const std::vector<float>& data) {
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return buffer;
+}
+
+static void bind_attribute(GLuint shader, const char* attrib, GLuint buffer, GLint size, GLuint divisor) {
+	GLint location = glGetAttribLocation(shader, attrib);
+	if (location < 0) return;
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribDivisor(location, divisor);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void belt_create(GpuBelt& belt, GLuint shader, const OrbitSet& orbits, float min_size, float max_size) {
+	belt_destroy(belt);
+	belt.count = (int)orbits.size();
+	belt.epoch = orbits.epoch;
+	if (belt.count == 0) return;
+
+	//pack what the vertex shader needs: (M0, n, e, size), a*P and b*Q
+	std::vector<float> orbit(belt.count * 4), axis_p(belt.count * 3), axis_q(belt.count * 3);
+	std::mt19937 rng(belt.count);
+	std::uniform_real_distribution<float> size(min_size, max_size);
+	for (int i = 0; i < belt.count; i++) {
+		orbit[i * 4 + 0] = orbits.mean_anomaly[i];
+		orbit[i * 4 + 1] = orbits.mean_motion[i];
+		orbit[i * 4 + 2] = orbits.eccentricity[i];
+		orbit[i * 4 + 3] = size(rng);
+		axis_p[i * 3 + 0] = orbits.px[i]; axis_p[i * 3 + 1] = orbits.py[i]; axis_p[i * 3 + 2] = orbits.pz[i];
+		axis_q[i * 3 + 0] = orbits.qx[i]; axis_q[i * 3 + 1] = orbits.qy[i]; axis_q[i * 3 + 2] = orbits.qz[i];
+	}
+	belt.orbit_buffer = create_static_buffer(orbit);
+	belt.axis_p_buffer = create_static_buffer(axis_p);
+	belt.axis_q_buffer = create_static_buffer(axis_q);
+
+	std::vector<float> rock;
+	std::vector<GLuint> rock_indices;
+	icosahedron(rock, rock_indices);
+	belt.rock_buffer = create_static_buffer(rock);
+	belt.rock_indices = (int)rock_indices.size();
+
+	//points: the elements are plain vertex attributes, the shader does not read a_vertex (u_points)
+	belt.points_vao = gl_createAndBindVAO();
+	bind_attribute(shader, "a_orbit", belt.orbit_buffer, 4, 0);
+	bind_attribute(shader, "a_axis_p", belt.axis_p_buffer, 3, 0);
+	bind_attribute(shader, "a_axis_q", belt.axis_q_buffer, 3, 0);
+	gl_unbindVAO();
+
+	//rocks: the same buffers advance once per instance
+	belt.rocks_vao = gl_createAndBindVAO();
+	bind_attribute(shader, "a_vertex", belt.rock_buffer, 3, 0);
+	bind_attribute(shader, "a_orbit", belt.orbit_buffer, 4, 1);
+	bind_attribute(shader, "a_axis_p", belt.axis_p_buffer, 3, 1);
+	bind_attribute(shader, "a_axis_q", belt.axis_q_buffer, 3, 1);
+	glGenBuffers(1, &belt.rock_index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, belt.rock_index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, rock_indices.size() * sizeof(GLuint), &rock_indices[0], GL_STATIC_DRAW);
+	gl_unbindVAO();
+}
+
+void belt_destroy(GpuBelt& belt) {
+	GLuint buffers[5] = { belt.orbit_buffer, belt.axis_p_buffer, belt.axis_q_buffer, belt.rock_buffer, belt.rock_index_buffer };
+	for (int i = 0; i < 5; i++) {
+		if (buffers[i]) glDeleteBuffers(1, &buffers[i]);
+	}
+	if (belt.points_vao) glDeleteVertexArrays(1, &belt.points_vao);
+	if (belt.rocks_vao) glDeleteVertexArrays(1, &belt.rocks_vao);
+	belt = GpuBelt();
+}
+
+void belt_draw(const GpuBelt& belt, GLuint shader, double t, const glm::mat4& projection, const glm::mat4& view,
+	const glm::vec3& light_pos, float point_scale, bool rocks) {
+	if (belt.count == 0) return;
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+
+	// activate shader
+	glUseProgram(shader);
+
+	glUniformMatrix4fv(glGetUniformLocation(shader, "u_projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	glUniformMatrix4fv(glGetUniformLocation(shader, "u_view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniform1f(glGetUniformLocation(shader, "u_time"), (float)(t - belt.epoch));
+	glUniform3f(glGetUniformLocation(shader, "u_light_pos"), light_pos.x, light_pos.y, light_pos.z);
+	glUniform1f(glGetUniformLocation(shader, "u_point_scale"), point_scale);
+	glUniform1i(glGetUniformLocation(shader, "u_points"), rocks ? 0 : 1);
+	glUniform3f(glGetUniformLocation(shader, "u_color"), 0.55f, 0.5f, 0.45f);
+	glUniform3f(glGetUniformLocation(shader, "u_ambient"), 0.1f, 0.1f, 0.1f);
+
+	if (rocks) {
+		gl_bindVAO(belt.rocks_vao);
+		glDrawElementsInstanced(GL_TRIANGLES, belt.rock_indices, GL_UNSIGNED_INT, 0, belt.count);
+	}
+	else {
+		gl_bindVAO(belt.points_vao);
+		glDrawArrays(GL_POINTS, 0, belt.count);
+	}
+	gl_unbindVAO();
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "orbits.h"
+
+// Asteroid belt whose orbits are evaluated on the GPU: the elements are uploaded
+// once and the vertex shader solves Kepler's equation from a single time uniform,
+// so the per-frame CPU cost and upload do not depend on the belt size.
+struct GpuBelt {
+	GLuint points_vao; //one vertex per body
+	GLuint rocks_vao; //low-poly rock instanced once per body
+	GLuint orbit_buffer, axis_p_buffer, axis_q_buffer, rock_buffer, rock_index_buffer;
+	int count;
+	int rock_indices;
+	double epoch;
+
+	GpuBelt() : points_vao(0), rocks_vao(0), orbit_buffer(0), axis_p_buffer(0), axis_q_buffer(0),
+		rock_buffer(0), rock_index_buffer(0), count(0), rock_indices(0), epoch(0.0) {}
+};
+
+// Uploads the orbits (immutable afterwards); sizes are random between min_size and max_size
+void belt_create(GpuBelt& belt, GLuint shader, const OrbitSet& orbits, float min_size, float max_size);
+void belt_destroy(GpuBelt& belt);
+
+// point_scale converts size / distance into pixels (viewport height / (2 tan(fov / 2)))
+void belt_draw(const GpuBelt& belt, GLuint shader, double t, const glm::mat4& projection, const glm::mat4& view,
+	const glm::vec3& light_pos, float point_scale, bool rocks);
@@ -0,0 +1,80 @@
+#include "bloom.h"
+
+#include "glfunctions.h"
+
+void bloom_create(Bloom& bloom, int width, int height) {
+	bloom_destroy(bloom);
+	glGenVertexArrays(1, &bloom.vao);
+
+	//half resolution, then down to the budget
+	int w = width / 2 > 1 ? width / 2 : 1, h = height / 2 > 1 ? height / 2 : 1;
+	while ((long long)w * h > BLOOM_BUDGET_PIXELS) {
+		w = w / 2 > 1 ? w / 2 : 1;
+		h = h / 2 > 1 ? h / 2 : 1;
+	}
+
+	for (bloom.levels = 0; bloom.levels < BLOOM_MAX_LEVELS && w >= 2 && h >= 2; bloom.levels++) {
+		bloom.widths[bloom.levels] = w;
+		bloom.heights[bloom.levels] = h;
+		w /= 2;
+		h /= 2;
+	}
+}
+
+void bloom_destroy(Bloom& bloom) {
+	if (bloom.vao) glDeleteVertexArrays(1, &bloom.vao);
+	bloom.vao = 0;
+	bloom.levels = 0;
+}
+
+// One fullscreen triangle sampling 'source' into the bound framebuffer
+static void bloom_pass(const Bloom& bloom, GLuint shader, GLuint source, int source_width, int source_height) {
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glUseProgram(shader);
+	glUniform2f(glGetUniformLocation(shader, "u_texel"), 1.0f / source_width, 1.0f / source_height);
+	glUniform1i(glGetUniformLocation(shader, "u_texture"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source);
+	gl_bindVAO(bloom.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_unbindVAO();
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+}
+
+void bloom_downsample(const Bloom& bloom, GLuint down_shader, GLuint source, int source_width, int source_height, bool prefilter) {
+	glDisable(GL_BLEND);
+	glUseProgram(down_shader);
+	glUniform1f(glGetUniformLocation(down_shader, "u_threshold"), bloom.threshold);
+	glUniform1i(glGetUniformLocation(down_shader, "u_prefilter"), prefilter ? 1 : 0);
+	bloom_pass(bloom, down_shader, source, source_width, source_height);
+}
+
+void bloom_upsample(const Bloom& bloom, GLuint up_shader, GLuint source, int source_width, int source_height) {
+	//each level added into the one above, level 0 ends up with the whole chain
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	bloom_pass(bloom, up_shader, source, source_width, source_height);
+	glDisable(GL_BLEND);
+}
+
+void bloom_tonemap(const Bloom& bloom, GLuint tonemap_shader, GLuint scene_texture, GLuint bloom_texture) {
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_BLEND);
+	glUseProgram(tonemap_shader);
+	glUniform1i(glGetUniformLocation(tonemap_shader, "u_scene"), 0);
+	glUniform1i(glGetUniformLocation(tonemap_shader, "u_bloom"), 1);
+	glUniform1f(glGetUniformLocation(tonemap_shader, "u_bloom_intensity"), bloom_texture ? bloom.intensity : 0.0f);
+	glUniform1f(glGetUniformLocation(tonemap_shader, "u_exposure"), bloom.exposure);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, bloom_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, scene_texture);
+	gl_bindVAO(bloom.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_unbindVAO();
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <GL/glew.h>
+
+// Levels of the downsample/upsample chain, at most
+#define BLOOM_MAX_LEVELS 6
+// Pixels of the first (largest) level, at most: the chain costs the same at 1080p and 4K
+#define BLOOM_BUDGET_PIXELS (960 * 540)
+
+// Bloom on an HDR scene with the dual filter (dual Kawase) chain: the bright part of the
+// scene is downsampled level by level with a 5-tap filter, then upsampled back with a
+// 8-tap filter, each level added to the one above. Every tap is bilinear, so the blur
+// widens with each level at a fraction of a Gaussian's cost. The first level is half the
+// scene or smaller, down to the pixel budget, and a tonemapping pass adds the result to
+// the scene on the way to the window. The level textures belong to the frame graph; each
+// step draws into whatever framebuffer is bound.
+struct Bloom {
+	GLuint vao; //empty, the fullscreen triangle comes from gl_VertexID
+	int widths[BLOOM_MAX_LEVELS], heights[BLOOM_MAX_LEVELS];
+	int levels;
+
+	float threshold; //scene brightness where bloom starts
+	float intensity; //bloom added on top of the scene
+	float exposure; //scale before tonemapping
+
+	Bloom() : vao(0), levels(0), threshold(1.0f), intensity(0.08f), exposure(1.0f) {
+		for (int i = 0; i < BLOOM_MAX_LEVELS; i++) widths[i] = heights[i] = 0;
+	}
+};
+
+// Sizes the chain for a scene of width x height pixels
+void bloom_create(Bloom& bloom, int width, int height);
+void bloom_destroy(Bloom& bloom);
+
+// Downsamples source (source_width x source_height) into the bound level; the first step
+// from the scene applies the threshold (prefilter)
+void bloom_downsample(const Bloom& bloom, GLuint down_shader, GLuint source, int source_width, int source_height, bool prefilter);
+// Upsamples source and adds it to the bound level above
+void bloom_upsample(const Bloom& bloom, GLuint up_shader, GLuint source, int source_width, int source_height);
+// Tonemaps scene plus bloom (level 0, or 0 for none) into the bound framebuffer
+void bloom_tonemap(const Bloom& bloom, GLuint tonemap_shader, GLuint scene_texture, GLuint bloom_texture);
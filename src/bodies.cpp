@@ -0,0 +1,43 @@
+#include "bodies.h"
+
+void BodyStore::clear() {
+	pos_x.clear(); pos_y.clear(); pos_z.clear();
+	rotation.clear(); clouds_rotation.clear(); scale.clear();
+	texture_id.clear(); texture_spec_id.clear(); normal_map_id.clear(); texture_night_id.clear();
+	name_id.clear(); type.clear();
+	name_table.clear(); name_lookup.clear();
+}
+
+size_t BodyStore::add(const std::string& name, BodyType body_type, float body_scale) {
+	pos_x.push_back(0.0); pos_y.push_back(0.0); pos_z.push_back(0.0);
+	rotation.push_back(0.0f);
+	clouds_rotation.push_back(0.0f);
+	scale.push_back(body_scale);
+
+	texture_id.push_back(0);
+	texture_spec_id.push_back(0);
+	normal_map_id.push_back(0);
+	texture_night_id.push_back(0);
+
+	name_id.push_back(intern(name));
+	type.push_back((unsigned char)body_type);
+	return size() - 1;
+}
+
+int BodyStore::intern(const std::string& name) {
+	std::unordered_map<std::string, int>::const_iterator it = name_lookup.find(name);
+	if (it != name_lookup.end()) return it->second;
+	int id = (int)name_table.size();
+	name_table.push_back(name);
+	name_lookup[name] = id;
+	return id;
+}
+
+int BodyStore::find(const std::string& name) const {
+	std::unordered_map<std::string, int>::const_iterator it = name_lookup.find(name);
+	if (it == name_lookup.end()) return -1;
+	for (size_t i = 0; i < size(); i++) {
+		if (name_id[i] == it->second) return (int)i;
+	}
+	return -1;
+}
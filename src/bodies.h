@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+
+// Picks the render path of a body, so the frame loop never compares names
+enum BodyType {
+	BODY_SUN = 0,
+	BODY_PLANET = 1,
+	BODY_EARTH = 2 //planet with specular, normal and night maps plus clouds
+};
+
+// Solar system bodies in structure-of-arrays form, split by access pattern:
+// hot kinematic arrays streamed by update() every frame, render handles read
+// only by the draw calls, and cold metadata used at load time or for display.
+struct BodyStore {
+	//hot: kinematics
+	std::vector<double> pos_x, pos_y, pos_z; //double so real-scale distances keep meter-level precision
+	std::vector<float> rotation; //spin, degrees
+	std::vector<float> clouds_rotation; //degrees
+	std::vector<float> scale; //uniform
+
+	//render handles
+	std::vector<GLuint> texture_id;
+	std::vector<GLuint> texture_spec_id;
+	std::vector<GLuint> normal_map_id;
+	std::vector<GLuint> texture_night_id;
+
+	//cold: metadata
+	std::vector<int> name_id; //index in name_table
+	std::vector<unsigned char> type; //BodyType
+
+	//interned names, each stored once
+	std::vector<std::string> name_table;
+	std::unordered_map<std::string, int> name_lookup;
+
+	size_t size() const { return pos_x.size(); }
+	void clear();
+
+	//Adds a body at the origin with no textures and returns its index
+	size_t add(const std::string& name, BodyType body_type, float body_scale);
+
+	int intern(const std::string& name);
+	const std::string& name(size_t body) const { return name_table[name_id[body]]; }
+	int find(const std::string& name) const; //first body with that name, -1 if none
+};
@@ -0,0 +1,428 @@
+#include "bvh.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <emmintrin.h>
+
+#include "jobs.h"
+
+typedef std::chrono::high_resolution_clock bvh_clock;
+
+static double elapsed_ms(bvh_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(bvh_clock::now() - start).count();
+}
+
+static inline float sphere_coord(const BvhSpheres& s, const float* base, int i) {
+	return base[(size_t)i * s.stride];
+}
+
+static void empty_box(BvhNode& node) {
+	for (int k = 0; k < 3; k++) {
+		node.bmin[k] = FLT_MAX;
+		node.bmax[k] = -FLT_MAX;
+	}
+}
+
+static float surface_area(const BvhNode& node) {
+	float dx = node.bmax[0] - node.bmin[0], dy = node.bmax[1] - node.bmin[1], dz = node.bmax[2] - node.bmin[2];
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static BvhNode make_node() {
+	BvhNode node;
+	empty_box(node);
+	node.left = node.right = -1;
+	node.first = node.count = 0;
+	return node;
+}
+
+// Median split along the widest axis of the centroids, returns the split position
+static int split(int* indices, const BvhSpheres& s, int begin, int end) {
+	float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	const float* base[3] = { s.x, s.y, s.z };
+	for (int i = begin; i < end; i++) {
+		for (int k = 0; k < 3; k++) {
+			float c = sphere_coord(s, base[k], indices[i]);
+			cmin[k] = std::min(cmin[k], c);
+			cmax[k] = std::max(cmax[k], c);
+		}
+	}
+	int axis = 0;
+	for (int k = 1; k < 3; k++) {
+		if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis]) axis = k;
+	}
+	int mid = (begin + end) / 2;
+	const float* coord = base[axis];
+	size_t stride = s.stride;
+	std::nth_element(indices + begin, indices + mid, indices + end, [coord, stride](int a, int b) {
+		return coord[(size_t)a * stride] < coord[(size_t)b * stride];
+	});
+	return mid;
+}
+
+// Recursive build of one subtree into 'nodes' (depth first), returns the local node index
+static int build_subtree(std::vector<BvhNode>& nodes, int* indices, const BvhSpheres& s, int begin, int end) {
+	int index = (int)nodes.size();
+	nodes.push_back(make_node());
+	if (end - begin <= BVH_LEAF_SIZE) {
+		nodes[index].first = begin;
+		nodes[index].count = end - begin;
+		return index;
+	}
+	int mid = split(indices, s, begin, end);
+	int left = build_subtree(nodes, indices, s, begin, mid);
+	int right = build_subtree(nodes, indices, s, mid, end);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+struct BvhRange {
+	int begin, end;
+};
+
+// Top levels, serial. Children that become subtrees are encoded as -(task + 2) until the
+// subtrees are built and their final positions known.
+static int build_top(Bvh& bvh, const BvhSpheres& s, int begin, int end, int depth, std::vector<BvhRange>& tasks) {
+	if (depth == BVH_TOP_DEPTH && end - begin > BVH_LEAF_SIZE) {
+		BvhRange range = { begin, end };
+		tasks.push_back(range);
+		return -(int)tasks.size() - 1;
+	}
+	int index = (int)bvh.nodes.size();
+	bvh.nodes.push_back(make_node());
+	if (end - begin <= BVH_LEAF_SIZE) {
+		bvh.nodes[index].first = begin;
+		bvh.nodes[index].count = end - begin;
+		return index;
+	}
+	int mid = split(&bvh.indices[0], s, begin, end);
+	int left = build_top(bvh, s, begin, mid, depth + 1, tasks);
+	int right = build_top(bvh, s, mid, end, depth + 1, tasks);
+	bvh.nodes[index].left = left;
+	bvh.nodes[index].right = right;
+	return index;
+}
+
+void bvh_build(Bvh& bvh, const BvhSpheres& spheres) {
+	int count = (int)spheres.count;
+	bvh.nodes.clear();
+	bvh.subtree_begin.clear();
+	bvh.indices.resize(count);
+	for (int i = 0; i < count; i++) bvh.indices[i] = i;
+	bvh.top_count = 0;
+	bvh.build_area = 0.0f;
+	if (count == 0) return;
+
+	std::vector<BvhRange> tasks;
+	build_top(bvh, spheres, 0, count, 0, tasks);
+	bvh.top_count = (int)bvh.nodes.size();
+
+	//subtrees in parallel, each into its own node list
+	std::vector<std::vector<BvhNode> > subtrees(tasks.size());
+	parallel_for(0, tasks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			subtrees[t].reserve(2 * (tasks[t].end - tasks[t].begin) / BVH_LEAF_SIZE + 1);
+			build_subtree(subtrees[t], &bvh.indices[0], spheres, tasks[t].begin, tasks[t].end);
+		}
+	});
+
+	//stitch: subtrees go after the top nodes, in task order
+	bvh.subtree_begin.push_back(bvh.top_count);
+	for (size_t t = 0; t < subtrees.size(); t++) bvh.subtree_begin.push_back(bvh.subtree_begin.back() + (int)subtrees[t].size());
+	for (int i = 0; i < bvh.top_count; i++) {
+		BvhNode& node = bvh.nodes[i];
+		if (node.left < -1) node.left = bvh.subtree_begin[-node.left - 2];
+		if (node.right < -1) node.right = bvh.subtree_begin[-node.right - 2];
+	}
+	bvh.nodes.resize(bvh.subtree_begin.back());
+	parallel_for(0, subtrees.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			int offset = bvh.subtree_begin[t];
+			for (size_t i = 0; i < subtrees[t].size(); i++) {
+				BvhNode node = subtrees[t][i];
+				if (node.left >= 0) { node.left += offset; node.right += offset; }
+				bvh.nodes[offset + i] = node;
+			}
+		}
+	});
+
+	bvh_refit(bvh, spheres);
+	bvh.build_area = surface_area(bvh.nodes[0]);
+}
+
+static void refit_node(Bvh& bvh, const BvhSpheres& s, int index) {
+	BvhNode& node = bvh.nodes[index];
+	if (node.left < 0) {
+		empty_box(node);
+		for (int k = node.first; k < node.first + node.count; k++) {
+			int i = bvh.indices[k];
+			float c[3] = { sphere_coord(s, s.x, i), sphere_coord(s, s.y, i), sphere_coord(s, s.z, i) };
+			float r = sphere_coord(s, s.r, i);
+			for (int a = 0; a < 3; a++) {
+				node.bmin[a] = std::min(node.bmin[a], c[a] - r);
+				node.bmax[a] = std::max(node.bmax[a], c[a] + r);
+			}
+		}
+		return;
+	}
+	const BvhNode& l = bvh.nodes[node.left];
+	const BvhNode& r = bvh.nodes[node.right];
+	for (int a = 0; a < 3; a++) {
+		node.bmin[a] = std::min(l.bmin[a], r.bmin[a]);
+		node.bmax[a] = std::max(l.bmax[a], r.bmax[a]);
+	}
+}
+
+float bvh_refit(Bvh& bvh, const BvhSpheres& spheres) {
+	if (bvh.nodes.empty()) return 1.0f;
+
+	//children come after their parent: reverse sweeps, the subtrees in parallel
+	size_t num_subtrees = bvh.subtree_begin.empty() ? 0 : bvh.subtree_begin.size() - 1;
+	parallel_for(0, num_subtrees, 1, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			for (int i = bvh.subtree_begin[t + 1] - 1; i >= bvh.subtree_begin[t]; i--) refit_node(bvh, spheres, i);
+		}
+	});
+	for (int i = bvh.top_count - 1; i >= 0; i--) refit_node(bvh, spheres, i);
+
+	return bvh.build_area > 0.0f ? surface_area(bvh.nodes[0]) / bvh.build_area : 1.0f;
+}
+
+// Entry distance of the ray into the box, FLT_MAX if it misses or starts beyond t_max
+static inline float ray_box(const BvhNode& node, const float origin[3], const float inv_dir[3], float t_max) {
+	float t0 = 0.0f, t1 = t_max;
+	for (int a = 0; a < 3; a++) {
+		float near_t = (node.bmin[a] - origin[a]) * inv_dir[a];
+		float far_t = (node.bmax[a] - origin[a]) * inv_dir[a];
+		if (near_t > far_t) std::swap(near_t, far_t);
+		t0 = near_t > t0 ? near_t : t0;
+		t1 = far_t < t1 ? far_t : t1;
+		if (t0 > t1) return FLT_MAX;
+	}
+	return t0;
+}
+
+int bvh_raycast(const Bvh& bvh, const BvhSpheres& s, const float origin[3], const float dir[3], float& t_hit) {
+	t_hit = FLT_MAX;
+	if (bvh.nodes.empty()) return -1;
+
+	float inv_dir[3];
+	for (int a = 0; a < 3; a++) inv_dir[a] = 1.0f / (dir[a] != 0.0f ? dir[a] : 1e-30f);
+
+	int hit = -1;
+	int stack[64];
+	int sp = 0;
+	if (ray_box(bvh.nodes[0], origin, inv_dir, t_hit) == FLT_MAX) return -1;
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const BvhNode& node = bvh.nodes[stack[--sp]];
+		if (node.left < 0) {
+			for (int k = node.first; k < node.first + node.count; k++) {
+				int i = bvh.indices[k];
+				float oc[3] = { sphere_coord(s, s.x, i) - origin[0], sphere_coord(s, s.y, i) - origin[1], sphere_coord(s, s.z, i) - origin[2] };
+				float r = sphere_coord(s, s.r, i);
+				float b = oc[0] * dir[0] + oc[1] * dir[1] + oc[2] * dir[2];
+				//r^2 minus the squared distance from the centre to the ray: b^2 - |oc|^2 + r^2
+				//cancels badly when the sphere is far away compared to its radius
+				float off[3] = { oc[0] - b * dir[0], oc[1] - b * dir[1], oc[2] - b * dir[2] };
+				float h = r * r - (off[0] * off[0] + off[1] * off[1] + off[2] * off[2]);
+				if (h < 0.0f) continue;
+				h = sqrtf(h);
+				float t = b - h >= 0.0f ? b - h : b + h; //from inside, the exit point
+				if (t >= 0.0f && t < t_hit) {
+					t_hit = t;
+					hit = i;
+				}
+			}
+			continue;
+		}
+
+		//nearer child on top of the stack, boxes beyond the current hit are skipped
+		float tl = ray_box(bvh.nodes[node.left], origin, inv_dir, t_hit);
+		float tr = ray_box(bvh.nodes[node.right], origin, inv_dir, t_hit);
+		int first = node.left, second = node.right;
+		if (tr < tl) { std::swap(tl, tr); std::swap(first, second); }
+		if (tr != FLT_MAX && sp < 64) stack[sp++] = second;
+		if (tl != FLT_MAX && sp < 64) stack[sp++] = first;
+	}
+	if (hit < 0) t_hit = FLT_MAX;
+	return hit;
+}
+
+// ------------------------------------------------------------------------------------------
+// Packets
+// ------------------------------------------------------------------------------------------
+struct PacketRays {
+	__m128 origin[3], dir[3], inv_dir[3];
+	__m128 t; //shrinks to the closest hit; -1 once an occlusion ray is blocked
+	__m128i hit, skip_below, ignore[2];
+};
+
+// Entry distance of each ray into the box, FLT_MAX where it misses
+static inline __m128 packet_box(const BvhNode& node, const PacketRays& r) {
+	__m128 t0 = _mm_setzero_ps(), t1 = r.t;
+	for (int a = 0; a < 3; a++) {
+		__m128 near_t = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmin[a]), r.origin[a]), r.inv_dir[a]);
+		__m128 far_t = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmax[a]), r.origin[a]), r.inv_dir[a]);
+		t0 = _mm_max_ps(t0, _mm_min_ps(near_t, far_t));
+		t1 = _mm_min_ps(t1, _mm_max_ps(near_t, far_t));
+	}
+	__m128 inside = _mm_cmple_ps(t0, t1);
+	return _mm_or_ps(_mm_and_ps(inside, t0), _mm_andnot_ps(inside, _mm_set1_ps(FLT_MAX)));
+}
+
+static inline float packet_min(__m128 v) {
+	float lanes[4];
+	_mm_storeu_ps(lanes, v);
+	return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+}
+
+// Same traversal as bvh_raycast with the packet's nearest entry deciding the child order.
+// 'any' ends a ray at its first hit; returns the rays that hit something.
+static int packet_traverse(const Bvh& bvh, const BvhSpheres& s, PacketRays& r, bool any) {
+	const __m128 zero = _mm_setzero_ps(), far_away = _mm_set1_ps(FLT_MAX);
+	int active = _mm_movemask_ps(_mm_cmpgt_ps(r.t, zero));
+	int hits = 0;
+	if (bvh.nodes.empty() || !active) return 0;
+	if (!_mm_movemask_ps(_mm_cmplt_ps(packet_box(bvh.nodes[0], r), far_away))) return 0;
+
+	int stack[64];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const BvhNode& node = bvh.nodes[stack[--sp]];
+		if (node.left < 0) {
+			for (int k = node.first; k < node.first + node.count; k++) {
+				int i = bvh.indices[k];
+				float radius = sphere_coord(s, s.r, i);
+				__m128 oc[3] = {
+					_mm_sub_ps(_mm_set1_ps(sphere_coord(s, s.x, i)), r.origin[0]),
+					_mm_sub_ps(_mm_set1_ps(sphere_coord(s, s.y, i)), r.origin[1]),
+					_mm_sub_ps(_mm_set1_ps(sphere_coord(s, s.z, i)), r.origin[2]) };
+				__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(oc[0], r.dir[0]), _mm_mul_ps(oc[1], r.dir[1])), _mm_mul_ps(oc[2], r.dir[2]));
+				//distance to the centre off the ray, as in bvh_raycast
+				__m128 off[3];
+				for (int a = 0; a < 3; a++) off[a] = _mm_sub_ps(oc[a], _mm_mul_ps(b, r.dir[a]));
+				__m128 off2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(off[0], off[0]), _mm_mul_ps(off[1], off[1])), _mm_mul_ps(off[2], off[2]));
+				__m128 h = _mm_sub_ps(_mm_set1_ps(radius * radius), off2);
+				__m128 valid = _mm_cmpge_ps(h, zero);
+				h = _mm_sqrt_ps(_mm_max_ps(h, zero));
+				__m128 entry = _mm_sub_ps(b, h);
+				__m128 front = _mm_cmpge_ps(entry, zero);
+				__m128 t = _mm_or_ps(_mm_and_ps(front, entry), _mm_andnot_ps(front, _mm_add_ps(b, h))); //from inside, the exit point
+				__m128 accept = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, r.t)));
+				__m128i index = _mm_set1_epi32(i);
+				__m128i skipped = _mm_or_si128(_mm_cmpgt_epi32(r.skip_below, index),
+					_mm_or_si128(_mm_cmpeq_epi32(r.ignore[0], index), _mm_cmpeq_epi32(r.ignore[1], index)));
+				accept = _mm_andnot_ps(_mm_castsi128_ps(skipped), accept);
+				int mask = _mm_movemask_ps(accept);
+				if (!mask) continue;
+				hits |= mask;
+				r.t = _mm_or_ps(_mm_and_ps(accept, any ? _mm_set1_ps(-1.0f) : t), _mm_andnot_ps(accept, r.t));
+				r.hit = _mm_or_si128(_mm_and_si128(_mm_castps_si128(accept), _mm_set1_epi32(i)), _mm_andnot_si128(_mm_castps_si128(accept), r.hit));
+				if (any && hits == active) return hits;
+			}
+			continue;
+		}
+
+		__m128 tl = packet_box(bvh.nodes[node.left], r);
+		__m128 tr = packet_box(bvh.nodes[node.right], r);
+		float nl = packet_min(tl), nr = packet_min(tr);
+		int first = node.left, second = node.right;
+		if (nr < nl) { std::swap(nl, nr); std::swap(first, second); }
+		if (nr != FLT_MAX && sp < 64) stack[sp++] = second;
+		if (nl != FLT_MAX && sp < 64) stack[sp++] = first;
+	}
+	return hits;
+}
+
+static void packet_load(const BvhPacket& packet, PacketRays& r) {
+	for (int a = 0; a < 3; a++) {
+		float inv_dir[4];
+		for (int k = 0; k < 4; k++) inv_dir[k] = 1.0f / (packet.dir[a][k] != 0.0f ? packet.dir[a][k] : 1e-30f);
+		r.origin[a] = _mm_loadu_ps(packet.origin[a]);
+		r.dir[a] = _mm_loadu_ps(packet.dir[a]);
+		r.inv_dir[a] = _mm_loadu_ps(inv_dir);
+	}
+	r.t = _mm_loadu_ps(packet.t);
+	r.hit = _mm_set1_epi32(-1);
+	r.skip_below = _mm_loadu_si128((const __m128i*)packet.skip_below);
+	for (int j = 0; j < 2; j++) r.ignore[j] = _mm_loadu_si128((const __m128i*)packet.ignore[j]);
+}
+
+void bvh_raycast4(const Bvh& bvh, const BvhSpheres& s, BvhPacket& packet) {
+	PacketRays r;
+	packet_load(packet, r);
+	packet_traverse(bvh, s, r, false);
+	_mm_storeu_si128((__m128i*)packet.hit, r.hit);
+	float t[4];
+	_mm_storeu_ps(t, r.t);
+	for (int k = 0; k < 4; k++) packet.t[k] = packet.hit[k] >= 0 ? t[k] : FLT_MAX;
+}
+
+int bvh_occluded4(const Bvh& bvh, const BvhSpheres& s, const BvhPacket& packet) {
+	PacketRays r;
+	packet_load(packet, r);
+	return packet_traverse(bvh, s, r, true);
+}
+
+// ------------------------------------------------------------------------------------------
+// Benchmark
+// ------------------------------------------------------------------------------------------
+void bvh_benchmark(size_t max_count) {
+	jobs_init(0);
+	printf("Sphere BVH picking: leaf size %d, %d threads\n", BVH_LEAF_SIZE, jobs_num_threads());
+	printf("  %10s %10s %10s %12s %10s\n", "spheres", "build ms", "refit ms", "query us", "hit rate");
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (size_t count = 10000; count <= max_count; count *= 10) {
+		//a thin disk of radius 100, like a belt seen from outside
+		std::vector<float> data(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			float angle = 3.14159265f * unit(rng), radius = 60.0f + 40.0f * unit(rng);
+			data[i * 4 + 0] = radius * cosf(angle);
+			data[i * 4 + 1] = 2.0f * unit(rng);
+			data[i * 4 + 2] = radius * sinf(angle);
+			data[i * 4 + 3] = 0.05f + 0.1f * (unit(rng) * 0.5f + 0.5f);
+		}
+		BvhSpheres spheres = { &data[0], &data[1], &data[2], &data[3], 4, count };
+
+		Bvh bvh;
+		bvh_clock::time_point start = bvh_clock::now();
+		bvh_build(bvh, spheres);
+		double build = elapsed_ms(start);
+
+		//move everything a little, as one frame of orbital motion would
+		for (size_t i = 0; i < count; i++) {
+			data[i * 4 + 0] += 0.01f * unit(rng);
+			data[i * 4 + 2] += 0.01f * unit(rng);
+		}
+		const int refits = 10;
+		start = bvh_clock::now();
+		for (int k = 0; k < refits; k++) bvh_refit(bvh, spheres);
+		double refit = elapsed_ms(start) / refits;
+
+		//rays from a camera above the disk towards random points on it
+		const int queries = 10000;
+		int hits = 0;
+		float origin[3] = { 0.0f, 80.0f, 160.0f };
+		start = bvh_clock::now();
+		for (int q = 0; q < queries; q++) {
+			float target[3] = { 100.0f * unit(rng), 0.0f, 100.0f * unit(rng) };
+			float dir[3] = { target[0] - origin[0], target[1] - origin[1], target[2] - origin[2] };
+			float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+			for (int a = 0; a < 3; a++) dir[a] /= length;
+			float t;
+			if (bvh_raycast(bvh, spheres, origin, dir, t) >= 0) hits++;
+		}
+		double query = elapsed_ms(start) * 1000.0 / queries;
+
+		printf("  %10u %10.2f %10.2f %12.2f %9.1f%%\n", (unsigned int)count, build, refit, query, 100.0 * hits / queries);
+	}
+	jobs_shutdown();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Primitives per leaf
+#define BVH_LEAF_SIZE 4
+// Levels built (and refit) serially before the subtrees are handed to the job system
+#define BVH_TOP_DEPTH 6
+
+// Bounding spheres read in place from the caller's arrays, with a stride in floats (as in
+// orbit_propagate): stride 16 with x = &models[0][3][0] and r = &models[0][0][0] reads
+// the instance matrices directly, as long as they carry a uniform scale and no rotation.
+struct BvhSpheres {
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* r;
+	size_t stride;
+	size_t count;
+};
+
+struct BvhNode {
+	float bmin[3], bmax[3];
+	int left, right; //children, -1 for leaves
+	int first, count; //primitive range in Bvh::indices, leaves only
+};
+
+// Bounding volume hierarchy over spheres. Built once with median splits, then refit every
+// frame as the spheres move: the topology stays, only the boxes are recomputed bottom-up.
+// Node layout: the top levels first, then every subtree contiguous, children always after
+// their parent, so a refit is a reverse sweep and the subtrees refit in parallel.
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<int> indices; //primitive indices, leaves reference ranges of it
+	std::vector<int> subtree_begin; //node range of each subtree, one more entry than subtrees
+	int top_count; //nodes before the first subtree
+	float build_area; //root surface area right after the build, to judge refit quality
+
+	Bvh() : top_count(0), build_area(0.0f) {}
+	size_t size() const { return indices.size(); }
+};
+
+void bvh_build(Bvh& bvh, const BvhSpheres& spheres);
+
+// Recomputes all boxes from the current sphere positions. Returns the root surface area
+// relative to the one at build time; rebuild when it has grown too much.
+float bvh_refit(Bvh& bvh, const BvhSpheres& spheres);
+
+// Closest sphere hit by the ray origin + t * dir (dir normalized), -1 if none
+int bvh_raycast(const Bvh& bvh, const BvhSpheres& spheres, const float origin[3], const float dir[3], float& t_hit);
+
+// Four rays traced together, one per SSE lane; meant for coherent rays such as a 2x2 pixel
+// quad or the shadow rays leaving it. A node is visited when any ray in the packet enters it.
+struct BvhPacket {
+	float origin[3][4]; //per axis, per ray
+	float dir[3][4]; //normalized
+	float t[4]; //in: how far each ray goes, <= 0 for an unused ray; out: the hit distance
+	int hit[4]; //out: sphere index, -1 if none
+	int skip_below[4]; //spheres with a lower index are ignored by that ray
+	int ignore[2][4]; //two more spheres each ray ignores, such as the one it leaves; -1 for none
+};
+
+// Closest sphere each ray of the packet hits
+void bvh_raycast4(const Bvh& bvh, const BvhSpheres& spheres, BvhPacket& packet);
+
+// Rays (bit k for ray k) that hit any sphere before their t, for shadow rays. Stops as soon
+// as every ray is blocked.
+int bvh_occluded4(const Bvh& bvh, const BvhSpheres& spheres, const BvhPacket& packet);
+
+// Times build, refit and ray queries for sphere counts up to max_count
+void bvh_benchmark(size_t max_count);
@@ -0,0 +1,233 @@
+#include "capture.h"
+#include "png.h"
+
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Counts the frame index conversions (%d, %Nd, %0Nd) in a PNG pattern, -1 if it has any other
+// conversion: it goes to snprintf as the format, so "%%" is the only other '%' allowed
+static int pattern_conversions(const char* pattern) {
+	int count = 0;
+	for (const char* c = pattern; *c; c++) {
+		if (*c != '%') continue;
+		c++;
+		if (*c == '%') continue;
+		while (*c >= '0' && *c <= '9') c++;
+		if (*c != 'd') return -1;
+		count++;
+	}
+	return count;
+}
+
+// One file per frame, top row first
+static bool write_png(const char* path, const unsigned char* rgba, int width, int height, PngWriter& png) {
+	if (!png_begin(png, path, width, height)) return false;
+	for (int y = height - 1; y >= 0; y--) png_write_row(png, rgba + (size_t)y * width * 4);
+	return png_end(png);
+}
+
+// ------------------------------------------------------------------------------------------
+// Y4M: RGB to BT.709 limited-range YCbCr, chroma averaged over 2x2 pixels
+// ------------------------------------------------------------------------------------------
+static bool write_y4m_frame(FILE* file, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& planes) {
+	int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+	size_t luma_size = (size_t)width * height, chroma_size = (size_t)chroma_width * chroma_height;
+	planes.resize(luma_size + 2 * chroma_size);
+	unsigned char* Y = &planes[0];
+	unsigned char* U = Y + luma_size;
+	unsigned char* V = U + chroma_size;
+
+	for (int cy = 0; cy < chroma_height; cy++) {
+		for (int cx = 0; cx < chroma_width; cx++) {
+			float cb = 0.0f, cr = 0.0f;
+			int samples = 0;
+			for (int dy = 0; dy < 2; dy++) {
+				int y = cy * 2 + dy;
+				if (y >= height) continue;
+				for (int dx = 0; dx < 2; dx++) {
+					int x = cx * 2 + dx;
+					if (x >= width) continue;
+					const unsigned char* p = rgba + ((size_t)(height - 1 - y) * width + x) * 4; //bottom row first
+					float luma = 0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2];
+					Y[(size_t)y * width + x] = (unsigned char)(16.0f + luma * (219.0f / 255.0f) + 0.5f);
+					cb += (p[2] - luma) / 1.8556f;
+					cr += (p[0] - luma) / 1.5748f;
+					samples++;
+				}
+			}
+			U[(size_t)cy * chroma_width + cx] = (unsigned char)(128.0f + cb / samples * (224.0f / 255.0f) + 0.5f);
+			V[(size_t)cy * chroma_width + cx] = (unsigned char)(128.0f + cr / samples * (224.0f / 255.0f) + 0.5f);
+		}
+	}
+	fputs("FRAME\n", file);
+	fwrite(&planes[0], 1, planes.size(), file);
+	return ferror(file) == 0;
+}
+
+static void writer_thread(Capture* capture) {
+	std::vector<unsigned char> scratch;
+	PngWriter png;
+	char name[1024];
+	for (;;) {
+		CaptureQueuedFrame frame;
+		{
+			std::unique_lock<std::mutex> guard(capture->lock);
+			capture->changed.wait(guard, [capture]() { return !capture->queue.empty() || capture->closing; });
+			if (capture->queue.empty()) return;
+			frame.rgba.swap(capture->queue.front().rgba);
+			frame.index = capture->queue.front().index;
+			capture->queue.pop_front();
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		bool ok;
+		if (capture->format == CAPTURE_Y4M) ok = write_y4m_frame(capture->file, &frame.rgba[0], capture->width, capture->height, scratch);
+		else {
+			snprintf(name, sizeof(name), capture->path.c_str(), frame.index);
+			ok = write_png(name, &frame.rgba[0], capture->width, capture->height, png);
+		}
+		double ms = elapsed_ms(start);
+
+		std::lock_guard<std::mutex> guard(capture->lock);
+		capture->write_ms += ms;
+		capture->written++;
+		if (!ok && !capture->failed) {
+			printf("Capture: writing frame %d failed\n", frame.index);
+			capture->failed = true;
+		}
+		capture->spare.push_back(std::vector<unsigned char>());
+		capture->spare.back().swap(frame.rgba);
+		capture->changed.notify_all();
+	}
+}
+
+// Maps the buffer in 'slot' (its fence has normally passed long ago) and queues the frame
+static void retrieve(Capture& capture, int slot) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	while (glClientWaitSync(capture.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+	glDeleteSync(capture.fences[slot]);
+	capture.fences[slot] = 0;
+
+	std::vector<unsigned char> rgba;
+	{
+		std::lock_guard<std::mutex> guard(capture.lock);
+		if (!capture.spare.empty()) {
+			rgba.swap(capture.spare.back());
+			capture.spare.pop_back();
+		}
+	}
+	size_t bytes = (size_t)capture.width * capture.height * 4;
+	rgba.resize(bytes);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+	const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+	if (mapped) memcpy(&rgba[0], mapped, bytes);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture.readback_ms += elapsed_ms(start);
+
+	start = std::chrono::high_resolution_clock::now();
+	std::unique_lock<std::mutex> guard(capture.lock);
+	capture.changed.wait(guard, [&capture]() { return capture.queue.size() < CAPTURE_QUEUE_FRAMES; });
+	capture.queue_wait_ms += elapsed_ms(start);
+	CaptureQueuedFrame frame;
+	frame.index = capture.pbo_frame[slot];
+	capture.queue.push_back(frame);
+	capture.queue.back().rgba.swap(rgba);
+	capture.pbo_frame[slot] = -1;
+	capture.changed.notify_all();
+}
+
+bool capture_open(Capture& capture, const char* path, int width, int height, double fps) {
+	size_t length = strlen(path);
+	bool y4m = length >= 4 && strcmp(path + length - 4, ".y4m") == 0;
+	capture.format = y4m ? CAPTURE_Y4M : CAPTURE_PNG;
+	capture.path = path;
+	if (!y4m && pattern_conversions(path) == 0) capture.path += "%05d.png";
+	if (!y4m && pattern_conversions(capture.path.c_str()) != 1) {
+		printf("Capture: %s needs one frame number conversion (%%d or %%05d) and no other '%%' than %%%%\n", path);
+		return false;
+	}
+	capture.width = width;
+	capture.height = height;
+	capture.fps = fps;
+	capture.frames = capture.written = 0;
+	capture.closing = capture.failed = false;
+
+	if (y4m) {
+		capture.file = fopen(path, "wb");
+		if (!capture.file) {
+			printf("Capture: cannot open %s\n", path);
+			return false;
+		}
+		//frame rate as a ratio, exact for integer rates
+		int numerator = (int)floor(fps * 1000.0 + 0.5), denominator = 1000;
+		if (numerator % 1000 == 0) { numerator /= 1000; denominator = 1; }
+		fprintf(capture.file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, numerator, denominator);
+	}
+
+	glGenTextures(1, &capture.texture);
+	glBindTexture(GL_TEXTURE_2D, capture.texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenFramebuffers(1, &capture.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, capture.fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, capture.texture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(CAPTURE_PBO_COUNT, capture.pbos);
+	for (int i = 0; i < CAPTURE_PBO_COUNT; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+		capture.pbo_frame[i] = -1;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	capture.writer = std::thread(writer_thread, &capture);
+	return true;
+}
+
+void capture_frame(Capture& capture) {
+	int slot = capture.frames % CAPTURE_PBO_COUNT;
+	if (capture.pbo_frame[slot] >= 0) retrieve(capture, slot);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, capture.fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, 0); //returns at once, into the buffer
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	capture.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	capture.pbo_frame[slot] = capture.frames++;
+}
+
+void capture_close(Capture& capture) {
+	if (!capture.texture) return;
+	//oldest first, so the writer keeps the frames in order
+	for (int i = 0; i < CAPTURE_PBO_COUNT; i++) {
+		int slot = (capture.frames + i) % CAPTURE_PBO_COUNT;
+		if (capture.pbo_frame[slot] >= 0) retrieve(capture, slot);
+	}
+	{
+		std::lock_guard<std::mutex> guard(capture.lock);
+		capture.closing = true;
+		capture.changed.notify_all();
+	}
+	if (capture.writer.joinable()) capture.writer.join();
+	if (capture.file) fclose(capture.file);
+	capture.file = NULL;
+
+	glDeleteBuffers(CAPTURE_PBO_COUNT, capture.pbos);
+	glDeleteFramebuffers(1, &capture.fbo);
+	glDeleteTextures(1, &capture.texture);
+	for (int i = 0; i < CAPTURE_PBO_COUNT; i++) capture.pbos[i] = 0;
+	capture.fbo = capture.texture = 0;
+	capture.spare.clear();
+}
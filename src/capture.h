@@ -0,0 +1,77 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+// Pixel pack buffers in the readback ring: a frame is read back this many frames after it
+// was rendered, by which time the copy has long finished
+#define CAPTURE_PBO_COUNT 3
+// Frames waiting for the writer before rendering blocks on it
+#define CAPTURE_QUEUE_FRAMES 8
+
+enum CaptureFormat {
+	CAPTURE_Y4M, //one file, 4:2:0 BT.709 limited range
+	CAPTURE_PNG, //one 8-bit RGB file per frame, stored (uncompressed) deflate
+};
+
+// Offline capture. The frame is rendered into 'texture' (any size, independent of the
+// window); capture_frame starts an asynchronous glReadPixels of it into the next pixel pack
+// buffer of a ring, and maps the buffer filled CAPTURE_PBO_COUNT frames ago, which is done
+// by then, so the pipeline never waits on the readback. Mapped frames go to a writer
+// thread that converts and writes them in order; if it falls CAPTURE_QUEUE_FRAMES behind,
+// capture_frame waits for it.
+struct CaptureQueuedFrame {
+	std::vector<unsigned char> rgba; //bottom row first, as GL reads it
+	int index;
+};
+
+struct Capture {
+	std::string path; //the .y4m file, or a printf pattern for the PNG files
+	CaptureFormat format;
+	int width, height;
+	double fps;
+
+	GLuint texture, fbo;
+	GLuint pbos[CAPTURE_PBO_COUNT];
+	GLsync fences[CAPTURE_PBO_COUNT];
+	int pbo_frame[CAPTURE_PBO_COUNT]; //frame in each buffer, -1 if none
+	int frames; //submitted for readback
+
+	//writer thread
+	std::thread writer;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<CaptureQueuedFrame> queue;
+	std::vector<std::vector<unsigned char> > spare; //buffers to reuse
+	bool closing;
+	FILE* file; //Y4M only
+	int written;
+	bool failed;
+
+	double readback_ms; //render thread: mapping and copying
+	double queue_wait_ms; //render thread: waiting for the writer
+	double write_ms; //writer thread: converting and writing
+
+	Capture() : format(CAPTURE_Y4M), width(0), height(0), fps(60.0), texture(0), fbo(0), frames(0), closing(false),
+		file(NULL), written(0), failed(false), readback_ms(0.0), queue_wait_ms(0.0), write_ms(0.0) {
+		for (int i = 0; i < CAPTURE_PBO_COUNT; i++) {
+			pbos[i] = 0;
+			fences[i] = 0;
+			pbo_frame[i] = -1;
+		}
+	}
+};
+
+// Format from the path: *.y4m is Y4M, anything else is a PNG pattern with one %d or %0Nd
+// for the frame number ("%05d" is appended when it has none, "%%" for a literal '%').
+// Returns false if the pattern is invalid or the output cannot be opened.
+bool capture_open(Capture& capture, const char* path, int width, int height, double fps);
+// After the frame was rendered into capture.texture
+void capture_frame(Capture& capture);
+// Reads back the frames still in the ring, waits for the writer and closes the output
+void capture_close(Capture& capture);
@@ -0,0 +1,344 @@
+#include "catalog.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "jobs.h"
+
+#define CATALOG_PI 3.14159265358979323846
+#define CATALOG_DEG (CATALOG_PI / 180.0)
+#define CATALOG_CHUNK_BYTES (1 << 20)
+// A record has to reach the semi-major axis column (MPCORB columns 93-103)
+#define CATALOG_MIN_RECORD 103
+
+// ------------------------------------------------------------------------------------------
+// Read-only memory mapping of a whole file
+// ------------------------------------------------------------------------------------------
+struct MappedFile {
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+};
+
+static bool map_file(const char* path, MappedFile& f) {
+	f.data = NULL;
+	f.size = 0;
+#ifdef _WIN32
+	f.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (f.file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	GetFileSizeEx(f.file, &size);
+	f.size = (size_t)size.QuadPart;
+	f.mapping = f.size ? CreateFileMappingA(f.file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	if (f.mapping) f.data = (const char*)MapViewOfFile(f.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!f.data) {
+		if (f.mapping) CloseHandle(f.mapping);
+		CloseHandle(f.file);
+		return false;
+	}
+#else
+	f.fd = open(path, O_RDONLY);
+	if (f.fd < 0) return false;
+	struct stat st;
+	fstat(f.fd, &st);
+	f.size = (size_t)st.st_size;
+	void* data = f.size ? mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, f.fd, 0) : MAP_FAILED;
+	if (data == MAP_FAILED) {
+		close(f.fd);
+		return false;
+	}
+	madvise(data, f.size, MADV_SEQUENTIAL);
+	f.data = (const char*)data;
+#endif
+	return true;
+}
+
+static void unmap_file(MappedFile& f) {
+#ifdef _WIN32
+	UnmapViewOfFile(f.data);
+	CloseHandle(f.mapping);
+	CloseHandle(f.file);
+#else
+	munmap((void*)f.data, f.size);
+	close(f.fd);
+#endif
+	f.data = NULL;
+}
+
+// ------------------------------------------------------------------------------------------
+// MPCORB record parsing
+// ------------------------------------------------------------------------------------------
+
+// Fixed-width decimal field (columns are 1-based, inclusive, as in the MPC documentation).
+// No exponents appear in MPCORB, so this avoids strtod and the copies it would need.
+static bool parse_field(const char* line, int first, int last, double& out) {
+	const char* p = line + first - 1;
+	const char* end = line + last;
+	while (p < end && *p == ' ') p++;
+	if (p == end) return false;
+
+	double sign = 1.0;
+	if (*p == '-' || *p == '+') {
+		if (*p == '-') sign = -1.0;
+		p++;
+	}
+	double value = 0.0, scale = 1.0;
+	bool digits = false, fraction = false;
+	for (; p < end && *p != ' '; p++) {
+		if (*p == '.' && !fraction) { fraction = true; continue; }
+		if (*p < '0' || *p > '9') return false;
+		value = value * 10.0 + (*p - '0');
+		if (fraction) scale *= 10.0;
+		digits = true;
+	}
+	out = sign * value / scale;
+	return digits;
+}
+
+// Packed MPC digit: 0-9, then A = 10 ... V = 31
+static int unpack_digit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'V') return c - 'A' + 10;
+	return -1;
+}
+
+// Days from 1970-01-01 to a civil date (proleptic Gregorian)
+static long days_from_civil(long y, long m, long d) {
+	y -= m <= 2;
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// Packed epoch (columns 21-25, e.g. K24AH = 2024-10-17) to days since J2000 (2000-01-01 12:00 TT).
+// MPC epochs are at 0h TT.
+static bool unpack_epoch(const char* p, double& days) {
+	int century = p[0] == 'I' ? 18 : p[0] == 'J' ? 19 : p[0] == 'K' ? 20 : -1;
+	int y1 = unpack_digit(p[1]), y2 = unpack_digit(p[2]);
+	int month = unpack_digit(p[3]), day = unpack_digit(p[4]);
+	if (century < 0 || y1 < 0 || y1 > 9 || y2 < 0 || y2 > 9 || month < 1 || month > 12 || day < 1) return false;
+	long year = century * 100 + y1 * 10 + y2;
+	days = (double)(days_from_civil(year, month, day) - days_from_civil(2000, 1, 1)) - 0.5;
+	return true;
+}
+
+static bool parse_record(const char* line, size_t length, OrbitSet& set) {
+	if (length < CATALOG_MIN_RECORD) return false;
+
+	double epoch, m, peri, node, incl, e, n, a;
+	if (!unpack_epoch(line + 20, epoch)) return false;
+	if (!parse_field(line, 27, 35, m) || !parse_field(line, 38, 46, peri) || !parse_field(line, 49, 57, node) ||
+		!parse_field(line, 60, 68, incl) || !parse_field(line, 71, 79, e) || !parse_field(line, 81, 91, n) ||
+		!parse_field(line, 93, 103, a)) return false;
+	if (a <= 0.0 || e < 0.0 || e >= 1.0) return false;
+
+	//mean anomaly moved to the set's epoch, in double before it is wrapped and stored
+	double n_rad = n * CATALOG_DEG;
+	double m0 = m * CATALOG_DEG + n_rad * (set.epoch - epoch);
+	m0 -= 2.0 * CATALOG_PI * floor(m0 / (2.0 * CATALOG_PI));
+
+	set.add((float)a, (float)e, (float)(incl * CATALOG_DEG), (float)(node * CATALOG_DEG), (float)(peri * CATALOG_DEG),
+		(float)m0, (float)n_rad);
+	return true;
+}
+
+size_t catalog_parse_mpcorb(const char* data, size_t size, OrbitSet& set) {
+	//MPCORB.DAT starts with a text header closed by a line of dashes; plain record files don't
+	const char* begin = data;
+	const char* end = data + size;
+	const char* header_end = NULL;
+	for (const char* p = data; p + 5 <= end && p < data + 16384; ) {
+		if (strncmp(p, "-----", 5) == 0) { header_end = p; break; }
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) break;
+		p = eol + 1;
+	}
+	if (header_end) {
+		const char* eol = (const char*)memchr(header_end, '\n', end - header_end);
+		begin = eol ? eol + 1 : end;
+	}
+
+	//chunks of about CATALOG_CHUNK_BYTES, cut at line ends
+	std::vector<const char*> cuts;
+	cuts.push_back(begin);
+	while (cuts.back() < end) {
+		const char* p = cuts.back() + std::min<size_t>(CATALOG_CHUNK_BYTES, end - cuts.back());
+		if (p < end) {
+			const char* eol = (const char*)memchr(p, '\n', end - p);
+			p = eol ? eol + 1 : end;
+		}
+		cuts.push_back(p);
+	}
+	size_t num_chunks = cuts.size() - 1;
+
+	//every chunk fills its own set (the basis is computed on the worker), merged in order
+	std::vector<OrbitSet> parts(num_chunks);
+	std::vector<size_t> skipped(num_chunks, 0);
+	parallel_for(0, num_chunks, 1, [&](size_t chunk_begin, size_t chunk_end) {
+		for (size_t c = chunk_begin; c < chunk_end; c++) {
+			OrbitSet& part = parts[c];
+			part.epoch = set.epoch;
+			part.units_per_au = set.units_per_au;
+			part.reserve((cuts[c + 1] - cuts[c]) / 203 + 1);
+			for (const char* line = cuts[c]; line < cuts[c + 1]; ) {
+				const char* eol = (const char*)memchr(line, '\n', cuts[c + 1] - line);
+				if (!eol) eol = cuts[c + 1];
+				size_t length = eol - line;
+				if (length > 0 && line[length - 1] == '\r') length--;
+				if (length > 0 && !parse_record(line, length, part)) skipped[c]++;
+				line = eol + 1;
+			}
+		}
+	});
+
+	size_t total = set.size(), total_skipped = 0;
+	for (size_t c = 0; c < num_chunks; c++) {
+		total += parts[c].size();
+		total_skipped += skipped[c];
+	}
+	set.reserve(total);
+	for (size_t c = 0; c < num_chunks; c++) set.append(parts[c]);
+	return total_skipped;
+}
+
+// ------------------------------------------------------------------------------------------
+// Binary cache: a header followed by the 13 float arrays of the OrbitSet, in order
+// ------------------------------------------------------------------------------------------
+struct CatalogCacheHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned long long count;
+	unsigned long long source_size;
+	long long source_mtime;
+	double epoch;
+	float units_per_au;
+	unsigned int reserved;
+};
+
+static void cache_arrays(OrbitSet& set, std::vector<float>* arrays[13]) {
+	std::vector<float>* list[13] = {
+		&set.semi_major_axis, &set.eccentricity, &set.inclination, &set.ascending_node, &set.arg_periapsis,
+		&set.mean_anomaly, &set.mean_motion, &set.px, &set.py, &set.pz, &set.qx, &set.qy, &set.qz
+	};
+	for (int k = 0; k < 13; k++) arrays[k] = list[k];
+}
+
+bool catalog_write_cache(const char* cache_path, const OrbitSet& set, unsigned long long source_size, long long source_mtime) {
+	FILE* file = fopen(cache_path, "wb");
+	if (!file) return false;
+
+	CatalogCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "ORBC", 4);
+	header.version = CATALOG_CACHE_VERSION;
+	header.count = set.size();
+	header.source_size = source_size;
+	header.source_mtime = source_mtime;
+	header.epoch = set.epoch;
+	header.units_per_au = set.units_per_au;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	std::vector<float>* arrays[13];
+	cache_arrays(const_cast<OrbitSet&>(set), arrays);
+	for (int k = 0; k < 13 && ok && header.count > 0; k++) {
+		ok = fwrite(&(*arrays[k])[0], sizeof(float), header.count, file) == header.count;
+	}
+	fclose(file);
+	if (!ok) remove(cache_path);
+	return ok;
+}
+
+bool catalog_read_cache(const char* cache_path, OrbitSet& set, unsigned long long source_size, long long source_mtime) {
+	FILE* file = fopen(cache_path, "rb");
+	if (!file) return false;
+
+	CatalogCacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "ORBC", 4) == 0 &&
+		header.version == CATALOG_CACHE_VERSION && header.source_size == source_size &&
+		header.source_mtime == source_mtime && header.epoch == set.epoch;
+	if (ok) {
+		OrbitSet cached;
+		cached.epoch = header.epoch;
+		cached.units_per_au = header.units_per_au;
+		std::vector<float>* arrays[13];
+		cache_arrays(cached, arrays);
+		for (int k = 0; k < 13 && ok; k++) {
+			arrays[k]->resize((size_t)header.count);
+			if (header.count > 0) ok = fread(&(*arrays[k])[0], sizeof(float), (size_t)header.count, file) == header.count;
+		}
+		if (ok) {
+			//the basis is stored in scene units, rescale if those changed
+			if (cached.units_per_au != set.units_per_au) orbit_set_scale(cached, set.units_per_au);
+			set = cached;
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+static void truncate_set(OrbitSet& set, size_t count) {
+	std::vector<float>* arrays[13];
+	cache_arrays(set, arrays);
+	for (int k = 0; k < 13; k++) arrays[k]->resize(count);
+}
+
+bool catalog_load(const char* path, OrbitSet& set, size_t max_records, CatalogStats* stats) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	CatalogStats local;
+	if (!stats) stats = &local;
+	memset(stats, 0, sizeof(CatalogStats));
+
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "Could not open catalog %s\n", path);
+		return false;
+	}
+	std::string cache_path = std::string(path) + ".cache";
+	unsigned long long source_size = (unsigned long long)st.st_size;
+	long long source_mtime = (long long)st.st_mtime;
+
+	set.clear();
+	if (catalog_read_cache(cache_path.c_str(), set, source_size, source_mtime)) {
+		stats->from_cache = true;
+	}
+	else {
+		MappedFile file;
+		if (!map_file(path, file)) {
+			fprintf(stderr, "Could not map catalog %s\n", path);
+			return false;
+		}
+		set.clear();
+		stats->skipped = catalog_parse_mpcorb(file.data, file.size, set);
+		unmap_file(file);
+		if (!catalog_write_cache(cache_path.c_str(), set, source_size, source_mtime)) {
+			fprintf(stderr, "Could not write catalog cache %s\n", cache_path.c_str());
+		}
+	}
+
+	if (max_records > 0 && set.size() > max_records) truncate_set(set, max_records);
+	stats->records = set.size();
+	stats->load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+
+#include "orbits.h"
+
+// Version of the binary cache layout, bump when it changes
+#define CATALOG_CACHE_VERSION 1
+
+struct CatalogStats {
+	size_t records; //bodies loaded
+	size_t skipped; //lines that were not valid orbit records
+	bool from_cache;
+	double load_ms;
+};
+
+// Loads a minor planet catalog in MPCORB fixed-width format into 'set' (units_per_au and
+// epoch must be set beforehand; mean anomalies are moved from each record's epoch to
+// set.epoch). A binary cache '<path>.cache' is used when it matches the catalog's size and
+// modification time, otherwise the catalog is parsed and the cache written.
+// max_records = 0 loads everything. Returns false if the catalog can't be read.
+bool catalog_load(const char* path, OrbitSet& set, size_t max_records = 0, CatalogStats* stats = NULL);
+
+// Parses MPCORB records from memory in parallel chunks, appending to 'set'.
+// Returns the number of lines skipped (header, blank lines, malformed records).
+size_t catalog_parse_mpcorb(const char* data, size_t size, OrbitSet& set);
+
+bool catalog_write_cache(const char* cache_path, const OrbitSet& set, unsigned long long source_size, long long source_mtime);
+bool catalog_read_cache(const char* cache_path, OrbitSet& set, unsigned long long source_size, long long source_mtime);
@@ -0,0 +1,284 @@
+#include "collisions.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#include "jobs.h"
+
+#define COLLISION_GRAIN 4096
+// Insertion sort gives up after this many swaps per sphere and falls back to a full sort
+#define COLLISION_MAX_SWAPS 8
+
+typedef std::chrono::high_resolution_clock collision_clock;
+
+static double elapsed_ms(collision_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(collision_clock::now() - start).count();
+}
+
+static inline float coord(const float* base, size_t stride, size_t i) {
+	return base[i * stride];
+}
+
+static inline unsigned long long pair_key(int a, int b) {
+	return ((unsigned long long)(unsigned int)a << 32) | (unsigned int)b;
+}
+
+void CollisionEventQueue::push(const std::vector<CollisionEvent>& batch) {
+	std::lock_guard<std::mutex> guard(lock);
+	events.insert(events.end(), batch.begin(), batch.end());
+	while (events.size() > capacity) events.pop_front();
+}
+
+size_t CollisionEventQueue::pop_all(std::vector<CollisionEvent>& out) {
+	std::lock_guard<std::mutex> guard(lock);
+	size_t count = events.size();
+	out.insert(out.end(), events.begin(), events.end());
+	events.clear();
+	return count;
+}
+
+// Cell keys: 21 bits per axis, biased and clamped so neighbours never wrap
+#define CELL_BITS 21
+#define CELL_BIAS (1 << (CELL_BITS - 1))
+#define CELL_MAX ((1 << CELL_BITS) - 2)
+#define CELL_STEP_Y (1ULL << CELL_BITS)
+#define CELL_STEP_Z (1ULL << (2 * CELL_BITS))
+
+static inline unsigned long long cell_coord(float v, float inv_cell) {
+	long long c = (long long)floorf(v * inv_cell) + CELL_BIAS;
+	return (unsigned long long)(c < 1 ? 1 : c > CELL_MAX ? CELL_MAX : c);
+}
+
+// Repairs a nearly sorted order; returns false if it took too many swaps
+static bool insertion_sort(std::vector<int>& order, const std::vector<unsigned long long>& key, size_t max_swaps, size_t& swaps) {
+	swaps = 0;
+	for (size_t p = 1; p < order.size(); p++) {
+		int item = order[p];
+		unsigned long long k = key[item];
+		size_t q = p;
+		while (q > 0 && key[order[q - 1]] > k) {
+			order[q] = order[q - 1];
+			q--;
+			if (++swaps > max_swaps) {
+				order[q] = item;
+				return false;
+			}
+		}
+		order[q] = item;
+	}
+	return true;
+}
+
+struct CollisionPair {
+	int a, b;
+	float gap;
+};
+
+// Half of the neighbourhood, so each pair is seen once: the next cell in the own row
+// and the four rows above (dz, dy) = (0, 1), (1, -1), (1, 0), (1, 1), three cells each
+static const long long g_row_offsets[4] = {
+	(long long)CELL_STEP_Y,
+	(long long)CELL_STEP_Z - (long long)CELL_STEP_Y,
+	(long long)CELL_STEP_Z,
+	(long long)CELL_STEP_Z + (long long)CELL_STEP_Y
+};
+
+void collisions_update(CollisionSystem& sys, const BvhSpheres& s, double t,
+	std::vector<CollisionEvent>& events, CollisionEventQueue* queue) {
+	size_t n = s.count;
+	size_t first_event = events.size();
+	collision_clock::time_point start = collision_clock::now();
+
+	if (n == 0) {
+		sys.order.clear();
+		sys.active.clear();
+		sys.contacts.clear();
+		return;
+	}
+
+	//cells must hold the largest sphere's reach; they only change when that grows
+	float max_radius = 0.0f;
+	std::mutex max_lock;
+	parallel_for(0, n, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+		float local = 0.0f;
+		for (size_t i = begin; i < end; i++) local = std::max(local, coord(s.r, s.stride, i));
+		std::lock_guard<std::mutex> guard(max_lock);
+		max_radius = std::max(max_radius, local);
+	});
+	bool full_sort = false;
+	float needed = 2.0f * max_radius + sys.approach_distance;
+	if (sys.cell_size < needed || sys.order.size() != n) {
+		sys.cell_size = needed > 0.0f ? needed * 1.25f : 1.0f;
+		sys.order.resize(n);
+		for (size_t i = 0; i < n; i++) sys.order[i] = (int)i;
+		full_sort = true;
+	}
+
+	float inv_cell = 1.0f / sys.cell_size;
+	sys.cell.resize(n);
+	parallel_for(0, n, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			sys.cell[i] = cell_coord(coord(s.z, s.stride, i), inv_cell) << (2 * CELL_BITS) |
+				cell_coord(coord(s.y, s.stride, i), inv_cell) << CELL_BITS |
+				cell_coord(coord(s.x, s.stride, i), inv_cell);
+		}
+	});
+
+	sys.swaps = 0;
+	if (full_sort || !insertion_sort(sys.order, sys.cell, n * COLLISION_MAX_SWAPS, sys.swaps)) {
+		const std::vector<unsigned long long>& key = sys.cell;
+		std::sort(sys.order.begin(), sys.order.end(), [&key](int a, int b) { return key[a] < key[b]; });
+	}
+	sys.sorted_cell.resize(n);
+	for (size_t p = 0; p < n; p++) sys.sorted_cell[p] = sys.cell[sys.order[p]];
+	sys.sort_ms = elapsed_ms(start);
+	start = collision_clock::now();
+
+	//sweep: every sphere against the rest of its cell and the runs of the half neighbourhood.
+	//Run starts only move forward as the own key grows, so each chunk keeps cursors.
+	std::vector<CollisionPair> pairs;
+	std::mutex pairs_lock;
+	std::atomic<size_t> candidates(0);
+	float threshold = sys.approach_distance;
+	const unsigned long long* keys = &sys.sorted_cell[0];
+	parallel_for(0, n, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+		std::vector<CollisionPair> local;
+		size_t local_candidates = 0;
+		size_t cursor[5];
+		bool started = false;
+		for (size_t p = begin; p < end; p++) {
+			unsigned long long key = keys[p];
+			int i = sys.order[p];
+			float xi = coord(s.x, s.stride, i), yi = coord(s.y, s.stride, i), zi = coord(s.z, s.stride, i);
+			float ri = coord(s.r, s.stride, i);
+
+			//runs: [first key, last key] of the next cell and of the four rows
+			unsigned long long run_first[5], run_last[5];
+			run_first[0] = run_last[0] = key + 1;
+			for (int r = 0; r < 4; r++) {
+				run_first[r + 1] = key + g_row_offsets[r] - 1;
+				run_last[r + 1] = key + g_row_offsets[r] + 1;
+			}
+			for (int r = 0; r < 5; r++) {
+				if (!started) cursor[r] = std::lower_bound(keys, keys + n, run_first[r]) - keys;
+				while (cursor[r] < n && keys[cursor[r]] < run_first[r]) cursor[r]++;
+			}
+			started = true;
+
+			//own cell after p, then the runs
+			size_t q = p + 1;
+			int run = -1;
+			unsigned long long last = key;
+			while (true) {
+				if (q >= n || keys[q] > last) {
+					if (++run == 5) break;
+					q = cursor[run];
+					last = run_last[run];
+					continue;
+				}
+				int j = sys.order[q++];
+				local_candidates++;
+
+				//narrow phase: exact sphere distance
+				float dx = coord(s.x, s.stride, j) - xi, dy = coord(s.y, s.stride, j) - yi, dz = coord(s.z, s.stride, j) - zi;
+				float touch = ri + coord(s.r, s.stride, j);
+				float reach = touch + threshold;
+				float d2 = dx * dx + dy * dy + dz * dz;
+				if (d2 >= reach * reach) continue;
+
+				CollisionPair pair = { std::min(i, j), std::max(i, j), sqrtf(d2) - touch };
+				local.push_back(pair);
+			}
+		}
+		candidates += local_candidates;
+		if (!local.empty()) {
+			std::lock_guard<std::mutex> guard(pairs_lock);
+			pairs.insert(pairs.end(), local.begin(), local.end());
+		}
+	});
+	sys.candidate_pairs = candidates;
+
+	//events for pairs that were not in that state on the previous update
+	std::sort(pairs.begin(), pairs.end(), [](const CollisionPair& a, const CollisionPair& b) {
+		return a.a != b.a ? a.a < b.a : a.b < b.b;
+	});
+	std::unordered_set<unsigned long long> active, contacts;
+	active.reserve(pairs.size());
+	for (size_t k = 0; k < pairs.size(); k++) {
+		unsigned long long key = pair_key(pairs[k].a, pairs[k].b);
+		bool touching = pairs[k].gap < 0.0f;
+		active.insert(key);
+		if (touching) contacts.insert(key);
+
+		bool was_active = sys.active.count(key) != 0;
+		bool was_touching = sys.contacts.count(key) != 0;
+		if (!was_active || (touching && !was_touching)) {
+			CollisionEvent event = { pairs[k].a, pairs[k].b, touching ? COLLISION_CONTACT : COLLISION_CLOSE_APPROACH, pairs[k].gap, t };
+			events.push_back(event);
+		}
+	}
+	sys.active.swap(active);
+	sys.contacts.swap(contacts);
+	sys.sweep_ms = elapsed_ms(start);
+
+	if (sys.callback) {
+		for (size_t k = first_event; k < events.size(); k++) sys.callback(events[k]);
+	}
+	if (queue && events.size() > first_event) {
+		queue->push(std::vector<CollisionEvent>(events.begin() + first_event, events.end()));
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Benchmark
+// ------------------------------------------------------------------------------------------
+void collisions_benchmark(size_t max_count) {
+	jobs_init(0);
+	printf("Grid broad phase collisions: %d threads, disk of radius 100, approach distance 0.1\n", jobs_num_threads());
+	printf("  %10s %12s %10s %10s %10s %12s %10s %10s\n", "spheres", "sort", "sort ms", "sweep ms", "total ms", "Mbodies/s", "candidates", "events");
+	for (size_t count = 10000; count <= max_count; count *= 10) {
+		//a belt-like disk of bodies on circular orbits, same density at every size
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		float thickness = 2.0f * count / 1000000.0f + 0.2f;
+		std::vector<float> radius(count), angle(count), height(count), size(count), data(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			radius[i] = 60.0f + 40.0f * unit(rng);
+			angle[i] = 6.2831853f * unit(rng);
+			height[i] = thickness * (unit(rng) - 0.5f);
+			data[i * 4 + 3] = 0.01f + 0.02f * unit(rng);
+		}
+		BvhSpheres spheres = { &data[0], &data[1], &data[2], &data[3], 4, count };
+
+		for (int mode = 0; mode < 2; mode++) {
+			CollisionSystem sys;
+			sys.approach_distance = 0.1f;
+			std::vector<CollisionEvent> events;
+			const int steps = 10;
+			double sort = 0.0, sweep = 0.0;
+			size_t candidates = 0;
+			for (int step = 0; step <= steps; step++) {
+				for (size_t i = 0; i < count; i++) {
+					float a = angle[i] + step * 0.002f * powf(80.0f / radius[i], 1.5f);
+					data[i * 4 + 0] = radius[i] * cosf(a);
+					data[i * 4 + 1] = height[i];
+					data[i * 4 + 2] = radius[i] * sinf(a);
+				}
+				if (mode == 1) sys.cell_size = 0.0f; //forces a full sort every step
+				collisions_update(sys, spheres, step, events);
+				if (step == 0) continue; //the first update always sorts from scratch
+				sort += sys.sort_ms;
+				sweep += sys.sweep_ms;
+				candidates += sys.candidate_pairs;
+			}
+			double total = (sort + sweep) / steps;
+			printf("  %10u %12s %10.2f %10.2f %10.2f %12.2f %10u %10u\n", (unsigned int)count, mode == 0 ? "incremental" : "full",
+				sort / steps, sweep / steps, total, count / (total * 1000.0), (unsigned int)(candidates / steps), (unsigned int)events.size());
+		}
+	}
+	jobs_shutdown();
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "bvh.h" // BvhSpheres
+
+enum CollisionEventType {
+	COLLISION_CONTACT = 0, //spheres overlap
+	COLLISION_CLOSE_APPROACH = 1 //surfaces closer than the threshold
+};
+
+struct CollisionEvent {
+	int a, b; //sphere indices, a < b
+	int type; //CollisionEventType
+	float gap; //surface distance, negative when overlapping
+	double time; //simulated days
+};
+
+// Thread-safe queue: the simulation pushes, whoever displays or logs events drains it
+struct CollisionEventQueue {
+	std::mutex lock;
+	std::deque<CollisionEvent> events;
+	size_t capacity; //oldest events are dropped beyond this
+
+	CollisionEventQueue() : capacity(65536) {}
+	void push(const std::vector<CollisionEvent>& batch);
+	size_t pop_all(std::vector<CollisionEvent>& out);
+};
+
+// Broad phase on a uniform grid of cells as large as the biggest sphere plus the threshold,
+// so only neighbouring cells can interact. Spheres are kept sorted by cell key (z, y, x
+// packed, x fastest), so the three cells of a neighbouring row form one contiguous run that
+// is swept with a cursor. The order survives between updates and is repaired with an
+// insertion sort, as few bodies change cells per tick. Candidate pairs go through an exact
+// sphere test. An event is raised when a pair enters contact or close approach, not on
+// every update while it stays there.
+struct CollisionSystem {
+	float approach_distance; //close approach threshold between surfaces, scene units
+
+	//broad phase state, kept between updates
+	float cell_size; //0 until the first update
+	std::vector<int> order; //sphere indices sorted by cell key
+	std::vector<unsigned long long> cell; //cell key of each sphere
+	std::vector<unsigned long long> sorted_cell; //cell keys in sorted order
+	std::unordered_set<unsigned long long> active; //pairs in contact or close approach, (a << 32) | b
+	std::unordered_set<unsigned long long> contacts; //of those, the ones touching
+
+	//optional, called on the updating thread for each new event
+	std::function<void(const CollisionEvent&)> callback;
+
+	//statistics of the last update
+	size_t candidate_pairs, swaps;
+	double sort_ms, sweep_ms;
+
+	CollisionSystem() : approach_distance(0.0f), cell_size(0.0f),
+		candidate_pairs(0), swaps(0), sort_ms(0), sweep_ms(0) {}
+};
+
+// Finds contacts and close approaches among the spheres at simulated time t and appends
+// new events to 'events' (and the queue, if given)
+void collisions_update(CollisionSystem& sys, const BvhSpheres& spheres, double t,
+	std::vector<CollisionEvent>& events, CollisionEventQueue* queue = NULL);
+
+// Times the update for sphere counts up to max_count, incremental against full sorts
+void collisions_benchmark(size_t max_count);
@@ -0,0 +1,66 @@
+#include "culling.h"
+
+#include <algorithm>
+
+#include "jobs.h"
+
+#define CULL_GRAIN 2048
+
+Frustum frustum_from_matrix(const glm::mat4& m, bool clip_zero_to_one) {
+	//glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = clip_zero_to_one ? row2 : row3 + row2;
+	frustum.planes[5] = row3 - row2;
+	for (int i = 0; i < 6; i++) {
+		float length = glm::length(glm::vec3(frustum.planes[i]));
+		frustum.planes[i] = length > 0.0f ? frustum.planes[i] / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	return frustum;
+}
+
+bool frustum_sphere_visible(const Frustum& frustum, const glm::vec3& center, float radius) {
+	for (int i = 0; i < 6; i++) {
+		const glm::vec4& p = frustum.planes[i];
+		if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius) return false;
+	}
+	return true;
+}
+
+void cull_instances(const Frustum& frustum, const std::vector<glm::mat4>& in, std::vector<glm::mat4>& out) {
+	size_t n = in.size();
+	out.resize(n);
+	if (n == 0) return;
+
+	//each chunk compacts its visible instances at the front of its own range of 'out',
+	//then the ranges are packed together in chunk order
+	size_t num_chunks = (n + CULL_GRAIN - 1) / CULL_GRAIN;
+	std::vector<size_t> visible(num_chunks, 0);
+	parallel_for(0, num_chunks, 1, [&](size_t chunk_begin, size_t chunk_end) {
+		for (size_t c = chunk_begin; c < chunk_end; c++) {
+			size_t begin = c * CULL_GRAIN, end = std::min(n, begin + CULL_GRAIN);
+			size_t count = begin;
+			for (size_t i = begin; i < end; i++) {
+				const glm::mat4& m = in[i];
+				if (frustum_sphere_visible(frustum, glm::vec3(m[3]), glm::length(glm::vec3(m[0])))) out[count++] = m;
+			}
+			visible[c] = count - begin;
+		}
+	});
+
+	size_t total = visible[0];
+	for (size_t c = 1; c < num_chunks; c++) {
+		size_t begin = c * CULL_GRAIN;
+		if (total != begin) std::copy(out.begin() + begin, out.begin() + begin + visible[c], out.begin() + total);
+		total += visible[c];
+	}
+	out.resize(total);
+}
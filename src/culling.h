@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// View frustum as six planes (a, b, c, d) with normals pointing inwards:
+// left, right, bottom, top, near, far
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// Extracts the planes of projection * view (Gribb/Hartmann), normalized. clip_zero_to_one
+// for a [0, 1] clip depth range (glClipControl). A plane at infinity (infinite far plane)
+// comes out as one that accepts everything.
+Frustum frustum_from_matrix(const glm::mat4& view_projection, bool clip_zero_to_one = false);
+
+bool frustum_sphere_visible(const Frustum& frustum, const glm::vec3& center, float radius);
+
+// Copies the instance transforms whose bounding sphere touches the frustum to 'out',
+// keeping their order. The sphere is taken from the matrix: translation column as the
+// center and the length of the first column as the radius (uniformly scaled unit sphere).
+// Runs as a parallel_for over the job system.
+void cull_instances(const Frustum& frustum, const std::vector<glm::mat4>& in, std::vector<glm::mat4>& out);
@@ -0,0 +1,55 @@
+#include "eclipse.h"
+
+void eclipse_select_occluders(const BodyStore& bodies, int light, const glm::dvec3& origin,
+	std::vector<EclipseOccluders>& out) {
+	int count = (int)bodies.size();
+	out.resize(count);
+	glm::dvec3 light_pos(bodies.pos_x[light], bodies.pos_y[light], bodies.pos_z[light]);
+	double light_radius = bodies.scale[light];
+
+	for (int r = 0; r < count; r++) {
+		EclipseOccluders& occluders = out[r];
+		occluders.count = 0;
+		if (r == light) continue;
+
+		glm::dvec3 receiver(bodies.pos_x[r], bodies.pos_y[r], bodies.pos_z[r]);
+		double receiver_radius = bodies.scale[r];
+		glm::dvec3 to_light = light_pos - receiver;
+		double light_distance = glm::length(to_light);
+		if (light_distance <= 0.0) continue;
+		glm::dvec3 axis = to_light / light_distance;
+
+		//candidates sorted by distance along the axis, nearest first
+		double along_sorted[ECLIPSE_MAX_OCCLUDERS];
+		int index_sorted[ECLIPSE_MAX_OCCLUDERS];
+		int found = 0;
+		for (int o = 0; o < count; o++) {
+			if (o == r || o == light) continue;
+			glm::dvec3 v = glm::dvec3(bodies.pos_x[o], bodies.pos_y[o], bodies.pos_z[o]) - receiver;
+			double along = glm::dot(v, axis);
+			if (along <= 0.0 || along >= light_distance) continue; //behind the receiver or past the light
+
+			//rays from the receiver to the light's disc stay within this distance of the axis
+			double s = along / light_distance;
+			double reach = receiver_radius * (1.0 - s) + light_radius * s + bodies.scale[o];
+			if (glm::length(v - axis * along) >= reach) continue;
+
+			if (found == ECLIPSE_MAX_OCCLUDERS && along >= along_sorted[found - 1]) continue;
+			int k = found < ECLIPSE_MAX_OCCLUDERS ? found++ : found - 1;
+			while (k > 0 && along_sorted[k - 1] > along) {
+				along_sorted[k] = along_sorted[k - 1];
+				index_sorted[k] = index_sorted[k - 1];
+				k--;
+			}
+			along_sorted[k] = along;
+			index_sorted[k] = o;
+		}
+
+		for (int k = 0; k < found; k++) {
+			int o = index_sorted[k];
+			glm::dvec3 center = glm::dvec3(bodies.pos_x[o], bodies.pos_y[o], bodies.pos_z[o]) - origin;
+			occluders.spheres[k] = glm::vec4(glm::vec3(center), bodies.scale[o]);
+		}
+		occluders.count = found;
+	}
+}
@@ -0,0 +1,42 @@
+// Eclipse term shared by the lit shaders, pulled in with #include "eclipse.glsl" (see
+// Shader.cpp). The occluders and the light are in the space of the shader that includes it.
+uniform float u_light_radius; //the sun
+layout(std140) uniform Eclipse { //a range of the frame's stream buffer, see eclipse.h
+	vec4 u_occluders[4]; //xyz center, w radius
+	int u_num_occluders; //bodies that may shadow this one, up to 4
+};
+
+const float PI = 3.14159265359;
+
+// Area of the intersection of two discs of radii r1 and r2 whose centers are d apart
+float discOverlap(float r1, float r2, float d)
+{
+	if (d >= r1 + r2) return 0.0;
+	if (d <= abs(r1 - r2)) return PI * min(r1, r2) * min(r1, r2);
+	float a1 = acos(clamp((d * d + r1 * r1 - r2 * r2) / (2.0 * d * r1), -1.0, 1.0));
+	float a2 = acos(clamp((d * d + r2 * r2 - r1 * r1) / (2.0 * d * r2), -1.0, 1.0));
+	float k = sqrt(max((-d + r1 + r2) * (d + r1 - r2) * (d - r1 + r2) * (d + r1 + r2), 0.0));
+	return r1 * r1 * a1 + r2 * r2 * a2 - 0.5 * k;
+}
+
+// Fraction of the light's disc visible from P past the occluders
+float eclipseVisibility(vec3 P, vec3 light_pos)
+{
+	vec3 to_light = light_pos - P;
+	float light_distance = length(to_light);
+	vec3 L = to_light / light_distance;
+	float light_angle = asin(min(u_light_radius / light_distance, 1.0));
+	float light_area = PI * light_angle * light_angle;
+
+	float visible = 1.0;
+	for (int i = 0; i < u_num_occluders; i++) {
+		vec3 to_occluder = u_occluders[i].xyz - P;
+		float occluder_distance = length(to_occluder);
+		vec3 O = to_occluder / occluder_distance;
+		float occluder_angle = asin(min(u_occluders[i].w / occluder_distance, 1.0));
+		//atan2 of cross and dot keeps small separations precise, unlike acos of the dot
+		float separation = atan(length(cross(L, O)), dot(L, O));
+		visible *= 1.0 - min(discOverlap(light_angle, occluder_angle, separation) / light_area, 1.0);
+	}
+	return visible;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bodies.h"
+
+// Occluders passed to the shaders per receiver (u_occluders[] has this many entries)
+#define ECLIPSE_MAX_OCCLUDERS 4
+// Uniform buffer binding of the shaders' Eclipse block
+#define ECLIPSE_UNIFORM_BINDING 0
+
+// The Eclipse block as std140 lays it out: the array, then the count padded to 16 bytes
+struct EclipseUniforms {
+	glm::vec4 occluders[ECLIPSE_MAX_OCCLUDERS];
+	int count;
+	int padding[3];
+};
+
+// Spheres that may shadow one receiver: xyz center in render space, w radius
+struct EclipseOccluders {
+	int count;
+	glm::vec4 spheres[ECLIPSE_MAX_OCCLUDERS];
+};
+
+// Analytic eclipses instead of shadow maps. For each body a handful of other bodies that
+// lie between it and the light, close enough to the light axis to cover part of the light's
+// disc from somewhere on the receiver, are selected (nearest first). The fragment shaders
+// then compare the apparent discs of the light and of each occluder and darken by the
+// fraction of the light that is hidden, which gives umbra, penumbra and annular eclipses.
+// Positions are read in double and written relative to 'origin' (the camera).
+void eclipse_select_occluders(const BodyStore& bodies, int light, const glm::dvec3& origin,
+	std::vector<EclipseOccluders>& out);
@@ -0,0 +1,416 @@
+#include "framegraph.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+static bool is_depth_format(GLenum format) {
+	return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32 ||
+		format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+static int bytes_per_pixel(GLenum format) {
+	switch (format) {
+	case GL_R8: return 1;
+	case GL_R16F: case GL_RG8: case GL_DEPTH_COMPONENT16: return 2;
+	case GL_RGB8: return 3;
+	case GL_RGBA32F: return 16;
+	case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+	case GL_RGB16F: return 6;
+	case GL_RGB32F: return 12;
+	default: return 4; //RGBA8, R32F, RG16F, R11F_G11F_B10F, 24 and 32-bit depth
+	}
+}
+
+static long long desc_bytes(const FrameGraphTextureDesc& desc) {
+	long long bytes = 0;
+	int w = desc.width, h = desc.height;
+	for (int level = 0; level < desc.levels; level++) {
+		bytes += (long long)w * h * bytes_per_pixel(desc.format);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	return bytes;
+}
+
+static bool same_desc(const FrameGraphTextureDesc& a, const FrameGraphTextureDesc& b) {
+	return a.width == b.width && a.height == b.height && a.format == b.format && a.levels == b.levels;
+}
+
+void framegraph_reset(FrameGraph& graph) {
+	graph.resources.clear();
+	graph.passes.clear();
+	graph.order.clear();
+	graph.frame++;
+}
+
+FrameGraphResource framegraph_create_texture(FrameGraph& graph, const char* name, const FrameGraphTextureDesc& desc) {
+	FrameGraphResourceNode node;
+	node.name = name;
+	node.desc = desc;
+	node.imported = false;
+	node.texture = 0;
+	node.first_use = node.last_use = -1;
+	node.physical = -1;
+	graph.resources.push_back(node);
+	return (FrameGraphResource)graph.resources.size() - 1;
+}
+
+FrameGraphResource framegraph_import_window(FrameGraph& graph, const char* name, int width, int height) {
+	FrameGraphResource resource = framegraph_create_texture(graph, name, FrameGraphTextureDesc(width, height, GL_RGBA8));
+	graph.resources[resource].imported = true;
+	return resource;
+}
+
+FrameGraphResource framegraph_import_texture(FrameGraph& graph, const char* name, GLuint texture, const FrameGraphTextureDesc& desc) {
+	FrameGraphResource resource = framegraph_create_texture(graph, name, desc);
+	graph.resources[resource].imported = true;
+	graph.resources[resource].texture = texture;
+	return resource;
+}
+
+int framegraph_add_pass(FrameGraph& graph, const char* name, const FrameGraphExecute& execute) {
+	FrameGraphPass pass;
+	pass.name = name;
+	pass.execute = execute;
+	pass.culled = false;
+	pass.fbo = 0;
+	pass.width = pass.height = 0;
+	graph.passes.push_back(pass);
+	return (int)graph.passes.size() - 1;
+}
+
+void framegraph_read(FrameGraph& graph, int pass, FrameGraphResource resource) {
+	graph.passes[pass].reads.push_back(resource);
+}
+
+void framegraph_write(FrameGraph& graph, int pass, FrameGraphResource resource, const GLfloat* clear) {
+	FrameGraphPass& p = graph.passes[pass];
+	p.writes.push_back(resource);
+	p.clears.push_back(clear != NULL);
+	for (int i = 0; i < 4; i++) p.clear_values.push_back(clear ? clear[is_depth_format(graph.resources[resource].desc.format) ? 0 : i] : 0.0f);
+}
+
+// Walks back from the passes that write imported resources: a pass stays if something
+// kept after it needs one of its writes. A cleared write ends the need for earlier writers.
+static void cull_passes(FrameGraph& graph) {
+	std::vector<bool> needed(graph.resources.size(), false);
+	for (int p = (int)graph.passes.size() - 1; p >= 0; p--) {
+		FrameGraphPass& pass = graph.passes[p];
+		bool keep = false;
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			FrameGraphResource r = pass.writes[w];
+			if (graph.resources[r].imported || needed[r]) keep = true;
+		}
+		pass.culled = !keep;
+		if (!keep) continue;
+
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			if (pass.clears[w]) needed[pass.writes[w]] = false;
+		}
+		for (size_t r = 0; r < pass.reads.size(); r++) needed[pass.reads[r]] = true;
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			if (!pass.clears[w]) needed[pass.writes[w]] = true;
+		}
+	}
+}
+
+// Dependencies between kept passes come from the declaration order on each resource:
+// writer before later readers and writers, readers before the next writer. The order is
+// built from the back, always taking the ready pass whose first consumer runs latest, so
+// producers sit right before their consumers.
+static void order_passes(FrameGraph& graph) {
+	int count = (int)graph.passes.size();
+	std::vector<std::vector<int> > successors(count), predecessors(count);
+	std::vector<int> last_writer(graph.resources.size(), -1);
+	std::vector<std::vector<int> > readers(graph.resources.size());
+
+	for (int p = 0; p < count; p++) {
+		const FrameGraphPass& pass = graph.passes[p];
+		if (pass.culled) continue;
+		std::vector<int> after;
+		for (size_t r = 0; r < pass.reads.size(); r++) {
+			FrameGraphResource resource = pass.reads[r];
+			if (last_writer[resource] >= 0) after.push_back(last_writer[resource]);
+		}
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			FrameGraphResource resource = pass.writes[w];
+			if (last_writer[resource] >= 0) after.push_back(last_writer[resource]);
+			after.insert(after.end(), readers[resource].begin(), readers[resource].end());
+		}
+		for (size_t a = 0; a < after.size(); a++) {
+			int before = after[a];
+			if (before == p) continue;
+			bool known = false;
+			for (size_t s = 0; s < successors[before].size(); s++) known = known || successors[before][s] == p;
+			if (known) continue;
+			successors[before].push_back(p);
+			predecessors[p].push_back(before);
+		}
+		for (size_t r = 0; r < pass.reads.size(); r++) readers[pass.reads[r]].push_back(p);
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			last_writer[pass.writes[w]] = p;
+			readers[pass.writes[w]].clear();
+		}
+	}
+
+	int kept = 0;
+	std::vector<int> waiting(count, 0), position(count, -1);
+	for (int p = 0; p < count; p++) {
+		if (graph.passes[p].culled) continue;
+		kept++;
+		waiting[p] = (int)successors[p].size();
+	}
+
+	graph.order.assign(kept, -1);
+	for (int slot = kept - 1; slot >= 0; slot--) {
+		int best = -1, best_consumer = -1;
+		for (int p = count - 1; p >= 0; p--) {
+			if (graph.passes[p].culled || position[p] >= 0 || waiting[p] > 0) continue;
+			int consumer = kept; //no consumer: as late as possible
+			for (size_t s = 0; s < successors[p].size(); s++) {
+				if (position[successors[p][s]] < consumer) consumer = position[successors[p][s]];
+			}
+			if (consumer > best_consumer) {
+				best = p;
+				best_consumer = consumer;
+			}
+		}
+		position[best] = slot;
+		graph.order[slot] = best;
+		for (size_t q = 0; q < predecessors[best].size(); q++) waiting[predecessors[best][q]]--;
+	}
+}
+
+static GLuint create_texture(const FrameGraphTextureDesc& desc) {
+	bool depth = is_depth_format(desc.format);
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	int w = desc.width, h = desc.height;
+	for (int level = 0; level < desc.levels; level++) {
+		glTexImage2D(GL_TEXTURE_2D, level, desc.format, w, h, 0, depth ? GL_DEPTH_COMPONENT : GL_RGBA, GL_FLOAT, NULL);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, desc.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : desc.levels > 1 ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+// Deletes pooled textures unused for FRAMEGRAPH_POOL_FRAMES frames, and the framebuffers
+// that had them attached
+static void trim_pool(FrameGraph& graph) {
+	for (size_t t = 0; t < graph.pool.size();) {
+		if (graph.frame - graph.pool[t].last_frame <= FRAMEGRAPH_POOL_FRAMES) {
+			t++;
+			continue;
+		}
+		GLuint texture = graph.pool[t].texture;
+		for (size_t f = 0; f < graph.framebuffers.size();) {
+			bool attached = false;
+			for (int a = 0; a <= FRAMEGRAPH_MAX_COLOR_ATTACHMENTS; a++) attached = attached || graph.framebuffers[f].attachments[a] == texture;
+			if (attached) {
+				glDeleteFramebuffers(1, &graph.framebuffers[f].fbo);
+				graph.framebuffers[f] = graph.framebuffers.back();
+				graph.framebuffers.pop_back();
+			}
+			else f++;
+		}
+		glDeleteTextures(1, &texture);
+		graph.pool[t] = graph.pool.back();
+		graph.pool.pop_back();
+	}
+}
+
+// Lifetimes over the execution order, then a physical texture for each transient resource
+// when it is first used, given back to the pool after its last use
+static void assign_textures(FrameGraph& graph) {
+	for (size_t i = 0; i < graph.order.size(); i++) {
+		const FrameGraphPass& pass = graph.passes[graph.order[i]];
+		for (int k = 0; k < 2; k++) {
+			const std::vector<FrameGraphResource>& list = k == 0 ? pass.reads : pass.writes;
+			for (size_t r = 0; r < list.size(); r++) {
+				FrameGraphResourceNode& node = graph.resources[list[r]];
+				if (node.first_use < 0) node.first_use = (int)i;
+				node.last_use = (int)i;
+			}
+		}
+	}
+
+	std::vector<bool> busy(graph.pool.size(), false);
+	for (size_t i = 0; i < graph.order.size(); i++) {
+		for (size_t r = 0; r < graph.resources.size(); r++) {
+			FrameGraphResourceNode& node = graph.resources[r];
+			if (node.imported || node.first_use != (int)i) continue;
+
+			//a texture already used this frame first, so the others can age out of the pool
+			int found = -1;
+			for (int pass = 0; pass < 2 && found < 0; pass++) {
+				for (size_t t = 0; t < graph.pool.size() && found < 0; t++) {
+					bool this_frame = graph.pool[t].last_frame == graph.frame;
+					if (!busy[t] && this_frame == (pass == 0) && same_desc(graph.pool[t].desc, node.desc)) found = (int)t;
+				}
+			}
+			if (found < 0) {
+				FrameGraphTexture texture;
+				texture.desc = node.desc;
+				texture.texture = create_texture(node.desc);
+				texture.bytes = desc_bytes(node.desc);
+				texture.last_frame = graph.frame;
+				graph.pool.push_back(texture);
+				busy.push_back(false);
+				found = (int)graph.pool.size() - 1;
+			}
+			busy[found] = true;
+			graph.pool[found].last_frame = graph.frame;
+			node.physical = found;
+		}
+		for (size_t r = 0; r < graph.resources.size(); r++) {
+			const FrameGraphResourceNode& node = graph.resources[r];
+			if (!node.imported && node.last_use == (int)i) busy[node.physical] = false;
+		}
+	}
+}
+
+static GLuint framebuffer_for(FrameGraph& graph, const GLuint attachments[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS + 1], int colors) {
+	for (size_t f = 0; f < graph.framebuffers.size(); f++) {
+		if (memcmp(graph.framebuffers[f].attachments, attachments, sizeof(graph.framebuffers[f].attachments)) == 0) {
+			return graph.framebuffers[f].fbo;
+		}
+	}
+
+	FrameGraphFramebuffer framebuffer;
+	memcpy(framebuffer.attachments, attachments, sizeof(framebuffer.attachments));
+	glGenFramebuffers(1, &framebuffer.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
+	GLenum buffers[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS];
+	for (int c = 0; c < colors; c++) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, GL_TEXTURE_2D, attachments[c], 0);
+		buffers[c] = GL_COLOR_ATTACHMENT0 + c;
+	}
+	if (attachments[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS]) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, attachments[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS], 0);
+	}
+	if (colors > 0) glDrawBuffers(colors, buffers);
+	else glDrawBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Frame graph: incomplete framebuffer\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	graph.framebuffers.push_back(framebuffer);
+	return framebuffer.fbo;
+}
+
+// A framebuffer from each pass's writes, colours in declaration order
+static void build_framebuffers(FrameGraph& graph) {
+	for (size_t i = 0; i < graph.order.size(); i++) {
+		FrameGraphPass& pass = graph.passes[graph.order[i]];
+		GLuint attachments[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS + 1] = { 0 };
+		int colors = 0;
+		bool window = false;
+		pass.width = pass.height = 0;
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			const FrameGraphResourceNode& node = graph.resources[pass.writes[w]];
+			pass.width = node.desc.width;
+			pass.height = node.desc.height;
+			if (node.imported && !node.texture) window = true;
+			else if (node.imported) { if (colors < FRAMEGRAPH_MAX_COLOR_ATTACHMENTS) attachments[colors++] = node.texture; }
+			else if (is_depth_format(node.desc.format)) attachments[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS] = graph.pool[node.physical].texture;
+			else if (colors < FRAMEGRAPH_MAX_COLOR_ATTACHMENTS) attachments[colors++] = graph.pool[node.physical].texture;
+		}
+		pass.fbo = window ? 0 : framebuffer_for(graph, attachments, colors);
+	}
+}
+
+void framegraph_compile(FrameGraph& graph) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	trim_pool(graph);
+	cull_passes(graph);
+	order_passes(graph);
+	assign_textures(graph);
+	build_framebuffers(graph);
+
+	FrameGraphStats& stats = graph.stats;
+	stats = FrameGraphStats();
+	stats.passes = (int)graph.passes.size();
+	stats.culled_passes = stats.passes - (int)graph.order.size();
+	for (size_t r = 0; r < graph.resources.size(); r++) {
+		const FrameGraphResourceNode& node = graph.resources[r];
+		if (node.imported || node.first_use < 0) continue;
+		stats.resources++;
+		stats.resource_bytes += desc_bytes(node.desc);
+	}
+	for (size_t t = 0; t < graph.pool.size(); t++) {
+		stats.pool_bytes += graph.pool[t].bytes;
+		if (graph.pool[t].last_frame != graph.frame) continue;
+		stats.textures++;
+		stats.texture_bytes += graph.pool[t].bytes;
+	}
+	stats.compile_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void framegraph_execute(const FrameGraph& graph) {
+	for (size_t i = 0; i < graph.order.size(); i++) {
+		const FrameGraphPass& pass = graph.passes[graph.order[i]];
+		glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
+		glViewport(0, 0, pass.width, pass.height);
+
+		int color = 0;
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			bool depth = is_depth_format(graph.resources[pass.writes[w]].desc.format);
+			if (pass.clears[w]) {
+				if (depth) {
+					glDepthMask(GL_TRUE); //clears honour the mask
+					glClearBufferfv(GL_DEPTH, 0, &pass.clear_values[4 * w]);
+				}
+				else glClearBufferfv(GL_COLOR, color, &pass.clear_values[4 * w]);
+			}
+			if (!depth) color++;
+		}
+		pass.execute(graph);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint framegraph_texture(const FrameGraph& graph, FrameGraphResource resource) {
+	const FrameGraphResourceNode& node = graph.resources[resource];
+	if (node.imported) return node.texture;
+	return node.physical < 0 ? 0 : graph.pool[node.physical].texture;
+}
+
+void framegraph_print(const FrameGraph& graph) {
+	const FrameGraphStats& stats = graph.stats;
+	printf("Frame graph: %d passes (%d culled), %d resources on %d textures, %.1f MB (%.1f MB without aliasing, %.1f MB pooled)\n",
+		stats.passes, stats.culled_passes, stats.resources, stats.textures,
+		stats.texture_bytes / 1048576.0, stats.resource_bytes / 1048576.0, stats.pool_bytes / 1048576.0);
+	for (size_t i = 0; i < graph.order.size(); i++) {
+		const FrameGraphPass& pass = graph.passes[graph.order[i]];
+		printf("  %-16s", pass.name);
+		for (size_t r = 0; r < pass.reads.size(); r++) printf(" <%s", graph.resources[pass.reads[r]].name);
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			const FrameGraphResourceNode& node = graph.resources[pass.writes[w]];
+			if (node.imported) printf(" >%s", node.name);
+			else printf(" >%s [%d]", node.name, node.physical);
+		}
+		printf("\n");
+	}
+	for (size_t p = 0; p < graph.passes.size(); p++) {
+		if (graph.passes[p].culled) printf("  %-16s culled\n", graph.passes[p].name);
+	}
+}
+
+void framegraph_destroy(FrameGraph& graph) {
+	for (size_t f = 0; f < graph.framebuffers.size(); f++) glDeleteFramebuffers(1, &graph.framebuffers[f].fbo);
+	for (size_t t = 0; t < graph.pool.size(); t++) glDeleteTextures(1, &graph.pool[t].texture);
+	graph.framebuffers.clear();
+	graph.pool.clear();
+	graph.resources.clear();
+	graph.passes.clear();
+	graph.order.clear();
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <GL/glew.h>
+
+// Colour attachments a pass can write, besides one depth attachment
+#define FRAMEGRAPH_MAX_COLOR_ATTACHMENTS 4
+// Frames a pooled texture may go unused before it is deleted
+#define FRAMEGRAPH_POOL_FRAMES 8
+
+// Frame graph, rebuilt every frame. Passes declare the textures they sample (reads) and the
+// ones they render to (writes); a write either clears the target or loads what earlier
+// passes left in it (blending, depth testing), and a load counts as a read. Compiling:
+//  - culls passes none of whose writes reach a pass writing an imported resource (the window)
+//  - orders what is left by its dependencies, each pass as late as it can go, which
+//    shortens the lifetimes of the transient textures between passes
+//  - gives the transient textures physical ones from a pool, sharing a texture between
+//    resources of the same description whose lifetimes do not overlap
+//  - builds (and caches) a framebuffer per pass from its writes
+// Executing binds each pass's framebuffer, sets the viewport, does the clears and calls the
+// pass. GL already orders rendering into a texture before later sampling of it, so the
+// framebuffer, draw buffers, viewport and clears are all the state the graph has to own.
+typedef int FrameGraphResource; //index into FrameGraph::resources, -1 for none
+
+struct FrameGraphTextureDesc {
+	int width, height;
+	GLenum format; //sized internal format, depth formats attach as the depth buffer
+	int levels; //mip levels
+
+	FrameGraphTextureDesc() : width(0), height(0), format(GL_RGBA8), levels(1) {}
+	FrameGraphTextureDesc(int w, int h, GLenum f, int l = 1) : width(w), height(h), format(f), levels(l) {}
+};
+
+struct FrameGraphResourceNode {
+	const char* name;
+	FrameGraphTextureDesc desc;
+	bool imported; //the window or a caller's texture: never allocated, writing it keeps a pass alive
+	GLuint texture; //imported texture, 0 for the window
+	//compiled
+	int first_use, last_use; //positions in the execution order, -1 if unused
+	int physical; //index into FrameGraph::pool
+};
+
+struct FrameGraph;
+typedef std::function<void(const FrameGraph&)> FrameGraphExecute;
+
+struct FrameGraphPass {
+	const char* name;
+	FrameGraphExecute execute;
+	std::vector<FrameGraphResource> reads;
+	std::vector<FrameGraphResource> writes;
+	std::vector<bool> clears; //per write
+	std::vector<GLfloat> clear_values; //4 per write
+	//compiled
+	bool culled;
+	GLuint fbo;
+	int width, height;
+};
+
+struct FrameGraphTexture {
+	FrameGraphTextureDesc desc;
+	GLuint texture;
+	long long bytes;
+	int last_frame; //last frame it backed a resource
+};
+
+struct FrameGraphFramebuffer {
+	GLuint attachments[FRAMEGRAPH_MAX_COLOR_ATTACHMENTS + 1]; //colours, then depth
+	GLuint fbo;
+};
+
+struct FrameGraphStats {
+	int passes, culled_passes;
+	int resources, textures; //transient resources used, physical textures backing them
+	long long resource_bytes; //the transient resources with a texture each
+	long long texture_bytes; //what they actually use after aliasing
+	long long pool_bytes; //everything the pool holds, including textures kept for later frames
+	double compile_ms;
+
+	FrameGraphStats() : passes(0), culled_passes(0), resources(0), textures(0),
+		resource_bytes(0), texture_bytes(0), pool_bytes(0), compile_ms(0.0) {}
+};
+
+struct FrameGraph {
+	std::vector<FrameGraphResourceNode> resources;
+	std::vector<FrameGraphPass> passes;
+	std::vector<int> order; //compiled execution order, kept passes only
+	//persistent between frames
+	std::vector<FrameGraphTexture> pool;
+	std::vector<FrameGraphFramebuffer> framebuffers;
+	int frame;
+	FrameGraphStats stats;
+
+	FrameGraph() : frame(0) {}
+};
+
+// Starts a new frame's graph; pooled textures and framebuffers are kept
+void framegraph_reset(FrameGraph& graph);
+
+FrameGraphResource framegraph_create_texture(FrameGraph& graph, const char* name, const FrameGraphTextureDesc& desc);
+// The default framebuffer, width x height
+FrameGraphResource framegraph_import_window(FrameGraph& graph, const char* name, int width, int height);
+// A colour texture owned by the caller, e.g. an offscreen frame to read back
+FrameGraphResource framegraph_import_texture(FrameGraph& graph, const char* name, GLuint texture, const FrameGraphTextureDesc& desc);
+
+int framegraph_add_pass(FrameGraph& graph, const char* name, const FrameGraphExecute& execute);
+void framegraph_read(FrameGraph& graph, int pass, FrameGraphResource resource);
+// clear: 4 values (only the first for depth), or NULL to keep the contents
+void framegraph_write(FrameGraph& graph, int pass, FrameGraphResource resource, const GLfloat* clear = NULL);
+
+void framegraph_compile(FrameGraph& graph);
+void framegraph_execute(const FrameGraph& graph);
+
+// Physical texture of a resource, valid while executing
+GLuint framegraph_texture(const FrameGraph& graph, FrameGraphResource resource);
+
+void framegraph_print(const FrameGraph& graph);
+void framegraph_destroy(FrameGraph& graph);
@@ -0,0 +1,93 @@
+#include "framepacer.h"
+
+#include <algorithm>
+#include <chrono>
+
+static double seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// GL_TIMESTAMP read now is the GPU clock at this point in the command stream, close enough
+// to the CPU clock read next to it
+static void calibrate(FramePacer& pacer) {
+	GLint64 gpu_now = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+	pacer.clock_offset = seconds() - gpu_now * 1e-9;
+	pacer.frames_since_calibration = 0;
+}
+
+void framepacer_create(FramePacer& pacer, int max_frames_in_flight) {
+	framepacer_destroy(pacer);
+	pacer.max_frames_in_flight = std::max(1, std::min(max_frames_in_flight, FRAME_PACER_MAX_FRAMES));
+	for (int i = 0; i < FRAME_PACER_MAX_FRAMES; i++) glGenQueries(1, &pacer.frames[i].query);
+	pacer.next = 0;
+	pacer.latency_ms.assign(FRAME_PACER_SAMPLES, 0.0f);
+	framepacer_reset_stats(pacer);
+	calibrate(pacer);
+}
+
+void framepacer_destroy(FramePacer& pacer) {
+	for (int i = 0; i < FRAME_PACER_MAX_FRAMES; i++) {
+		FramePacerFrame& frame = pacer.frames[i];
+		if (frame.fence) glDeleteSync(frame.fence);
+		if (frame.query) glDeleteQueries(1, &frame.query);
+		frame.fence = 0;
+		frame.query = 0;
+	}
+}
+
+void framepacer_begin_frame(FramePacer& pacer) {
+	FramePacerFrame& frame = pacer.frames[pacer.next];
+	if (frame.fence) {
+		double start = seconds();
+		while (glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+		pacer.wait_ms += (seconds() - start) * 1000.0;
+		glDeleteSync(frame.fence);
+		frame.fence = 0;
+
+		//the fence came after the timestamp, so the result is there without stalling
+		GLuint64 gpu_time = 0;
+		glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpu_time);
+		double latency = (gpu_time * 1e-9 + pacer.clock_offset - frame.input_time) * 1000.0;
+		pacer.latency_ms[pacer.sample_count % FRAME_PACER_SAMPLES] = (float)std::max(latency, 0.0);
+		pacer.sample_count++;
+	}
+	pacer.paced_frames++;
+	if (++pacer.frames_since_calibration >= FRAME_PACER_CALIBRATE_FRAMES) calibrate(pacer);
+	pacer.input_time = seconds();
+}
+
+void framepacer_latch(FramePacer& pacer) {
+	pacer.input_time = seconds();
+}
+
+void framepacer_end_frame(FramePacer& pacer) {
+	FramePacerFrame& frame = pacer.frames[pacer.next];
+	frame.input_time = pacer.input_time;
+	glQueryCounter(frame.query, GL_TIMESTAMP);
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pacer.next = (pacer.next + 1) % pacer.max_frames_in_flight;
+}
+
+FramePacerStats framepacer_stats(const FramePacer& pacer) {
+	FramePacerStats stats;
+	stats.samples = std::min(pacer.sample_count, FRAME_PACER_SAMPLES);
+	if (pacer.paced_frames > 0) stats.wait_ms = pacer.wait_ms / pacer.paced_frames;
+	if (stats.samples == 0) return stats;
+
+	std::vector<float> sorted(pacer.latency_ms.begin(), pacer.latency_ms.begin() + stats.samples);
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (float ms : sorted) sum += ms;
+	stats.mean_ms = sum / stats.samples;
+	stats.median_ms = sorted[stats.samples / 2];
+	stats.p99_ms = sorted[std::min(stats.samples - 1, stats.samples * 99 / 100)];
+	stats.max_ms = sorted.back();
+	return stats;
+}
+
+void framepacer_reset_stats(FramePacer& pacer) {
+	pacer.sample_count = 0;
+	pacer.wait_ms = 0.0;
+	pacer.paced_frames = 0;
+}
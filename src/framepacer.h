@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+
+// Frames the pacer can keep in flight; the stream buffer has this many regions, so allowing
+// more would only move the wait there
+#define FRAME_PACER_MAX_FRAMES 3
+// Latency samples kept for the statistics (a ring, oldest overwritten)
+#define FRAME_PACER_SAMPLES 512
+// Frames between re-reading the GPU clock against the CPU clock
+#define FRAME_PACER_CALIBRATE_FRAMES 240
+
+// Frame pacing. Without it the driver queues as many frames as it likes behind
+// glfwSwapBuffers, and every queued frame is input latency. The pacer puts a fence and a
+// timestamp query after each swap and, before the CPU starts a frame, waits for the frame
+// max_frames_in_flight back to finish on the GPU, so at most that many frames are ever queued.
+//
+// Latency is measured from the moment camera input was last sampled for a frame
+// (framepacer_latch) to the GPU timestamp taken right after its swap, i.e. until the frame
+// is rendered and handed to presentation; the display's own scanout delay is not included.
+// GPU timestamps are moved onto the CPU clock with an offset read now and then.
+struct FramePacerFrame {
+	GLsync fence; //0 when the slot is free
+	GLuint query; //GL_TIMESTAMP after the swap
+	double input_time; //CPU seconds
+};
+
+struct FramePacerStats {
+	int samples;
+	double mean_ms, median_ms, p99_ms, max_ms;
+	double wait_ms; //per frame, CPU time blocked on the fences
+
+	FramePacerStats() : samples(0), mean_ms(0.0), median_ms(0.0), p99_ms(0.0), max_ms(0.0), wait_ms(0.0) {}
+};
+
+struct FramePacer {
+	int max_frames_in_flight;
+	FramePacerFrame frames[FRAME_PACER_MAX_FRAMES];
+	int next; //slot of the frame being built
+	double input_time; //latest framepacer_latch
+	double clock_offset; //CPU seconds minus GPU seconds
+	int frames_since_calibration;
+
+	std::vector<float> latency_ms; //ring of FRAME_PACER_SAMPLES
+	int sample_count; //since the last reset, may exceed the ring
+	double wait_ms;
+	int paced_frames;
+
+	FramePacer() : max_frames_in_flight(2), next(0), input_time(0.0), clock_offset(0.0), frames_since_calibration(0),
+		sample_count(0), wait_ms(0.0), paced_frames(0) {
+		for (int i = 0; i < FRAME_PACER_MAX_FRAMES; i++) {
+			frames[i].fence = 0;
+			frames[i].query = 0;
+			frames[i].input_time = 0.0;
+		}
+	}
+};
+
+// max_frames_in_flight is clamped to 1..FRAME_PACER_MAX_FRAMES
+void framepacer_create(FramePacer& pacer, int max_frames_in_flight);
+void framepacer_destroy(FramePacer& pacer);
+
+// Blocks until the frame max_frames_in_flight back is done and records its latency. Called
+// before any of the frame's CPU work, so that work is as fresh as it can be.
+void framepacer_begin_frame(FramePacer& pacer);
+// Marks the time camera input was sampled; a later call for the same frame replaces it
+void framepacer_latch(FramePacer& pacer);
+// Right after the swap
+void framepacer_end_frame(FramePacer& pacer);
+
+FramePacerStats framepacer_stats(const FramePacer& pacer);
+void framepacer_reset_stats(FramePacer& pacer);
@@ -37,6 +37,22 @@ void gl_createIndexBuffer(const GLuint* data, int data_size) {
 	glBindBuffer(GL_ARRAY_BUFFER, 0); //unbind buffers
 }
 
+// Points the VAO's per-instance matrix at 'buffer', starting 'offset' bytes in; called again
+// to re-point it, e.g. at this frame's range of a stream buffer
+void gl_bindInstanceMat4Attribute(GLuint buffer, GLuint shader, const char* attrib, GLintptr offset) {
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// A mat4 attribute takes four consecutive locations, one per column
+	GLuint matrixLoc = glGetAttribLocation(shader, attrib);
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(matrixLoc + column);
+		glVertexAttribPointer(matrixLoc + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), (void*)(offset + column * 4 * sizeof(GLfloat)));
+		glVertexAttribDivisor(matrixLoc + column, 1); //advance once per instance
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0); //unbind buffers
+}
+
 void gl_unbindVAO() {
 #ifdef __APPLE__
 	glBindVertexArrayAPPLE(0); //unbind VAO
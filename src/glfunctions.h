@@ -8,5 +8,6 @@
 GLuint gl_createAndBindVAO();
 void gl_createAndBindAttribute(const GLfloat data[], int data_size, GLuint shader, const char* attrib, GLuint attrib_size);
 void gl_createIndexBuffer(const GLuint* data, int data_size);
+void gl_bindInstanceMat4Attribute(GLuint buffer, GLuint shader, const char* attrib, GLintptr offset = 0);
 void gl_unbindVAO();
 void gl_bindVAO(GLuint vao);
\ No newline at end of file
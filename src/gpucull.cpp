@@ -0,0 +1,166 @@
+#include "gpucull.h"
+
+#include <math.h>
+
+#include "glfunctions.h"
+
+static const float GPU_CULL_PI = 3.14159265358979f;
+
+bool gpucull_supported() {
+	return GLEW_VERSION_4_3 != 0;
+}
+
+// UV sphere of unit radius appended to the arrays, texture coordinates as on the sphere
+// mesh: u from atan(x, z), v from the latitude
+static void append_sphere(int segments, int rings, std::vector<GLfloat>& positions, std::vector<GLfloat>& normals,
+	std::vector<GLfloat>& uvs, std::vector<GLuint>& indices) {
+	GLuint base = (GLuint)(positions.size() / 3);
+	for (int j = 0; j <= rings; j++) {
+		float latitude = GPU_CULL_PI * ((float)j / rings - 0.5f);
+		for (int i = 0; i <= segments; i++) {
+			float longitude = 2.0f * GPU_CULL_PI * ((float)i / segments - 0.5f);
+			float n[3] = { cosf(latitude) * sinf(longitude), sinf(latitude), cosf(latitude) * cosf(longitude) };
+			positions.insert(positions.end(), n, n + 3);
+			normals.insert(normals.end(), n, n + 3);
+			uvs.push_back((float)i / segments);
+			uvs.push_back((float)j / rings);
+		}
+	}
+	//counter-clockwise seen from outside
+	for (int j = 0; j < rings; j++) {
+		for (int i = 0; i < segments; i++) {
+			GLuint a = base + j * (segments + 1) + i, b = a + 1, c = a + segments + 1, d = c + 1;
+			if (j > 0) { indices.push_back(a); indices.push_back(b); indices.push_back(d); }
+			if (j < rings - 1) { indices.push_back(a); indices.push_back(d); indices.push_back(c); }
+		}
+	}
+}
+
+static void allocate(GpuCull& cull, int capacity) {
+	cull.capacity = capacity > 1 ? capacity : 1;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull.lod_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, cull.capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull.instance_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, cull.capacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void gpucull_create(GpuCull& cull, GLuint cull_program, GLuint compact_program,
+	GLuint mesh_shader, GLuint impostor_shader, int capacity) {
+	gpucull_destroy(cull);
+	cull.cull_program = cull_program;
+	cull.compact_program = compact_program;
+
+	glGenBuffers(1, &cull.lod_buffer);
+	glGenBuffers(1, &cull.instance_buffer);
+	glGenBuffers(1, &cull.command_buffer);
+	allocate(cull, capacity);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cull.command_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, GPU_CULL_COMMAND_UINTS * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	//both meshes in one set of buffers, so one multi-draw covers them
+	std::vector<GLfloat> positions, normals, uvs;
+	std::vector<GLuint> indices;
+	append_sphere(GPU_CULL_MESH_SEGMENTS, GPU_CULL_MESH_RINGS, positions, normals, uvs, indices);
+	cull.first_index[0] = 0;
+	cull.index_count[0] = (GLuint)indices.size();
+	append_sphere(GPU_CULL_LOW_SEGMENTS, GPU_CULL_LOW_RINGS, positions, normals, uvs, indices);
+	cull.first_index[1] = cull.index_count[0];
+	cull.index_count[1] = (GLuint)indices.size() - cull.index_count[0];
+
+	cull.mesh_vao = gl_createAndBindVAO();
+	gl_createAndBindAttribute(&positions[0], positions.size() * sizeof(GLfloat), mesh_shader, "a_vertex", 3);
+	gl_createAndBindAttribute(&normals[0], normals.size() * sizeof(GLfloat), mesh_shader, "a_normal", 3);
+	gl_createAndBindAttribute(&uvs[0], uvs.size() * sizeof(GLfloat), mesh_shader, "a_uv", 2);
+	gl_createIndexBuffer(&indices[0], indices.size() * sizeof(GLuint));
+	gl_bindInstanceMat4Attribute(cull.instance_buffer, mesh_shader, "a_model");
+	gl_unbindVAO();
+
+	//impostors need no geometry, the quad corners come from gl_VertexID
+	cull.impostor_vao = gl_createAndBindVAO();
+	gl_bindInstanceMat4Attribute(cull.instance_buffer, impostor_shader, "a_model");
+	gl_unbindVAO();
+}
+
+void gpucull_destroy(GpuCull& cull) {
+	if (cull.lod_buffer) glDeleteBuffers(1, &cull.lod_buffer);
+	if (cull.instance_buffer) glDeleteBuffers(1, &cull.instance_buffer);
+	if (cull.command_buffer) glDeleteBuffers(1, &cull.command_buffer);
+	if (cull.mesh_vao) glDeleteVertexArrays(1, &cull.mesh_vao);
+	if (cull.impostor_vao) glDeleteVertexArrays(1, &cull.impostor_vao);
+	cull.lod_buffer = cull.instance_buffer = cull.command_buffer = 0;
+	cull.mesh_vao = cull.impostor_vao = 0;
+	cull.capacity = cull.count = 0;
+}
+
+void gpucull_update(GpuCull& cull, StreamBuffer& stream, const std::vector<glm::mat4>& transforms,
+	const Frustum& frustum, float focal_pixels, float impostor_pixels) {
+	cull.count = (int)transforms.size();
+	if (cull.count > cull.capacity) allocate(cull, cull.count);
+
+	//fresh commands: nothing visible yet, base instances are filled in by the compaction
+	GLuint commands[GPU_CULL_COMMAND_UINTS] = { 0 };
+	for (int lod = 0; lod < 2; lod++) {
+		commands[5 * lod + 0] = cull.index_count[lod];
+		commands[5 * lod + 2] = cull.first_index[lod];
+	}
+	commands[GPU_CULL_ARRAYS_COMMAND] = 4;
+	//copied on the GPU: the counters are atomics the passes below add to, so they live in a
+	//buffer of their own rather than in the ring
+	GLintptr commands_offset = streambuffer_upload(stream, commands, sizeof(commands), sizeof(GLuint));
+	if (commands_offset < 0) {
+		cull.count = 0;
+		return;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, stream.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, cull.command_buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, commands_offset, 0, sizeof(commands));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (cull.count == 0) return;
+
+	//the one O(n) step left on the CPU: a single copy of what the simulation produced
+	GLsizeiptr transform_bytes = cull.count * sizeof(glm::mat4);
+	GLintptr transforms_offset = streambuffer_upload(stream, &transforms[0], transform_bytes, stream.storage_alignment);
+	if (transforms_offset < 0) {
+		cull.count = 0;
+		return;
+	}
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, stream.buffer, transforms_offset, transform_bytes);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cull.lod_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cull.command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cull.instance_buffer);
+	GLuint groups = (GLuint)((cull.count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE);
+
+	glUseProgram(cull.cull_program);
+	glUniform1ui(glGetUniformLocation(cull.cull_program, "u_count"), (GLuint)cull.count);
+	glUniform4fv(glGetUniformLocation(cull.cull_program, "u_planes"), 6, &frustum.planes[0][0]);
+	glUniform1f(glGetUniformLocation(cull.cull_program, "u_focal_pixels"), focal_pixels);
+	glUniform1f(glGetUniformLocation(cull.cull_program, "u_lod_pixels"), cull.lod_pixels);
+	glUniform1f(glGetUniformLocation(cull.cull_program, "u_impostor_pixels"), impostor_pixels);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glUseProgram(cull.compact_program);
+	glUniform1ui(glGetUniformLocation(cull.compact_program, "u_count"), (GLuint)cull.count);
+	glDispatchCompute(groups, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void gpucull_draw_meshes(const GpuCull& cull) {
+	gl_bindVAO(cull.mesh_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cull.command_buffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 2, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	gl_unbindVAO();
+}
+
+void gpucull_draw_impostors(const GpuCull& cull) {
+	gl_bindVAO(cull.impostor_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cull.command_buffer);
+	glDrawArraysIndirect(GL_TRIANGLE_STRIP, (const void*)(GPU_CULL_ARRAYS_COMMAND * sizeof(GLuint)));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	gl_unbindVAO();
+}
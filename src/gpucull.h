@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "streambuffer.h"
+
+// GPU-driven culling of the small bodies (GL 4.3). Every body's model matrix is written to
+// the frame's stream buffer range and read from there as a shader storage buffer; a compute pass frustum-culls each one and picks a level of detail
+// from its projected radius (full mesh, low-poly mesh or impostor), and a second pass packs
+// the visible matrices LOD after LOD into the instance buffer and fills in the indirect
+// commands. Drawing is then one glMultiDrawElementsIndirect for both meshes and one
+// glDrawArraysIndirect for the impostors, the same two calls whatever the body count.
+//
+// Command buffer, in GLuints:
+//   0..9   DrawElementsIndirectCommand for the mesh and the low-poly mesh
+//   10..13 DrawArraysIndirectCommand for the impostors (4 vertex strip)
+//   14..16 running counts of the compaction pass
+#define GPU_CULL_LODS 3
+#define GPU_CULL_ARRAYS_COMMAND 10
+#define GPU_CULL_COMMAND_UINTS 17
+#define GPU_CULL_GROUP_SIZE 256 //local_size_x of both compute shaders
+
+// Segments around and rings from pole to pole of the two UV spheres
+#define GPU_CULL_MESH_SEGMENTS 32
+#define GPU_CULL_MESH_RINGS 16
+#define GPU_CULL_LOW_SEGMENTS 8
+#define GPU_CULL_LOW_RINGS 6
+
+struct GpuCull {
+	GLuint cull_program, compact_program;
+	GLuint lod_buffer; //per body: LOD, or culled
+	GLuint instance_buffer; //visible model matrices, LOD ranges one after the other
+	GLuint command_buffer;
+	GLuint mesh_vao, impostor_vao;
+	int capacity; //bodies the buffers hold
+	int count; //bodies culled last update
+	GLuint first_index[2], index_count[2]; //mesh and low-poly mesh in the shared index buffer
+
+	float lod_pixels; //projected radius below which the low-poly mesh is drawn
+
+	GpuCull() : cull_program(0), compact_program(0), lod_buffer(0), instance_buffer(0),
+		command_buffer(0), mesh_vao(0), impostor_vao(0), capacity(0), count(0), lod_pixels(96.0f) {
+		first_index[0] = first_index[1] = index_count[0] = index_count[1] = 0;
+	}
+};
+
+// GL 4.3 brings compute shaders, storage buffers and multi-draw indirect
+bool gpucull_supported();
+
+// Builds both meshes and the buffers for 'capacity' bodies. The mesh VAO is laid out for
+// mesh_shader (a_vertex, a_normal, a_uv, a_model per instance), the impostor VAO for
+// impostor_shader (a_model per instance).
+void gpucull_create(GpuCull& cull, GLuint cull_program, GLuint compact_program,
+	GLuint mesh_shader, GLuint impostor_shader, int capacity);
+void gpucull_destroy(GpuCull& cull);
+
+// Uploads the matrices and the reset commands through 'stream' and runs both passes. Bodies
+// below impostor_pixels of projected radius become impostors (0 for none, FLT_MAX for all).
+// If the stream buffer is full this frame nothing is drawn.
+void gpucull_update(GpuCull& cull, StreamBuffer& stream, const std::vector<glm::mat4>& transforms,
+	const Frustum& frustum, float focal_pixels, float impostor_pixels);
+
+// The caller activates the shader and sets its uniforms
+void gpucull_draw_meshes(const GpuCull& cull);
+void gpucull_draw_impostors(const GpuCull& cull);
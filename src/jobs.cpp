@@ -0,0 +1,234 @@
+#include "jobs.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+typedef std::chrono::steady_clock jobs_clock;
+
+struct Job {
+	std::function<void()> fn;
+	JobCounter* counter;
+};
+
+struct Worker {
+	std::mutex lock;
+	std::deque<Job*> jobs; //owner works at the back, thieves take from the front
+	std::atomic<unsigned long long> executed;
+	std::atomic<unsigned long long> steals;
+	std::atomic<unsigned long long> busy_ns;
+
+	Worker() : executed(0), steals(0), busy_ns(0) {}
+};
+
+// g_workers[0..n-1] belong to the threads, the extra last deque takes jobs
+// submitted from threads outside the system
+static std::vector<Worker*> g_workers;
+static std::vector<std::thread> g_threads;
+static int g_num_threads = 0;
+static std::atomic<bool> g_running(false);
+static std::atomic<int> g_queued(0);
+static std::mutex g_sleep_lock;
+static std::condition_variable g_wake;
+static jobs_clock::time_point g_stats_start;
+
+static thread_local int t_worker = -1;
+static thread_local int t_depth = 0; //nested jobs, only the outermost counts as busy time
+
+static void push(Job* job) {
+	int w = t_worker >= 0 ? t_worker : g_num_threads;
+	{
+		std::lock_guard<std::mutex> guard(g_workers[w]->lock);
+		g_workers[w]->jobs.push_back(job);
+	}
+	g_queued++;
+	g_wake.notify_one();
+}
+
+static Job* pop_local(int w) {
+	if (w < 0) return NULL;
+	Worker* worker = g_workers[w];
+	std::lock_guard<std::mutex> guard(worker->lock);
+	if (worker->jobs.empty()) return NULL;
+	Job* job = worker->jobs.back();
+	worker->jobs.pop_back();
+	return job;
+}
+
+static Job* steal(int thief) {
+	int count = (int)g_workers.size();
+	int start = thief >= 0 ? thief + 1 : 0;
+	for (int k = 0; k < count; k++) {
+		int victim = (start + k) % count;
+		if (victim == thief) continue;
+		Worker* worker = g_workers[victim];
+		std::lock_guard<std::mutex> guard(worker->lock);
+		if (worker->jobs.empty()) continue;
+		Job* job = worker->jobs.front();
+		worker->jobs.pop_front();
+		return job;
+	}
+	return NULL;
+}
+
+static void finish(JobCounter* counter) {
+	if (!counter) return;
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> guard(counter->lock);
+		if (--counter->pending == 0) ready.swap(counter->continuations);
+	}
+	for (size_t i = 0; i < ready.size(); i++) push(ready[i]);
+}
+
+static void execute(Job* job, int w, bool stolen) {
+	jobs_clock::time_point start = jobs_clock::now();
+	t_depth++;
+	job->fn();
+	t_depth--;
+	if (w >= 0) {
+		Worker* worker = g_workers[w];
+		worker->executed++;
+		if (stolen) worker->steals++;
+		if (t_depth == 0) {
+			worker->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(jobs_clock::now() - start).count();
+		}
+	}
+	finish(job->counter);
+	delete job;
+}
+
+static bool run_one(int w) {
+	bool stolen = false;
+	Job* job = pop_local(w);
+	if (!job) {
+		job = steal(w);
+		stolen = job != NULL;
+	}
+	if (!job) return false;
+	g_queued--;
+	execute(job, w, stolen);
+	return true;
+}
+
+static void worker_main(int w) {
+	t_worker = w;
+	while (g_running) {
+		if (run_one(w)) continue;
+		std::unique_lock<std::mutex> sleep(g_sleep_lock);
+		g_wake.wait_for(sleep, std::chrono::milliseconds(1), [] { return g_queued > 0 || !g_running; });
+	}
+}
+
+void jobs_init(int num_threads) {
+	jobs_shutdown();
+	if (num_threads <= 0) num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+	g_num_threads = num_threads;
+	for (int w = 0; w <= num_threads; w++) g_workers.push_back(new Worker());
+
+	t_worker = 0;
+	g_running = true;
+	for (int w = 1; w < num_threads; w++) g_threads.push_back(std::thread(worker_main, w));
+	jobs_reset_stats();
+}
+
+void jobs_shutdown() {
+	g_running = false;
+	g_wake.notify_all();
+	for (size_t i = 0; i < g_threads.size(); i++) g_threads[i].join();
+	g_threads.clear();
+	for (size_t w = 0; w < g_workers.size(); w++) {
+		for (size_t k = 0; k < g_workers[w]->jobs.size(); k++) delete g_workers[w]->jobs[k];
+		delete g_workers[w];
+	}
+	g_workers.clear();
+	g_num_threads = 0;
+	g_queued = 0;
+	t_worker = -1;
+}
+
+int jobs_num_threads() {
+	return std::max(1, g_num_threads);
+}
+
+void jobs_run(const std::function<void()>& fn, JobCounter* counter, JobCounter* dependency) {
+	//without workers everything runs inline, dependencies are then always complete
+	if (g_workers.empty()) {
+		fn();
+		return;
+	}
+
+	Job* job = new Job();
+	job->fn = fn;
+	job->counter = counter;
+	if (counter) counter->pending++;
+
+	if (dependency) {
+		std::lock_guard<std::mutex> guard(dependency->lock);
+		if (dependency->pending > 0) {
+			dependency->continuations.push_back(job);
+			return;
+		}
+	}
+	push(job);
+}
+
+void jobs_wait(JobCounter* counter) {
+	while (counter->pending > 0) {
+		if (g_workers.empty() || !run_one(t_worker)) std::this_thread::yield();
+	}
+	//the finishing thread may still hold the lock; the counter must outlive it
+	std::lock_guard<std::mutex> guard(counter->lock);
+}
+
+void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+	if (begin >= end) return;
+	size_t count = end - begin;
+	size_t target_chunks = (size_t)jobs_num_threads() * 4; //some slack for stealing
+	size_t chunk = std::max(std::max<size_t>(grain, 1), (count + target_chunks - 1) / target_chunks);
+	if (g_workers.empty() || chunk >= count) {
+		fn(begin, end);
+		return;
+	}
+
+	JobCounter counter;
+	size_t last = begin + ((count - 1) / chunk) * chunk;
+	for (size_t b = begin; b < last; b += chunk) {
+		size_t e = b + chunk;
+		jobs_run([&fn, b, e] { fn(b, e); }, &counter);
+	}
+	fn(last, end); //the caller takes the last chunk
+	jobs_wait(&counter);
+}
+
+void jobs_get_stats(std::vector<JobWorkerStats>& stats) {
+	double wall_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(jobs_clock::now() - g_stats_start).count();
+	stats.resize(g_num_threads);
+	for (int w = 0; w < g_num_threads; w++) {
+		stats[w].executed = g_workers[w]->executed;
+		stats[w].steals = g_workers[w]->steals;
+		stats[w].utilization = wall_ns > 0.0 ? g_workers[w]->busy_ns / wall_ns : 0.0;
+	}
+}
+
+void jobs_reset_stats() {
+	for (size_t w = 0; w < g_workers.size(); w++) {
+		g_workers[w]->executed = 0;
+		g_workers[w]->steals = 0;
+		g_workers[w]->busy_ns = 0;
+	}
+	g_stats_start = jobs_clock::now();
+}
+
+void jobs_print_stats() {
+	std::vector<JobWorkerStats> stats;
+	jobs_get_stats(stats);
+	printf("Job system: %d workers\n", g_num_threads);
+	printf("  %6s %12s %10s %12s\n", "worker", "jobs", "steals", "utilization");
+	for (size_t w = 0; w < stats.size(); w++) {
+		printf("  %6u %12llu %10llu %11.1f%%\n", (unsigned int)w, stats[w].executed, stats[w].steals, stats[w].utilization * 100.0);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Work-stealing job system. Every worker owns a deque: it pushes and pops its own
+// jobs at the back while idle workers steal from the front of the others. The thread
+// that calls jobs_init() is worker 0 and runs jobs while it waits.
+
+struct Job;
+
+// Counts unfinished jobs. Jobs can wait on a counter or be scheduled to start only
+// once a counter reaches zero (a dependency).
+struct JobCounter {
+	std::atomic<int> pending;
+	std::mutex lock;
+	std::vector<Job*> continuations; //jobs waiting for this counter
+
+	JobCounter() : pending(0) {}
+};
+
+struct JobWorkerStats {
+	unsigned long long executed; //jobs run by this worker
+	unsigned long long steals; //of those, taken from another worker's deque
+	double utilization; //busy time / wall time since the last reset
+};
+
+void jobs_init(int num_threads); //0 = one per hardware thread
+void jobs_shutdown();
+int jobs_num_threads();
+
+// Schedules fn. 'counter' (optional) is incremented now and decremented when fn
+// returns; 'dependency' (optional) delays the start until it reaches zero.
+void jobs_run(const std::function<void()>& fn, JobCounter* counter, JobCounter* dependency = NULL);
+
+// Runs other jobs until the counter reaches zero
+void jobs_wait(JobCounter* counter);
+
+// Splits [begin, end) into chunks of at least 'grain' items, runs fn(chunk_begin, chunk_end)
+// on the workers and returns when all chunks are done
+void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+void jobs_get_stats(std::vector<JobWorkerStats>& stats);
+void jobs_reset_stats();
+void jobs_print_stats();
@@ -4,8 +4,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include <time.h> 
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <float.h>
 
 //include OpenGL libraries
 #include <GL/glew.h>
@@ -18,6 +24,30 @@
 //include some custom code files
 #include "glfunctions.h" //include all OpenGL stuff
 #include "Shader.h" // class to compile shaders
+#include "orbits.h" // Kepler orbit propagator
+#include "nbody.h" // Barnes-Hut N-body simulation
+#include "bodies.h" // body storage
+#include "belt.h" // GPU-evaluated asteroid belt
+#include "jobs.h" // work-stealing job system
+#include "culling.h" // frustum culling
+#include "snapshot.h" // simulation snapshots
+#include "catalog.h" // minor planet catalogs
+#include "bvh.h" // bounding volume hierarchy for picking
+#include "collisions.h" // contacts and close approaches between small bodies
+#include "eclipse.h" // analytic shadows between bodies
+#include "bloom.h" // HDR bloom and tonemapping
+#include "atmosphere.h" // precomputed scattering for the Earth
+#include "oit.h" // order-independent transparency
+#include "skybox.h" // cube map sky
+#include "framegraph.h" // render passes and their targets
+#include "gpucull.h" // compute culling and indirect draws for the small bodies
+#include "streambuffer.h" // per-frame ring buffer for dynamic data
+#include "framepacer.h" // frames in flight and input latency
+#include "capture.h" // offline video capture
+#include "poster.h" // tiled stills larger than a framebuffer
+#include "swraster.h" // CPU rasterizer for machines without a GPU
+#include "raytrace.h" // analytic CPU ray tracer over the body spheres
+#include "png.h" // streaming PNG writer
 
 //include custome loaders 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -27,31 +57,16 @@
 using namespace std;
 using namespace glm;
 
-struct bodie {
-	string name;
-	string type;
-	GLuint texture_id;
-	GLuint texture_spec_id;
-	GLuint normal_map_id;
-	GLuint texture_trans_id;
-	GLuint texture_night_id;
-	float clouds_rotation;
-	vec3 position;
-	vec3 scale;
-	float orbit_angle;
-	float rotacion;
-	float orbit_speed;
-	float dist_to_sun;
-};
-
-vector<bodie> bodies; //Planets
+BodyStore g_bodies; //Sun and planets
+int g_earth = -1; //Earth's index in g_bodies
 
 //Sistem
 int g_ViewportWidth = 800; int g_ViewportHeight = 800; // Default window size, in pixels
 double mouse_x, mouse_y; //variables storing mouse position
 const vec3 g_backgroundColor(0.2f, 0.2f, 0.2f); // background colour - a GLM 3-component vector
 
-vec3 eye(0, 0, 50), center(0.0, 0.0, 0.0), up(0, 1, 0); //Camera  
+vec3 eye(0, 0, 50), center(0.0, 0.0, 0.0), up(0, 1, 0); //Camera in render space: eye stays at the origin
+dvec3 g_camera_pos(0.0, 0.0, 50.0); //Camera in world space, everything is drawn relative to it
 int camera_mode = 1; //Camera type - Default -> Earth Camera
 
 //Shaders 
@@ -61,24 +76,191 @@ GLuint g_phongShader = 0;
 GLuint g_phongEarthShader = 0; 
 
 //Extra textures
-GLuint texture_skybox_id = 0; 
+GLuint texture_skybox_id = 0; //cube map
 GLuint texture_cloud_id = 0;
 
 //Variables of the sistem 
-float g_NumPlanets = 0;
-vec3 g_light_dir(0, 0, 0); //Lighting 
-float dist_to_sun0 = 10; //Distance first planet-sun
+vec3 g_light_pos(0, 0, 0); //Lighting (the sun), camera-relative like everything drawn
+float g_units_per_au = 40.0f; //Scene units per astronomical unit
+bool g_real_scale = false; //--real-scale: kilometres, real distances and radii
+double g_sim_time = 0.0; //Simulated days since J2000, owned by the simulation thread
+float g_days_per_tick = 1.0f; //Simulation speed
+double g_tick_rate = 60.0; //Simulation ticks per second (--tick-rate)
+double g_render_time = 0.0; //Simulated days at the interpolated frame, for GPU-evaluated orbits
+
+//Simulation thread: owns g_sim_state and publishes a copy every tick through the triple buffer,
+//the render thread interpolates between the last two snapshots it picked up
+SimSnapshot g_sim_state;
+TripleBuffer<SimSnapshot> g_snapshots;
+SimSnapshot g_previous_snapshot;
+std::thread g_sim_thread;
+std::atomic<bool> g_sim_running(false);
+
+static double wallSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OrbitSet g_planet_orbits; //Keplerian elements of the planets, entry k drives body k + 1
+
+//Asteroid field (--asteroids N)
+int g_NumAsteroids = 0;
+OrbitSet g_asteroid_orbits;
+
+//N-body particle disk (--nbody N), drawn after the asteroids
+int g_NumParticles = 0;
+NBodySystem g_nbody;
+float g_nbody_theta = 0.5f; //opening angle (--theta)
+int g_nbody_threads = 0; //0 = all hardware threads (--threads), also sizes the job system
+
+//Small bodies share one instanced draw: asteroids first, then N-body particles
+vector<mat4> g_instance_transforms; //Instance matrices, simulation output goes into their translation column
+vector<mat4> g_visible_transforms; //The ones inside the view frustum, what actually gets drawn
+Bvh g_pick_bvh; //Over the instance bounding spheres, refit every frame
+
+//Eclipses: per body, the few bodies that may shadow it, refreshed every frame (toggled with S)
+vector<EclipseOccluders> g_eclipse_occluders;
+bool g_eclipses = true;
+
+//Selection (left click): a body, or a small body by instance index
+int g_picked_body = -1;
+int g_picked_instance = -1;
+
+//Contacts and close approaches between small bodies (--approach D, in Earth radii; off by default)
+float g_approach_radii = 0.0f;
+vector<float> g_instance_radius; //Bounding sphere radius of each instance, set in load()
+vector<float> g_collision_spheres; //x, y, z, r interleaved, simulation thread only
+CollisionSystem g_collisions;
+vector<CollisionEvent> g_collision_scratch;
+CollisionEventQueue g_collision_events; //Filled by the simulation, drained and printed by update()
+#define ASTEROID_JOB_SIZE 4096 //Asteroids propagated per job
+GLuint g_instanceVao = 0; //model matrices from this frame's range of g_stream
+GLuint g_instancedShader = 0;
+GLuint texture_asteroid_id = 0;
+
+//Massive belt evaluated in the vertex shader (--belt N, or a catalog with --catalog file [--catalog-limit N])
+int g_NumBeltBodies = 0;
+const char* g_catalog_path = NULL; //MPCORB-style file
+size_t g_catalog_limit = 0; //0 = all records
+GpuBelt g_belt;
+GLuint g_beltShader = 0;
+bool g_belt_rocks = false; //points or low-poly rocks, toggled with B
+
+//Impostors: one ray-cast quad per body instead of the sphere mesh, cycled with I
+int g_impostor_mode = 1; //0 = meshes only, 1 = impostors below g_impostor_pixels, 2 = impostors only
+float g_impostor_pixels = 24.0f; //projected radius, in pixels
+GLuint g_impostorShader = 0;
+GLuint g_impostorVao = 0; //no arrays, the model matrix is a constant attribute (stream ring full)
+GLuint g_impostorInstancedVao = 0; //model matrices from this frame's range of g_stream, bodies included
+
+//GPU-driven small bodies (GL 4.3, toggled with C): culled, LOD-selected and drawn indirectly
+GpuCull g_gpu_cull;
+bool g_gpu_culling = false;
+GLuint g_cullProgram = 0, g_compactProgram = 0;
+double g_small_bodies_cpu_ms = 0.0; //culling and submission on the CPU, since the last J
+int g_small_bodies_frames = 0;
+
+//Everything written once a frame (instance matrices, uniform blocks, indirect commands) goes
+//through one persistently mapped ring, fenced per frame
+StreamBuffer g_stream;
+GLuint g_eclipse_fallback_ubo = 0; //the eclipse block when the ring is full, filled with glBufferSubData
+#define STREAM_BUFFER_HEADROOM (1 << 20) //room for uniform blocks and commands, on top of the matrices
+
+//Frame pacing: frames queued on the GPU (--frames-in-flight N), swap interval (--swap-interval N)
+//and a second read of the mouse look right before the frame is drawn (--late-latch)
+FramePacer g_pacer;
+int g_frames_in_flight = 2;
+int g_swap_interval = 1;
+bool g_late_latch = false;
+
+//Offline capture (--capture out.y4m or frame%05d.png, --capture-fps F, --capture-size WxH,
+//--capture-frames N): fixed timestep, rendered offscreen at its own size, read back asynchronously
+const char* g_capture_path = NULL;
+double g_capture_fps = 60.0;
+int g_capture_width = 0, g_capture_height = 0; //0 = the window's framebuffer
+int g_capture_frames = 0; //0 = until the window is closed
+double g_capture_clock = 0.0; //simulation clock while capturing, seconds: frame / fps
+Capture g_capture;
+
+//Poster (--poster WxH file.png, --poster-tile N): one still rendered tile by tile, then exit
+const char* g_poster_path = NULL;
+int g_poster_width = 0, g_poster_height = 0;
+int g_poster_tile = 2048;
+
+//Software rendering (--software): the bodies are rasterized on the workers from CPU copies of
+//the sphere and the textures, GL only shows the result
+bool g_software = false;
+bool g_cpu_scene = false; //the CPU copies below are loaded, for --software or --raytrace
+SwRaster g_sw_raster;
+SwMesh g_sw_sphere; //shapes[0], as in g_Vao
+vector<SwTexture> g_sw_textures; //per body, the images behind g_bodies.texture_id
+SwTexture g_sw_earth_spec, g_sw_earth_normal, g_sw_earth_night, g_sw_asteroid;
+GLuint g_sw_texture = 0, g_sw_fbo = 0; //the rasterizer's output, blitted into the pass target
+
+//Ray traced still (--raytrace file.png, --raytrace-size WxH): the spheres traced on the CPU, then exit
+const char* g_raytrace_path = NULL;
+int g_raytrace_width = 0, g_raytrace_height = 0; //0 = the window's framebuffer
+RaytraceScene g_raytrace_scene;
+
+GLuint g_output_texture = 0; //where renderFrame() ends up: 0 for the window, else the capture or poster tile
+
+//Mouse look: dragging with the right button turns the camera about the eye
+#define LOOK_DEGREES_PER_PIXEL 0.2f
+mat4 g_camera_view; //view before the mouse look, set in update()
+float g_look_yaw = 0.0f, g_look_pitch = 0.0f; //degrees
+double g_look_cursor_x = 0.0, g_look_cursor_y = 0.0;
+bool g_look_dragging = false;
 
 
 GLuint g_Vao = 0; //Sphere -> Vao
 GLuint g_NumTriangles = 0; // Numbre of triangles we are painting.
 
 
+float g_near_plane = 0.1f; //Scaled with the Earth's radius in load()
+bool g_reversed_z = false; //Float depth buffer cleared to 0, near maps to 1 (needs glClipControl)
+int g_FramebufferWidth = 800; int g_FramebufferHeight = 800;
+
+//Render targets between passes (HDR scene, OIT, bloom chain, overdraw counts) come from the
+//frame graph, rebuilt every frame; it is printed whenever its shape or memory changes
+FrameGraph g_frameGraph;
+FrameGraphStats g_frame_graph_reported;
+
+//Bloom on the HDR scene, toggled with G; only the sun is brighter than 1
+Bloom g_bloom;
+bool g_bloom_enabled = true;
+float g_sun_emissive = 8.0f; //HDR intensity of the sun's surface
+GLuint g_bloomDownShader = 0;
+GLuint g_bloomUpShader = 0;
+GLuint g_tonemapShader = 0;
+
+//Earth's atmosphere from precomputed scattering tables, toggled with A
+AtmosphereParams g_atmosphere_params = atmosphere_default_params();
+Atmosphere g_atmosphere;
+const char* g_atmosphere_cache = "assets/atmosphere.lut"; //tables are computed once and kept here
+GLuint g_atmosphereShader = 0;
+bool g_atmosphere_enabled = true;
+float g_atmosphere_intensity = 10.0f; //sun irradiance the tables are scaled by
+
+//Translucent layers (clouds) go through weighted blended OIT, no sorting
+Oit g_oit;
+GLuint g_oitCompositeShader = 0;
+
+//Skybox: one fullscreen triangle at the far plane, drawn after the opaque bodies
+GLuint g_skyShader = 0;
+GLuint g_fullscreenVao = 0; //empty, the triangle comes from gl_VertexID
+
+//Overdraw view (O): opaque fragments per pixel counted by additive blending into the alpha
+//of a half float target, shown as a heat map; the average comes from its last mip level
+bool g_overdraw_mode = false;
+GLuint g_overdrawShader = 0;
+double g_overdraw_sum = 0.0; //averages since the last report
+int g_overdraw_frames = 0;
+double g_overdraw_report_time = 0.0;
+
 mat4 projection_matrix = perspective(
 	60.0f, // Field of view
 	1.0f, // Aspect ratio
 	0.1f, // near plane (distance from camera)
-	600.0f // Far plane (distance from camera)
+	1500.0f // Far plane (distance from camera)
 );
 
 mat4 view_matrix = glm::lookAt(
@@ -87,6 +269,39 @@ mat4 view_matrix = glm::lookAt(
 	up // probably glm::vec3(0,1,0)
 );
 
+// ------------------------------------------------------------------------------------------
+// This function builds the projection: infinite reversed-Z when the float depth target is
+// available, the usual near/far range otherwise
+// ------------------------------------------------------------------------------------------
+void updateProjection()
+{
+	float aspect = (float)g_ViewportWidth / g_ViewportHeight;
+	if (g_reversed_z) {
+		//clip z = near and w = distance: depth = near / distance, 1 at the near plane, 0 at infinity
+		float f = 1.0f / tan(radians(30.0f));
+		projection_matrix = mat4(0.0f);
+		projection_matrix[0][0] = f / aspect;
+		projection_matrix[1][1] = f;
+		projection_matrix[2][3] = -1.0f;
+		projection_matrix[3][2] = g_near_plane;
+	}
+	else {
+		//far enough for the whole system (Neptune is at 30 AU) at either scale, at the cost of
+		//depth precision in the real-scale case
+		float far_plane = std::max(15000.0f * g_near_plane, 50.0f * g_units_per_au);
+		projection_matrix = perspective(60.0f, aspect, g_near_plane, far_plane);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Camera-relative position of a body: the subtraction is done in double and only the
+// small difference is converted to float
+// ------------------------------------------------------------------------------------------
+vec3 renderPosition(int body)
+{
+	return vec3(dvec3(g_bodies.pos_x[body], g_bodies.pos_y[body], g_bodies.pos_z[body]) - g_camera_pos);
+}
+
 // ------------------------------------------------------------------------------------------
 // This function load all the geometry and textures
 // ------------------------------------------------------------------------------------------
@@ -105,6 +320,50 @@ void load()
 	Shader transparencyShader("src/shader.vert", "src/shader_transparency.frag");
 	g_transparencyShader = transparencyShader.program;
 
+	Shader instancedShader("src/shader_instanced.vert", "src/shader_phong.frag");
+	g_instancedShader = instancedShader.program;
+
+	Shader beltShader("src/shader_belt.vert", "src/shader_belt.frag");
+	g_beltShader = beltShader.program;
+
+	Shader impostorShader("src/shader_impostor.vert", "src/shader_impostor.frag");
+	g_impostorShader = impostorShader.program;
+
+	Shader bloomDownShader("src/shader_fullscreen.vert", "src/shader_bloom_down.frag");
+	g_bloomDownShader = bloomDownShader.program;
+
+	Shader bloomUpShader("src/shader_fullscreen.vert", "src/shader_bloom_up.frag");
+	g_bloomUpShader = bloomUpShader.program;
+
+	Shader tonemapShader("src/shader_fullscreen.vert", "src/shader_tonemap.frag");
+	g_tonemapShader = tonemapShader.program;
+
+	Shader atmosphereShader("src/shader.vert", "src/shader_atmosphere.frag");
+	g_atmosphereShader = atmosphereShader.program;
+
+	Shader oitCompositeShader("src/shader_fullscreen.vert", "src/shader_oit_composite.frag");
+	g_oitCompositeShader = oitCompositeShader.program;
+
+	Shader skyShader("src/shader_sky.vert", "src/shader_sky.frag");
+	g_skyShader = skyShader.program;
+
+	Shader overdrawShader("src/shader_fullscreen.vert", "src/shader_overdraw.frag");
+	g_overdrawShader = overdrawShader.program;
+
+	//lit shaders read their occluders from a uniform block
+	GLuint eclipse_programs[] = { g_phongShader, g_phongEarthShader, g_instancedShader, g_impostorShader };
+	for (GLuint program : eclipse_programs) {
+		glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Eclipse"), ECLIPSE_UNIFORM_BINDING);
+	}
+
+	if (gpucull_supported()) {
+		Shader cullProgram("src/shader_cull.comp");
+		g_cullProgram = cullProgram.program;
+
+		Shader compactProgram("src/shader_compact.comp");
+		g_compactProgram = compactProgram.program;
+	}
+
 
 
 	//SPHERE LOAD
@@ -130,30 +389,72 @@ void load()
 	gl_createAndBindAttribute(&(shapes[0].mesh.texcoords[0]), shapes[0].mesh.texcoords.size() * sizeof(float), g_simpleShader, "a_uv", 2);
 	gl_createIndexBuffer(&(shapes[0].mesh.indices[0]), shapes[0].mesh.indices.size() * sizeof(unsigned int));
 
+	//and on the CPU for the software rasterizer
+	if (g_cpu_scene) {
+		const tinyobj::mesh_t& mesh = shapes[0].mesh;
+		g_sw_sphere = SwMesh();
+		for (size_t v = 0; v < mesh.positions.size() / 3; v++) {
+			g_sw_sphere.positions.push_back(vec3(mesh.positions[3 * v], mesh.positions[3 * v + 1], mesh.positions[3 * v + 2]));
+			if (3 * v + 2 < mesh.normals.size()) g_sw_sphere.normals.push_back(vec3(mesh.normals[3 * v], mesh.normals[3 * v + 1], mesh.normals[3 * v + 2]));
+			if (2 * v + 1 < mesh.texcoords.size()) g_sw_sphere.uvs.push_back(vec2(mesh.texcoords[2 * v], mesh.texcoords[2 * v + 1]));
+		}
+		g_sw_sphere.indices = mesh.indices;
+	}
+
 	//unbind everything
 	gl_unbindVAO();
 
 	//store number of triangles (use in draw())
 	g_NumTriangles = shapes[0].mesh.indices.size() / 3;
 
+	//same sphere with a per-instance model matrix, for the asteroids
+	g_instanceVao = gl_createAndBindVAO();
+	gl_createAndBindAttribute(&(shapes[0].mesh.positions[0]), shapes[0].mesh.positions.size() * sizeof(float), g_instancedShader, "a_vertex", 3);
+	gl_createAndBindAttribute(&(shapes[0].mesh.normals[0]), shapes[0].mesh.normals.size() * sizeof(float), g_instancedShader, "a_normal", 3);
+	gl_createAndBindAttribute(&(shapes[0].mesh.texcoords[0]), shapes[0].mesh.texcoords.size() * sizeof(float), g_instancedShader, "a_uv", 2);
+	gl_createIndexBuffer(&(shapes[0].mesh.indices[0]), shapes[0].mesh.indices.size() * sizeof(unsigned int));
+	gl_unbindVAO(); //a_model is pointed at the stream buffer before each draw
+
+	//impostors need no geometry, the quad corners come from gl_VertexID
+	g_impostorVao = gl_createAndBindVAO();
+	gl_unbindVAO();
+	g_impostorInstancedVao = gl_createAndBindVAO();
+	gl_unbindVAO();
+
 	//All planets informatin 
 	vector<float> scales = { 10, 0.38, 0.95, 1, 0.53,  1.12, 9.45, 4, 3.88 };
+	if (g_real_scale) scales = { 696340, 2439.7, 6051.8, 6371, 3389.5, 69911, 58232, 25362, 24622 }; //mean radii, km
 	vector<string> names = { "Sun", "Mercury", "Venus", "Earth", "Mars", "Jupiter", "Saturn", "Uranus", "Neptune" };
 	vector<char*> textures = { "assets/textures/sunmap.bmp", "assets/textures/mercurymap.bmp", "assets/textures/venusmap.bmp", "assets/textures/earth/earthmap1k.bmp", "assets/textures/marsmap.bmp", "assets/textures/jupitermap.bmp", "assets/textures/saturnmap.bmp", "assets/textures/uranusmap.bmp", "assets/textures/mercurymap.bmp" };
-	vector<string> type = { "sun", "planet", "planet", "planet", "planet", "planet", "planet", "planet", "planet" };
-
-	g_NumPlanets = names.size();
-
-	for (int i = 0; i < g_NumPlanets; i++) {
-		bodie actualPlanet;
-		actualPlanet.name = names[i];
+	vector<BodyType> type = { BODY_SUN, BODY_PLANET, BODY_PLANET, BODY_EARTH, BODY_PLANET, BODY_PLANET, BODY_PLANET, BODY_PLANET, BODY_PLANET };
+
+	//Keplerian elements at J2000: a (AU), e, inclination, longitude of node, longitude of perihelion, mean longitude (degrees)
+	float elements[][6] = {
+		{ 0.38709927f, 0.20563593f, 7.00497902f, 48.33076593f, 77.45779628f, 252.25032350f }, //Mercury
+		{ 0.72333566f, 0.00677672f, 3.39467605f, 76.67984255f, 131.60246718f, 181.97909950f }, //Venus
+		{ 1.00000261f, 0.01671123f, -0.00001531f, 0.0f, 102.93768193f, 100.46457166f }, //Earth
+		{ 1.52371034f, 0.09339410f, 1.84969142f, 49.55953891f, -23.94362959f, -4.55343205f }, //Mars
+		{ 5.20288700f, 0.04838624f, 1.30439695f, 100.47390909f, 14.72847983f, 34.39644051f }, //Jupiter
+		{ 9.53667594f, 0.05386179f, 2.48599187f, 113.66242448f, 92.59887831f, 49.95424423f }, //Saturn
+		{ 19.18916464f, 0.04725744f, 0.77263783f, 74.01692503f, 170.95427630f, 313.23810451f }, //Uranus
+		{ 30.06992276f, 0.00859048f, 1.77004347f, 131.78422574f, 44.96476227f, -55.12002969f } //Neptune
+	};
+
+	g_bodies.clear();
+	g_planet_orbits.clear();
+	g_sw_textures.assign(g_cpu_scene ? names.size() : 0, SwTexture());
+	g_planet_orbits.units_per_au = g_units_per_au;
+
+	for (int i = 0; i < (int)names.size(); i++) {
+		size_t body = g_bodies.add(names[i], type[i], scales[i]);
 
 		GLuint texture_id = 0;
 		Image* image;
 
-		if (actualPlanet.name == "Earth") {
+		if (type[i] == BODY_EARTH) {
 
 			image = loadBMP("assets/textures/earth/earthspec.bmp"); //Specular Textura
+			if (g_cpu_scene) swtexture_create(g_sw_earth_spec, image->pixels, image->width, image->height);
 
 			glGenTextures(1, &texture_id);
 			glBindTexture(GL_TEXTURE_2D, texture_id);
@@ -170,9 +471,10 @@ void load()
 				GL_UNSIGNED_BYTE,
 				image->pixels);
 
-			actualPlanet.texture_spec_id = texture_id;
+			g_bodies.texture_spec_id[body] = texture_id;
 
 			image = loadBMP("assets/textures/earth/earthnormal.bmp"); //Normal map 
+			if (g_cpu_scene) swtexture_create(g_sw_earth_normal, image->pixels, image->width, image->height);
 
 			glGenTextures(1, &texture_id);
 			glBindTexture(GL_TEXTURE_2D, texture_id);
@@ -189,9 +491,10 @@ void load()
 				GL_UNSIGNED_BYTE,
 				image->pixels);
 
-			actualPlanet.normal_map_id = texture_id;
+			g_bodies.normal_map_id[body] = texture_id;
 
 			image = loadBMP("assets/textures/earth/2k_earth_nightmap.bmp"); //Night Earth texture
+			if (g_cpu_scene) swtexture_create(g_sw_earth_night, image->pixels, image->width, image->height);
 
 			glGenTextures(1, &texture_id);
 			glBindTexture(GL_TEXTURE_2D, texture_id);
@@ -208,15 +511,11 @@ void load()
 				GL_UNSIGNED_BYTE,
 				image->pixels);
 
-			actualPlanet.texture_night_id = texture_id;
-		}
-		else {
-			actualPlanet.texture_spec_id = 0;
-			actualPlanet.normal_map_id = 0;
-			actualPlanet.texture_night_id = 0;
+			g_bodies.texture_night_id[body] = texture_id;
 		}
 
 		image = loadBMP(textures[i]);
+		if (g_cpu_scene) swtexture_create(g_sw_textures[body], image->pixels, image->width, image->height);
 
 		glGenTextures(1, &texture_id);
 		glBindTexture(GL_TEXTURE_2D, texture_id);
@@ -234,27 +533,85 @@ void load()
 			image->pixels);
 
 
-		if (i == 0) {
-			actualPlanet.dist_to_sun = 0;
-		}
-		else {
-			actualPlanet.dist_to_sun = 5 * i;
+		if (i > 0) {
+			float* el = elements[i - 1];
+			g_planet_orbits.add(el[0], el[1], radians(el[2]), radians(el[3]), radians(el[4] - el[3]), radians(el[5] - el[4]));
 		}
-		actualPlanet.position = vec3(dist_to_sun0 + actualPlanet.dist_to_sun, 0.0, 0.0);
-		actualPlanet.scale = vec3(scales[i], scales[i], scales[i]);
-		actualPlanet.texture_id = texture_id;
-		actualPlanet.type = type[i];
-		actualPlanet.clouds_rotation = 0;
-		actualPlanet.orbit_speed = (rand() % 50 + 1)/10;
-		actualPlanet.orbit_angle = (rand() % 50 + 1) / 10;
-		actualPlanet.rotacion = 0;
-		bodies.push_back(actualPlanet);
+		g_bodies.texture_id[body] = texture_id;
+	}
+	g_earth = g_bodies.find("Earth");
+
+	//small body sizes and the near plane follow the Earth's radius (1 unit in the toy scale);
+	//reversed-Z float depth keeps full precision from the near plane to any distance
+	float body_unit = g_bodies.scale[g_earth];
+	g_near_plane = 0.1f * body_unit;
+	updateProjection();
+
+	//Asteroid belt
+	g_asteroid_orbits.clear();
+	g_asteroid_orbits.units_per_au = g_units_per_au;
+	orbit_generate_belt(g_asteroid_orbits, g_NumAsteroids, 42);
+
+	//GPU belt: elements are uploaded once and never touched again by the CPU.
+	//Filled from a minor planet catalog when one is given, synthetic otherwise.
+	OrbitSet belt_orbits;
+	belt_orbits.units_per_au = g_units_per_au;
+	CatalogStats catalog_stats;
+	if (g_catalog_path && catalog_load(g_catalog_path, belt_orbits, g_catalog_limit, &catalog_stats)) {
+		cout << "Catalog " << g_catalog_path << ": " << catalog_stats.records << " bodies in " << catalog_stats.load_ms << " ms"
+			<< (catalog_stats.from_cache ? " (cache)" : "") << ", " << catalog_stats.skipped << " lines skipped" << endl;
+	}
+	else {
+		orbit_generate_belt(belt_orbits, g_NumBeltBodies, 99);
 	}
+	belt_create(g_belt, g_beltShader, belt_orbits, 0.05f * body_unit, 0.2f * body_unit);
+
+	//Protoplanetary disk
+	g_nbody = NBodySystem();
+	g_nbody.theta = g_nbody_theta;
+	g_nbody.num_threads = jobs_num_threads();
+	nbody_generate_disk(g_nbody, g_NumParticles, 1.0f, 5.0f, 1e-3f, 7);
+	nbody_init(g_nbody);
+
+	g_instance_transforms.resize(g_NumAsteroids + g_NumParticles);
+	g_instance_radius.resize(g_NumAsteroids + g_NumParticles);
+	for (int i = 0; i < g_NumAsteroids + g_NumParticles; i++) {
+		float size = (i < g_NumAsteroids ? 0.05f + 0.15f * (rand() / (float)RAND_MAX) : 0.05f) * body_unit;
+		g_instance_transforms[i] = scale(mat4(1.0f), vec3(size, size, size));
+		g_instance_radius[i] = size;
+	}
+	if (gpucull_supported()) {
+		gpucull_create(g_gpu_cull, g_cullProgram, g_compactProgram, g_instancedShader, g_impostorShader, (int)g_instance_transforms.size());
+		g_gpu_cull.lod_pixels = 4.0f * g_impostor_pixels;
+	}
+	streambuffer_create(g_stream, g_instance_transforms.size() * sizeof(mat4) + STREAM_BUFFER_HEADROOM);
+	cout << "Stream buffer: " << STREAM_BUFFER_FRAMES << " x " << g_stream.region_size / 1024 << " KB, "
+		<< (g_stream.mapped ? "persistently mapped" : "glBufferSubData") << endl;
+	glGenBuffers(1, &g_eclipse_fallback_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, g_eclipse_fallback_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(EclipseUniforms), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	g_collisions = CollisionSystem();
+	g_collisions.approach_distance = g_approach_radii * body_unit;
 
 	Image* image = loadBMP("assets/textures/milkyway.bmp"); //Skybox
 
-	glGenTextures(1, &texture_skybox_id);
-	glBindTexture(GL_TEXTURE_2D, texture_skybox_id);
+	//resampled once into a mipmapped cube map on the workers
+	GLint max_cube_size;
+	glGetIntegerv(GL_MAX_CUBE_MAP_TEXTURE_SIZE, &max_cube_size);
+	SkyboxFaces sky_faces;
+	skybox_convert((const unsigned char*)image->pixels, image->width, image->height,
+		skybox_face_size(image->width, std::min((int)max_cube_size, SKYBOX_MAX_FACE_SIZE)), sky_faces);
+	if (texture_skybox_id) glDeleteTextures(1, &texture_skybox_id);
+	texture_skybox_id = skybox_create_cubemap(sky_faces);
+	cout << "Skybox: " << image->width << "x" << image->height << " map to 6 x " << sky_faces.size << "^2 cube faces in "
+		<< sky_faces.convert_ms << " ms" << endl;
+
+	image = loadBMP("assets/textures/moonmap.bmp"); //Asteroids
+	if (g_cpu_scene) swtexture_create(g_sw_asteroid, image->pixels, image->width, image->height);
+
+	glGenTextures(1, &texture_asteroid_id);
+	glBindTexture(GL_TEXTURE_2D, texture_asteroid_id);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
@@ -288,10 +645,136 @@ void load()
 }
 
 
+// ------------------------------------------------------------------------------------------
+// This function sets the eclipse uniforms of a lit shader: the sun's radius and the bodies
+// that may shadow 'body' (none for -1), moved into the shader's space by 'to_space'
+// ------------------------------------------------------------------------------------------
+void setEclipseUniforms(GLuint program, int body, const mat4& to_space) {
+	GLuint light_radius_loc = glGetUniformLocation(program, "u_light_radius");
+	glUniform1f(light_radius_loc, g_bodies.scale[0]);
+
+	int count = 0;
+	vec4 spheres[ECLIPSE_MAX_OCCLUDERS];
+	if (g_eclipses && body >= 0 && body < (int)g_eclipse_occluders.size()) {
+		const EclipseOccluders& occluders = g_eclipse_occluders[body];
+		for (count = 0; count < occluders.count; count++) {
+			vec4 sphere = occluders.spheres[count];
+			spheres[count] = vec4(vec3(to_space * vec4(vec3(sphere), 1.0f)), sphere.w);
+		}
+	}
+
+	//a fresh block per draw; if the ring is full (it grows next frame) the block goes into the
+	//fallback buffer instead, the driver orders that copy after the draws still reading it
+	EclipseUniforms block = {};
+	for (int i = 0; i < count; i++) block.occluders[i] = spheres[i];
+	block.count = count;
+	GLintptr offset = streambuffer_upload(g_stream, &block, sizeof(block), g_stream.uniform_alignment);
+	if (offset >= 0) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, ECLIPSE_UNIFORM_BINDING, g_stream.buffer, offset, sizeof(block));
+	}
+	else {
+		glBindBuffer(GL_UNIFORM_BUFFER, g_eclipse_fallback_ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+		glBindBufferBase(GL_UNIFORM_BUFFER, ECLIPSE_UNIFORM_BINDING, g_eclipse_fallback_ubo);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// This function draw the atmosphere shell of a body: a sphere around it whose fragments look
+// up the light scattered along the view ray and the transmittance through it, added to and
+// multiplied with what is already drawn
+// ------------------------------------------------------------------------------------------
+void drawAtmosphere(int body, vec3 position) {
+	if (!g_atmosphere_enabled || !g_atmosphere.scattering_texture) return;
+	if (g_overdraw_mode) return; //its blend state would break the count
+
+	const AtmosphereParams& params = g_atmosphere_params;
+	float km_per_unit = params.bottom_radius / g_bodies.scale[body];
+	float shell = params.top_radius / km_per_unit;
+	bool inside = length(eye - position) < shell;
+
+	//from inside, the far side of the shell covers the view; outside, the near side in front
+	//of the planet. Rays that miss the real shell are discarded, so it can be a bit larger
+	//than the top of the atmosphere to hide the mesh's facets
+	glEnable(GL_CULL_FACE);
+	glCullFace(inside ? GL_FRONT : GL_BACK);
+	if (inside) glDisable(GL_DEPTH_TEST);
+	else glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+	glUseProgram(g_atmosphereShader);
+
+	GLuint projection_loc = glGetUniformLocation(g_atmosphereShader, "u_projection");
+	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
+
+	GLuint view_loc = glGetUniformLocation(g_atmosphereShader, "u_view");
+	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
+
+	GLuint model_loc = glGetUniformLocation(g_atmosphereShader, "u_model");
+	mat4 model = scale(translate(mat4(1.0f), position), vec3(shell * 1.02f));
+	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
+
+	GLuint u_normal_matrix = glGetUniformLocation(g_atmosphereShader, "u_normal_matrix");
+	mat3 normal_matrix = inverseTranspose((mat3(model)));
+	glUniformMatrix3fv(u_normal_matrix, 1, GL_FALSE, glm::value_ptr(normal_matrix));
+
+	GLuint eye_loc = glGetUniformLocation(g_atmosphereShader, "u_eye");
+	glUniform3f(eye_loc, eye.x, eye.y, eye.z);
+
+	GLuint center_loc = glGetUniformLocation(g_atmosphereShader, "u_center");
+	glUniform3f(center_loc, position.x, position.y, position.z);
+
+	GLuint km_loc = glGetUniformLocation(g_atmosphereShader, "u_km_per_unit");
+	glUniform1f(km_loc, km_per_unit);
+
+	vec3 sun_dir = normalize(g_light_pos - position);
+	GLuint sun_dir_loc = glGetUniformLocation(g_atmosphereShader, "u_sun_dir");
+	glUniform3f(sun_dir_loc, sun_dir.x, sun_dir.y, sun_dir.z);
+
+	GLuint sun_intensity_loc = glGetUniformLocation(g_atmosphereShader, "u_sun_intensity");
+	glUniform1f(sun_intensity_loc, g_atmosphere_intensity);
+
+	glUniform1f(glGetUniformLocation(g_atmosphereShader, "u_bottom_radius"), params.bottom_radius);
+	glUniform1f(glGetUniformLocation(g_atmosphereShader, "u_top_radius"), params.top_radius);
+	glUniform3fv(glGetUniformLocation(g_atmosphereShader, "u_rayleigh_scattering"), 1, params.rayleigh_scattering);
+	glUniform1f(glGetUniformLocation(g_atmosphereShader, "u_mie_scattering"), params.mie_scattering);
+	glUniform1f(glGetUniformLocation(g_atmosphereShader, "u_mie_g"), params.mie_g);
+	glUniform1f(glGetUniformLocation(g_atmosphereShader, "u_mu_s_min"), params.mu_s_min);
+
+	GLuint u_transmittance = glGetUniformLocation(g_atmosphereShader, "u_transmittance");
+	glUniform1i(u_transmittance, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, g_atmosphere.transmittance_texture);
+
+	GLuint u_scattering = glGetUniformLocation(g_atmosphereShader, "u_scattering");
+	glUniform1i(u_scattering, 1);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_3D, g_atmosphere.scattering_texture);
+
+	//bind the geometry
+	gl_bindVAO(g_Vao);
+
+	// Draw to screen
+	glDrawElements(GL_TRIANGLES, 3 * g_NumTriangles, GL_UNSIGNED_INT, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glCullFace(GL_BACK);
+}
+
 // ------------------------------------------------------------------------------------------
 // This function draw the Earth
 // ------------------------------------------------------------------------------------------
-void drawEarth(bodie Earth) {
+void drawEarth(int body) {
+	vec3 position = renderPosition(body);
+	vec3 body_scale(g_bodies.scale[body]);
+
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
@@ -306,9 +789,9 @@ void drawEarth(bodie Earth) {
 	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
 	GLuint model_loc = glGetUniformLocation(g_phongEarthShader, "u_model");
-	mat4 model = translate(scale(mat4(1.0f), Earth.scale), Earth.position);
+	mat4 model = scale(translate(mat4(1.0f), position), body_scale);
 	model = glm::rotate(model, 10.0f, vec3(0.0f, 0.0f, 1.0f));
-	model = glm::rotate(model, Earth.rotacion, vec3(0.3f, 1.0f, 0.0f));
+	model = glm::rotate(model, g_bodies.rotation[body], vec3(0.3f, 1.0f, 0.0f));
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
 
 	GLuint u_normal_matrix = glGetUniformLocation(g_phongEarthShader, "u_normal_matrix");
@@ -316,7 +799,12 @@ void drawEarth(bodie Earth) {
 	glUniformMatrix3fv(u_normal_matrix, 1, GL_FALSE, glm::value_ptr(normal_matrix));
 
 	GLuint light_dir_loc = glGetUniformLocation(g_phongEarthShader, "u_light_dir");
-	glUniform3f(light_dir_loc, g_light_dir.x - Earth.position.x, g_light_dir.y - Earth.position.y, g_light_dir.z - Earth.position.z);
+	glUniform3f(light_dir_loc, g_light_pos.x - position.x, g_light_pos.y - position.y, g_light_pos.z - position.z);
+
+	GLuint light_pos_loc = glGetUniformLocation(g_phongEarthShader, "u_light_pos");
+	glUniform3f(light_pos_loc, g_light_pos.x, g_light_pos.y, g_light_pos.z);
+
+	setEclipseUniforms(g_phongEarthShader, body, mat4(1.0f));
 
 	GLuint light_color_loc = glGetUniformLocation(g_phongEarthShader, "u_light_color");
 	glUniform3f(light_color_loc, 0.99, 0.70, 0.21);
@@ -334,25 +822,37 @@ void drawEarth(bodie Earth) {
 	glUniform1i(u_texture, 0);
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, Earth.texture_id);
+	glBindTexture(GL_TEXTURE_2D, g_bodies.texture_id[body]);
 
 	GLuint u_texture_spec = glGetUniformLocation(g_phongEarthShader, "u_texture_spec");
 	glUniform1i(u_texture_spec, 1);
 
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, Earth.texture_spec_id);
+	glBindTexture(GL_TEXTURE_2D, g_bodies.texture_spec_id[body]);
 
 	GLuint u_normal_map = glGetUniformLocation(g_phongEarthShader, "u_normal_map");
 	glUniform1i(u_normal_map, 2);
 
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, Earth.normal_map_id);
+	glBindTexture(GL_TEXTURE_2D, g_bodies.normal_map_id[body]);
 
 	GLuint u_texture_night = glGetUniformLocation(g_phongEarthShader, "u_texture_night");
 	glUniform1i(u_texture_night, 3);
 
 	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, Earth.texture_night_id);
+	glBindTexture(GL_TEXTURE_2D, g_bodies.texture_night_id[body]);
+
+	//light from the sky on the day side, from the atmosphere's irradiance table
+	GLuint u_irradiance = glGetUniformLocation(g_phongEarthShader, "u_irradiance");
+	glUniform1i(u_irradiance, 4);
+
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, g_atmosphere.irradiance_texture);
+
+	GLuint sky_intensity_loc = glGetUniformLocation(g_phongEarthShader, "u_sky_intensity");
+	bool sky = g_atmosphere_enabled && g_atmosphere.irradiance_texture;
+	glUniform1f(sky_intensity_loc, sky ? g_atmosphere_intensity / 3.14159265f : 0.0f);
+	glActiveTexture(GL_TEXTURE0);
 
 
 	//bind the geometry
@@ -361,39 +861,47 @@ void drawEarth(bodie Earth) {
 	// Draw to screen
 	glDrawElements(GL_TRIANGLES, 3 * g_NumTriangles, GL_UNSIGNED_INT, 0);
 
+	//scattering over the surface (the clouds come later, with the translucent pass)
+	drawAtmosphere(body, position);
+}
 
-
-	//----------------------
-	//--CLOUDS--------------
-	//----------------------
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+// ------------------------------------------------------------------------------------------
+// This function draw the Earth's clouds, translucent: the blend state is set by the caller
+// ------------------------------------------------------------------------------------------
+void drawClouds(int body) {
+	vec3 position = renderPosition(body);
 
 	glUseProgram(g_transparencyShader);
 
-	projection_loc = glGetUniformLocation(g_transparencyShader, "u_projection");
+	GLuint projection_loc = glGetUniformLocation(g_transparencyShader, "u_projection");
 	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
 
-	view_loc = glGetUniformLocation(g_transparencyShader, "u_view");
+	GLuint view_loc = glGetUniformLocation(g_transparencyShader, "u_view");
 	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
-	model_loc = glGetUniformLocation(g_transparencyShader, "u_model");
-	model = translate(mat4(1.0f), Earth.position);
-	model = glm::scale(model, vec3(1.03f, 1.03f, 1.03f));
-	model = glm::rotate(model, Earth.clouds_rotation, vec3(0.0f, 1.0f, 0.0f));
+	GLuint model_loc = glGetUniformLocation(g_transparencyShader, "u_model");
+	mat4 model = translate(mat4(1.0f), position);
+	model = glm::scale(model, vec3(1.03f * g_bodies.scale[body]));
+	model = glm::rotate(model, g_bodies.clouds_rotation[body], vec3(0.0f, 1.0f, 0.0f));
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
 
 	GLuint u_transparency_loc = glGetUniformLocation(g_transparencyShader, "u_transparency");
 	glUniform1f(u_transparency_loc, 0.3f);
 
-	u_texture = glGetUniformLocation(g_transparencyShader, "u_texture");
+	GLuint depth_unit_loc = glGetUniformLocation(g_transparencyShader, "u_depth_unit");
+	glUniform1f(depth_unit_loc, g_bodies.scale[g_earth]);
+
+	GLuint u_texture = glGetUniformLocation(g_transparencyShader, "u_texture");
 	glUniform1i(u_texture, 0);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, texture_cloud_id);
 
+	//bind the geometry
+	gl_bindVAO(g_Vao);
+
+	// Draw to screen
 	glDrawElements(GL_TRIANGLES, 3 * g_NumTriangles, GL_UNSIGNED_INT, 0);
-	glDisable(GL_BLEND);
 }
 
 
@@ -416,14 +924,16 @@ void drawSun(vec3 position, GLuint texture_id, vec3 bodie_scale) {
 	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
 	GLuint model_loc = glGetUniformLocation(g_simpleShader, "u_model");
-	mat4 trans = translate(mat4(1.0f), vec3(0.0,0.0,0.0));
-	mat4 model = scale(trans, bodie_scale);
+	mat4 model = scale(translate(mat4(1.0f), position), bodie_scale);
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
 
 	GLuint u_normal_matrix = glGetUniformLocation(g_simpleShader, "u_normal_matrix");
 	mat3 normal_matrix = inverseTranspose((mat3(model)));
 	glUniformMatrix3fv(u_normal_matrix, 1, GL_FALSE, glm::value_ptr(normal_matrix));
 
+	GLuint emissive_loc = glGetUniformLocation(g_simpleShader, "u_emissive");
+	glUniform1f(emissive_loc, g_sun_emissive);
+
 	GLuint u_texture = glGetUniformLocation(g_simpleShader, "u_texture");
 	glUniform1i(u_texture, 0);
 
@@ -441,7 +951,7 @@ void drawSun(vec3 position, GLuint texture_id, vec3 bodie_scale) {
 // ------------------------------------------------------------------------------------------
 // This function draw the rest of the planets
 // ------------------------------------------------------------------------------------------
-void drawPlanet(vec3 position, GLuint texture_id, vec3 bodie_scale)
+void drawPlanet(vec3 position, GLuint texture_id, vec3 bodie_scale, int body)
 {
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -457,15 +967,17 @@ void drawPlanet(vec3 position, GLuint texture_id, vec3 bodie_scale)
 	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
 	GLuint model_loc = glGetUniformLocation(g_phongShader, "u_model");
-	mat4 model = translate(scale(mat4(1.0f), bodie_scale), position);
+	mat4 model = scale(translate(mat4(1.0f), position), bodie_scale);
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model)); 
 
 	GLuint u_normal_matrix = glGetUniformLocation(g_phongShader, "u_normal_matrix");
 	mat3 normal_matrix = inverseTranspose((mat3(model)));
 	glUniformMatrix3fv(u_normal_matrix, 1, GL_FALSE, glm::value_ptr (normal_matrix));
 
-	GLuint light_dir_loc = glGetUniformLocation(g_phongShader, "u_light_dir");
-	glUniform3f(light_dir_loc, g_light_dir.x - position.x, g_light_dir.y - position.y, g_light_dir.z - position.z);
+	GLuint light_pos_loc = glGetUniformLocation(g_phongShader, "u_light_pos");
+	glUniform3f(light_pos_loc, g_light_pos.x, g_light_pos.y, g_light_pos.z);
+
+	setEclipseUniforms(g_phongShader, body, mat4(1.0f));
 
 	GLuint light_color_loc = glGetUniformLocation(g_phongShader, "u_light_color");
 	glUniform3f(light_color_loc, 1.0, 1.0, 1.0);
@@ -494,44 +1006,688 @@ void drawPlanet(vec3 position, GLuint texture_id, vec3 bodie_scale)
 }
 
 // ------------------------------------------------------------------------------------------
-// This function draw the Skybox
+// Pixels per scene unit at distance 1 (viewport height / 2 tan(fov / 2))
 // ------------------------------------------------------------------------------------------
-void drawUniverse()
+float focalPixels() {
+	return g_ViewportHeight / (2.0f * tan(radians(30.0f)));
+}
+
+// ------------------------------------------------------------------------------------------
+// This function decides if a body is drawn as an impostor instead of a mesh
+// ------------------------------------------------------------------------------------------
+bool useImpostor(vec3 position, float radius) {
+	if (g_impostor_mode == 0) return false;
+	if (g_impostor_mode == 2) return true;
+	return radius / length(position - eye) * focalPixels() < g_impostor_pixels;
+}
+
+// ------------------------------------------------------------------------------------------
+// This function activates the impostor shader and sets the uniforms shared by all impostors
+// ------------------------------------------------------------------------------------------
+void useImpostorShader(GLuint texture_id, bool unlit) {
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	// activate shader
+	glUseProgram(g_impostorShader);
+
+	GLuint projection_loc = glGetUniformLocation(g_impostorShader, "u_projection");
+	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
+
+	GLuint view_loc = glGetUniformLocation(g_impostorShader, "u_view");
+	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
+
+	//impostors are shaded in view space
+	vec3 light_view = vec3(view_matrix * vec4(g_light_pos, 1.0f));
+	GLuint light_pos_loc = glGetUniformLocation(g_impostorShader, "u_light_pos");
+	glUniform3f(light_pos_loc, light_view.x, light_view.y, light_view.z);
+
+	GLuint light_color_loc = glGetUniformLocation(g_impostorShader, "u_light_color");
+	glUniform3f(light_color_loc, 1.0, 1.0, 1.0);
+
+	GLuint ambient_loc = glGetUniformLocation(g_impostorShader, "u_ambient");
+	glUniform3f(ambient_loc, 0.1, 0.1, 0.1);
+
+	GLuint glossiness_loc = glGetUniformLocation(g_impostorShader, "u_glossiness");
+	glUniform1f(glossiness_loc, 50);
+
+	GLuint unlit_loc = glGetUniformLocation(g_impostorShader, "u_unlit");
+	glUniform1i(unlit_loc, unlit ? 1 : 0);
+
+	GLuint emissive_loc = glGetUniformLocation(g_impostorShader, "u_emissive");
+	glUniform1f(emissive_loc, g_sun_emissive);
+
+	//no eclipses by default (instanced small bodies), drawImpostor sets a body's occluders
+	setEclipseUniforms(g_impostorShader, -1, view_matrix);
+
+	GLuint zero_to_one_loc = glGetUniformLocation(g_impostorShader, "u_clip_zero_to_one");
+	glUniform1i(zero_to_one_loc, g_reversed_z ? 1 : 0);
+
+	GLuint u_texture = glGetUniformLocation(g_impostorShader, "u_texture");
+	glUniform1i(u_texture, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+}
+
+// ------------------------------------------------------------------------------------------
+// This function draw a body as a ray-cast sphere impostor (4 vertices)
+// ------------------------------------------------------------------------------------------
+void drawImpostor(const mat4& model, GLuint texture_id, bool unlit, int body)
 {
-	glDisable(GL_DEPTH_TEST);
+	useImpostorShader(texture_id, unlit);
+	if (!unlit) setEclipseUniforms(g_impostorShader, body, view_matrix);
+
+	//a single body: one instance, its matrix in this frame's range of g_stream like the small bodies'
+	GLintptr offset = streambuffer_upload(g_stream, &model, sizeof(mat4), sizeof(mat4));
+	if (offset >= 0) {
+		gl_bindVAO(g_impostorInstancedVao);
+		gl_bindInstanceMat4Attribute(g_stream.buffer, g_impostorShader, "a_model", offset);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, 1);
+		return;
+	}
+
+	//the ring is full: constant attribute values, put back to their default (0, 0, 0, 1) after
+	//the draw since they are context state, not VAO state
+	GLuint model_loc = glGetAttribLocation(g_impostorShader, "a_model");
+	for (int column = 0; column < 4; column++) {
+		glVertexAttrib4fv(model_loc + column, glm::value_ptr(model[column]));
+	}
+	gl_bindVAO(g_impostorVao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	for (int column = 0; column < 4; column++) {
+		glVertexAttrib4f(model_loc + column, 0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// This function activates the instanced Phong shader used by the small bodies' meshes
+// ------------------------------------------------------------------------------------------
+void useInstancedShader()
+{
+	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
+	glCullFace(GL_BACK);
 
 	// activate shader
-	glUseProgram(g_simpleShader);
+	glUseProgram(g_instancedShader);
+	setEclipseUniforms(g_instancedShader, -1, mat4(1.0f)); //no occluders
 
-
-	GLuint projection_loc = glGetUniformLocation(g_simpleShader, "u_projection");
+	GLuint projection_loc = glGetUniformLocation(g_instancedShader, "u_projection");
 	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, glm::value_ptr(projection_matrix));
 
-	GLuint view_loc = glGetUniformLocation(g_simpleShader, "u_view");
+	GLuint view_loc = glGetUniformLocation(g_instancedShader, "u_view");
 	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 
-	GLuint model_loc = glGetUniformLocation(g_simpleShader, "u_model");
-	mat4 trans = translate(mat4(1.0f), eye);
-	mat4 model = scale(trans, vec3(30.0f, 30.0f, 30.0f));
-	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
+	GLuint light_pos_loc = glGetUniformLocation(g_instancedShader, "u_light_pos");
+	glUniform3f(light_pos_loc, g_light_pos.x, g_light_pos.y, g_light_pos.z);
 
-	GLuint u_normal_matrix = glGetUniformLocation(g_simpleShader, "u_normal_matrix");
-	mat3 normal_matrix = inverseTranspose((mat3(model)));
-	glUniformMatrix3fv(u_normal_matrix, 1, GL_FALSE, glm::value_ptr(normal_matrix));
+	GLuint light_color_loc = glGetUniformLocation(g_instancedShader, "u_light_color");
+	glUniform3f(light_color_loc, 1.0, 1.0, 1.0);
 
-	GLuint u_texture = glGetUniformLocation(g_simpleShader, "u_texture");
+	GLuint eye_loc = glGetUniformLocation(g_instancedShader, "u_eye");
+	glUniform3f(eye_loc, eye.x, eye.y, eye.z);
+
+	GLuint ambient_loc = glGetUniformLocation(g_instancedShader, "u_ambient");
+	glUniform3f(ambient_loc, 0.1, 0.1, 0.1);
+
+	GLuint glossiness_loc = glGetUniformLocation(g_instancedShader, "u_glossiness");
+	glUniform1f(glossiness_loc, 50);
+
+	GLuint u_texture = glGetUniformLocation(g_instancedShader, "u_texture");
 	glUniform1i(u_texture, 0);
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_skybox_id);
+	glBindTexture(GL_TEXTURE_2D, texture_asteroid_id);
+}
 
-	//bind the geometry
-	gl_bindVAO(g_Vao);
+// ------------------------------------------------------------------------------------------
+// This function draw the asteroids and N-body particles in a single instanced call, or on
+// the GPU path in two indirect calls (impostors, then both mesh LODs)
+// ------------------------------------------------------------------------------------------
+void drawSmallBodies()
+{
+	double submit_start = wallSeconds();
+	if (g_gpu_culling) {
+		if (g_gpu_cull.count > 0) {
+			useImpostorShader(texture_asteroid_id, false);
+			gpucull_draw_impostors(g_gpu_cull);
+			useInstancedShader();
+			gpucull_draw_meshes(g_gpu_cull);
+		}
+		g_small_bodies_cpu_ms += (wallSeconds() - submit_start) * 1000.0;
+		g_small_bodies_frames++;
+		return;
+	}
 
-	// Draw to screen
-	glDrawElements(GL_TRIANGLES, 3 * g_NumTriangles, GL_UNSIGNED_INT, 0);
+	int count = g_visible_transforms.size();
+	GLintptr offset = -1;
+	//this frame's visible instance matrices, skipped for a frame if they do not fit
+	if (count > 0) offset = streambuffer_upload(g_stream, &g_visible_transforms[0], count * sizeof(mat4), sizeof(mat4));
+	if (offset >= 0) {
+		//small bodies are a few pixels wide: one impostor quad each
+		if (g_impostor_mode != 0) {
+			useImpostorShader(texture_asteroid_id, false);
+			gl_bindVAO(g_impostorInstancedVao);
+			gl_bindInstanceMat4Attribute(g_stream.buffer, g_impostorShader, "a_model", offset);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+		}
+		else {
+			useInstancedShader();
+
+			//bind the geometry
+			gl_bindVAO(g_instanceVao);
+			gl_bindInstanceMat4Attribute(g_stream.buffer, g_instancedShader, "a_model", offset);
+
+			// Draw to screen
+			glDrawElementsInstanced(GL_TRIANGLES, 3 * g_NumTriangles, GL_UNSIGNED_INT, 0, count);
+		}
+	}
+	g_small_bodies_cpu_ms += (wallSeconds() - submit_start) * 1000.0;
+	g_small_bodies_frames++;
+}
+
+// ------------------------------------------------------------------------------------------
+// This function draw the Skybox, after the opaque bodies: one triangle at the far plane
+// passing the depth test only where nothing was drawn, so covered pixels are never shaded
+// ------------------------------------------------------------------------------------------
+void drawUniverse()
+{
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(g_reversed_z ? GL_GEQUAL : GL_LEQUAL); //equal to the cleared far depth
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+
+	// activate shader
+	glUseProgram(g_skyShader);
+
+	GLuint inverse_loc = glGetUniformLocation(g_skyShader, "u_inverse_view_projection");
+	mat4 inverse_view_projection = inverse(projection_matrix * view_matrix);
+	glUniformMatrix4fv(inverse_loc, 1, GL_FALSE, glm::value_ptr(inverse_view_projection));
+
+	GLuint near_loc = glGetUniformLocation(g_skyShader, "u_near_depth");
+	glUniform1f(near_loc, g_reversed_z ? 1.0f : -1.0f);
+
+	GLuint far_loc = glGetUniformLocation(g_skyShader, "u_far_depth");
+	glUniform1f(far_loc, g_reversed_z ? 0.0f : 1.0f);
+
+	GLuint u_texture = glGetUniformLocation(g_skyShader, "u_texture");
+	glUniform1i(u_texture, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_skybox_id);
+
+	gl_bindVAO(g_fullscreenVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_unbindVAO();
+
+	glDepthMask(GL_TRUE);
+	glDepthFunc(g_reversed_z ? GL_GREATER : GL_LESS);
+	glEnable(GL_CULL_FACE);
+}
+
+// ------------------------------------------------------------------------------------------
+// This function shows the overdraw count as a heat map in the window and reports the
+// average number of fragments per pixel about once a second. The average is the alpha of
+// the 1x1 mip level (the box filter drops odd edge rows, close enough for a debug figure).
+// ------------------------------------------------------------------------------------------
+void showOverdraw(GLuint counts, int levels)
+{
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, counts);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	GLfloat average[4];
+	glGetTexImage(GL_TEXTURE_2D, levels - 1, GL_RGBA, GL_FLOAT, average);
+	g_overdraw_sum += average[3];
+	g_overdraw_frames++;
+
+	double now = wallSeconds();
+	if (now - g_overdraw_report_time >= 1.0) {
+		cout << "Overdraw: " << g_overdraw_sum / g_overdraw_frames << " fragments per pixel (" << g_overdraw_frames << " frames)" << endl;
+		g_overdraw_sum = 0.0;
+		g_overdraw_frames = 0;
+		g_overdraw_report_time = now;
+	}
+
+	glUseProgram(g_overdrawShader);
+	GLuint counts_loc = glGetUniformLocation(g_overdrawShader, "u_counts");
+	glUniform1i(counts_loc, 0);
+	gl_bindVAO(g_fullscreenVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_unbindVAO();
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+}
+
+// ------------------------------------------------------------------------------------------
+// This function draw everything translucent, in any order: the blend state and the OIT
+// targets are set up by the frame graph's translucent pass
+// ------------------------------------------------------------------------------------------
+void drawTranslucent()
+{
+	for (int i = 0; i < (int)g_bodies.size(); i++) {
+		if (g_bodies.type[i] != BODY_EARTH || useImpostor(renderPosition(i), g_bodies.scale[i])) continue;
+		drawClouds(i);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// This function draw every opaque body: planets (or their impostors), the small bodies and
+// the belt. The sky comes after, where none of them was drawn.
+// ------------------------------------------------------------------------------------------
+void drawOpaque()
+{
+	for (int i = 0; i < (int)g_bodies.size(); i++) {
+		vec3 position = renderPosition(i);
+		vec3 body_scale(g_bodies.scale[i]);
+
+		if (useImpostor(position, g_bodies.scale[i])) {
+			drawImpostor(scale(translate(mat4(1.0f), position), body_scale), g_bodies.texture_id[i], g_bodies.type[i] == BODY_SUN, i);
+			continue;
+		}
+
+		switch (g_bodies.type[i]) {
+		case BODY_SUN: drawSun(position, g_bodies.texture_id[i], body_scale); break;
+		case BODY_EARTH: drawEarth(i); break;
+		default: drawPlanet(position, g_bodies.texture_id[i], body_scale, i);
+		}
+	}
+	drawSmallBodies();
+	//the belt is evaluated in world space on the GPU, so it gets the camera translation back
+	belt_draw(g_belt, g_beltShader, g_render_time, projection_matrix, translate(view_matrix, -vec3(g_camera_pos)),
+		vec3(g_bodies.pos_x[0], g_bodies.pos_y[0], g_bodies.pos_z[0]), focalPixels(), g_belt_rocks);
+}
+
+// ------------------------------------------------------------------------------------------
+// The Earth's tilt and spin as drawEarth() applies them, identity for the other bodies
+// ------------------------------------------------------------------------------------------
+mat4 bodyRotation(int body)
+{
+	if (g_bodies.type[body] != BODY_EARTH) return mat4(1.0f);
+	mat4 rotation = glm::rotate(mat4(1.0f), 10.0f, vec3(0.0f, 0.0f, 1.0f));
+	return glm::rotate(rotation, g_bodies.rotation[body], vec3(0.3f, 1.0f, 0.0f));
+}
+
+// ------------------------------------------------------------------------------------------
+// The uniforms drawSun(), drawEarth() and drawPlanet() set, for the CPU renderers
+// ------------------------------------------------------------------------------------------
+SwMaterial bodyMaterial(int body)
+{
+	SwMaterial material;
+	material.texture = &g_sw_textures[body];
+	material.light_pos = g_light_pos;
+	material.eye = eye;
+	material.light_radius = g_bodies.scale[0];
+	if (g_eclipses && body < (int)g_eclipse_occluders.size()) material.occluders = g_eclipse_occluders[body];
+
+	switch (g_bodies.type[body]) {
+	case BODY_SUN:
+		material.shader = SW_SHADER_SIMPLE;
+		material.emissive = g_sun_emissive;
+		break;
+	case BODY_EARTH:
+		material.shader = SW_SHADER_PHONG_EARTH;
+		material.spec = &g_sw_earth_spec;
+		material.normal_map = &g_sw_earth_normal;
+		material.night = &g_sw_earth_night;
+		material.light_dir = g_light_pos - renderPosition(body);
+		material.light_color = vec3(0.99f, 0.70f, 0.21f);
+		break;
+	default:
+		material.shader = SW_SHADER_PHONG;
+	}
+	return material;
+}
+
+// ------------------------------------------------------------------------------------------
+// This function draws the frame with the software rasterizer: the bodies with the CPU
+// equivalents of their shaders, the visible small bodies as meshes, tonemapped on the
+// workers and blitted into the pass target. No sky, atmosphere, clouds or bloom.
+// ------------------------------------------------------------------------------------------
+void drawSoftware()
+{
+	int width = g_FramebufferWidth, height = g_FramebufferHeight;
+	SwRaster& raster = g_sw_raster;
+	swraster_resize(raster, width, height);
+	swraster_begin(raster, projection_matrix, view_matrix, g_reversed_z, vec3(0.0f), g_bloom.exposure);
+
+	for (int i = 0; i < (int)g_bodies.size(); i++) {
+		mat4 model = scale(translate(mat4(1.0f), renderPosition(i)), vec3(g_bodies.scale[i])) * bodyRotation(i);
+		swraster_draw(raster, g_sw_sphere, model, swraster_material(raster, bodyMaterial(i)));
+	}
+
+	SwMaterial rock;
+	rock.texture = &g_sw_asteroid;
+	rock.light_pos = g_light_pos;
+	rock.eye = eye;
+	int rock_material = swraster_material(raster, rock);
+	for (size_t i = 0; i < g_visible_transforms.size(); i++) swraster_draw(raster, g_sw_sphere, g_visible_transforms[i], rock_material);
+
+	swraster_end(raster);
+
+	//the pass has its target bound for drawing, the output is read from a framebuffer of its own
+	if (!g_sw_texture) {
+		glGenTextures(1, &g_sw_texture);
+		glGenFramebuffers(1, &g_sw_fbo);
+	}
+	glBindTexture(GL_TEXTURE_2D, g_sw_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &raster.output[0]);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, g_sw_fbo);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_sw_texture, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// ------------------------------------------------------------------------------------------
+// This function builds this frame's graph, compiles and runs it:
+//   opaque (+ sky) -> HDR colour and depth
+//   translucent -> OIT accumulation and weights, testing against the depth
+//   composite -> OIT layers over the HDR colour
+//   bloom down/up -> the bloom chain, from the HDR colour
+//   tonemap -> the window
+// or, in overdraw mode, opaque (+ sky) counting fragments -> counts, then the heat map
+// into the window, or with --software a single pass drawing into the window on the CPU.
+// Whatever the window does not end up needing is culled.
+// ------------------------------------------------------------------------------------------
+void renderFrame()
+{
+	FrameGraph& graph = g_frameGraph;
+	framegraph_reset(graph);
+	int width = g_FramebufferWidth, height = g_FramebufferHeight;
+	const GLfloat black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat far_depth[4] = { g_reversed_z ? 0.0f : 1.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat accumulation_clear[4] = OIT_ACCUMULATION_CLEAR;
+
+	//the window, or the frame to read back
+	FrameGraphResource window = g_output_texture ?
+		framegraph_import_texture(graph, "output", g_output_texture, FrameGraphTextureDesc(width, height, GL_RGBA8)) :
+		framegraph_import_window(graph, "window", width, height);
+	FrameGraphResource depth = framegraph_create_texture(graph, "depth", FrameGraphTextureDesc(width, height, GL_DEPTH_COMPONENT32F));
+
+	if (g_software) {
+		int software_pass = framegraph_add_pass(graph, "software", [](const FrameGraph&) {
+			drawSoftware();
+		});
+		framegraph_write(graph, software_pass, window);
+	}
+	else if (g_overdraw_mode) {
+		//every fragment adds 1 to alpha, whatever the shader writes
+		int levels = 1;
+		while ((width >> levels) > 0 || (height >> levels) > 0) levels++;
+		FrameGraphResource counts = framegraph_create_texture(graph, "overdraw", FrameGraphTextureDesc(width, height, GL_RGBA16F, levels));
+
+		int count_pass = framegraph_add_pass(graph, "overdraw count", [](const FrameGraph&) {
+			glEnable(GL_BLEND);
+			glBlendFuncSeparate(GL_ZERO, GL_ONE, GL_ONE, GL_ONE);
+			drawOpaque();
+			drawUniverse();
+			glDisable(GL_BLEND);
+		});
+		framegraph_write(graph, count_pass, counts, black);
+		framegraph_write(graph, count_pass, depth, far_depth);
+
+		int show_pass = framegraph_add_pass(graph, "overdraw view", [counts, levels](const FrameGraph& g) {
+			showOverdraw(framegraph_texture(g, counts), levels);
+		});
+		framegraph_read(graph, show_pass, counts);
+		framegraph_write(graph, show_pass, window, black);
+	}
+	else {
+		FrameGraphResource color = framegraph_create_texture(graph, "hdr", FrameGraphTextureDesc(width, height, GL_RGBA16F));
+		FrameGraphResource accumulation = framegraph_create_texture(graph, "oit accumulation", FrameGraphTextureDesc(width, height, GL_RGBA16F));
+		FrameGraphResource weights = framegraph_create_texture(graph, "oit weights", FrameGraphTextureDesc(width, height, GL_R16F));
+
+		int opaque_pass = framegraph_add_pass(graph, "opaque", [](const FrameGraph&) {
+			drawOpaque();
+			drawUniverse();
+		});
+		framegraph_write(graph, opaque_pass, color, black);
+		framegraph_write(graph, opaque_pass, depth, far_depth);
+
+		int translucent_pass = framegraph_add_pass(graph, "translucent", [](const FrameGraph&) {
+			oit_begin();
+			drawTranslucent();
+			glDisable(GL_BLEND);
+			glDepthMask(GL_TRUE);
+			glEnable(GL_CULL_FACE);
+		});
+		framegraph_write(graph, translucent_pass, accumulation, accumulation_clear);
+		framegraph_write(graph, translucent_pass, weights, black);
+		framegraph_write(graph, translucent_pass, depth); //tested, not written
+
+		int composite_pass = framegraph_add_pass(graph, "oit composite", [accumulation, weights](const FrameGraph& g) {
+			oit_composite(g_oit, g_oitCompositeShader, framegraph_texture(g, accumulation), framegraph_texture(g, weights));
+		});
+		framegraph_read(graph, composite_pass, accumulation);
+		framegraph_read(graph, composite_pass, weights);
+		framegraph_write(graph, composite_pass, color);
+
+		//bloom chain: level 0 from the scene through the threshold, each level from the one
+		//above, then back up adding each level into the one above
+		FrameGraphResource levels[BLOOM_MAX_LEVELS];
+		for (int level = 0; level < g_bloom.levels; level++) {
+			levels[level] = framegraph_create_texture(graph, "bloom",
+				FrameGraphTextureDesc(g_bloom.widths[level], g_bloom.heights[level], GL_RGBA16F));
+		}
+		for (int level = 0; level < g_bloom.levels; level++) {
+			FrameGraphResource source = level == 0 ? color : levels[level - 1];
+			int source_width = level == 0 ? width : g_bloom.widths[level - 1];
+			int source_height = level == 0 ? height : g_bloom.heights[level - 1];
+			int pass = framegraph_add_pass(graph, "bloom down", [source, source_width, source_height, level](const FrameGraph& g) {
+				bloom_downsample(g_bloom, g_bloomDownShader, framegraph_texture(g, source), source_width, source_height, level == 0);
+			});
+			framegraph_read(graph, pass, source);
+			framegraph_write(graph, pass, levels[level], black);
+		}
+		for (int level = g_bloom.levels - 1; level > 0; level--) {
+			FrameGraphResource source = levels[level];
+			int pass = framegraph_add_pass(graph, "bloom up", [source, level](const FrameGraph& g) {
+				bloom_upsample(g_bloom, g_bloomUpShader, framegraph_texture(g, source), g_bloom.widths[level], g_bloom.heights[level]);
+			});
+			framegraph_read(graph, pass, source);
+			framegraph_write(graph, pass, levels[level - 1]);
+		}
+
+		//with bloom off nothing reads the chain, and its passes are culled
+		bool bloom = g_bloom_enabled && g_bloom.levels > 0;
+		FrameGraphResource bloom_result = bloom ? levels[0] : -1;
+		int tonemap_pass = framegraph_add_pass(graph, "tonemap", [color, bloom_result](const FrameGraph& g) {
+			bloom_tonemap(g_bloom, g_tonemapShader, framegraph_texture(g, color), bloom_result >= 0 ? framegraph_texture(g, bloom_result) : 0);
+		});
+		framegraph_read(graph, tonemap_pass, color);
+		if (bloom) framegraph_read(graph, tonemap_pass, bloom_result);
+		framegraph_write(graph, tonemap_pass, window);
+	}
+
+	framegraph_compile(graph);
+	const FrameGraphStats& stats = graph.stats;
+	if (stats.passes != g_frame_graph_reported.passes || stats.culled_passes != g_frame_graph_reported.culled_passes ||
+		stats.texture_bytes != g_frame_graph_reported.texture_bytes || stats.pool_bytes != g_frame_graph_reported.pool_bytes) {
+		framegraph_print(graph);
+		g_frame_graph_reported = stats;
+	}
+	framegraph_execute(graph);
+}
+
+// ------------------------------------------------------------------------------------------
+// One fixed simulation tick, run on the simulation thread. Advances the state it owns
+// (g_sim_state, orbits, N-body) and copies the result into 'out' for publishing.
+// ------------------------------------------------------------------------------------------
+void simulate(SimSnapshot& out) {
+	SimSnapshot& state = g_sim_state;
+	g_sim_time += g_days_per_tick;
+	state.tick++;
+	state.time = g_sim_time;
+
+	//asteroid chunks run on the workers while this thread does the rest
+	JobCounter asteroids;
+	for (int begin = 0; begin < g_NumAsteroids; begin += ASTEROID_JOB_SIZE) {
+		int end = std::min(g_NumAsteroids, begin + ASTEROID_JOB_SIZE);
+		jobs_run([&state, begin, end]() {
+			orbit_propagate(g_asteroid_orbits, g_sim_time, &state.instances[0], &state.instances[1], &state.instances[2], 3, begin, end);
+		}, &asteroids);
+	}
+
+	//Kepler propagation of the planets in double, straight into the position arrays (the sun is body 0)
+	orbit_propagate_double(g_planet_orbits, g_sim_time, &state.pos_x[1], &state.pos_y[1], &state.pos_z[1], 1);
+
+	//spin, branch-free so the loop vectorizes
+	float* rotation = &state.rotation[0];
+	float* clouds_rotation = &state.clouds_rotation[0];
+	int num_bodies = state.pos_x.size();
+	for (int i = 0; i < num_bodies; i++) {
+		float clouds = clouds_rotation[i] + 0.1f;
+		clouds_rotation[i] = clouds > 360.0f ? clouds - 360.0f : clouds;
+
+		float spin = rotation[i] - 0.05f;
+		rotation[i] = spin < -360.0f ? spin + 360.0f : spin;
+	}
+
+	//mutually interacting particles, one leapfrog step per tick (parallel inside)
+	if (g_NumParticles > 0) {
+		float* particles = &state.instances[g_NumAsteroids * 3];
+		nbody_step(g_nbody, g_days_per_tick);
+		nbody_write_positions(g_nbody, g_units_per_au, &particles[0], &particles[1], &particles[2], 3);
+	}
+
+	jobs_wait(&asteroids);
+
+	//contacts and close approaches at the new positions, events go to the render thread
+	if (g_approach_radii > 0.0f && !g_instance_radius.empty()) {
+		size_t count = g_instance_radius.size();
+		g_collision_spheres.resize(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			g_collision_spheres[i * 4 + 0] = state.instances[i * 3 + 0];
+			g_collision_spheres[i * 4 + 1] = state.instances[i * 3 + 1];
+			g_collision_spheres[i * 4 + 2] = state.instances[i * 3 + 2];
+			g_collision_spheres[i * 4 + 3] = g_instance_radius[i];
+		}
+		BvhSpheres spheres = { &g_collision_spheres[0], &g_collision_spheres[1], &g_collision_spheres[2], &g_collision_spheres[3], 4, count };
+		g_collision_scratch.clear();
+		collisions_update(g_collisions, spheres, g_sim_time, g_collision_scratch, &g_collision_events);
+	}
+
+	//while capturing, ticks are laid out on the capture clock at exactly the tick rate
+	state.wall = g_capture_path ? (state.tick - 1) / g_tick_rate : wallSeconds();
+	out = state;
+}
+
+// ------------------------------------------------------------------------------------------
+// Simulation thread: ticks at g_tick_rate and publishes every tick, never waits for rendering
+// ------------------------------------------------------------------------------------------
+void simulationThread() {
+	std::chrono::steady_clock::duration tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / g_tick_rate));
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	while (g_sim_running) {
+		simulate(g_snapshots.write_buffer());
+		g_snapshots.publish();
+
+		//fixed rate; after a long stall (debugger, window drag) restart the clock instead of catching up
+		next += tick;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now > next + 10 * tick) next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void startSimulation() {
+	//the simulation thread owns this state from now on, seeded from what load() set up
+	g_sim_state.tick = 0;
+	g_sim_state.time = g_sim_time;
+	g_sim_state.pos_x = g_bodies.pos_x;
+	g_sim_state.pos_y = g_bodies.pos_y;
+	g_sim_state.pos_z = g_bodies.pos_z;
+	g_sim_state.rotation = g_bodies.rotation;
+	g_sim_state.clouds_rotation = g_bodies.clouds_rotation;
+	g_sim_state.instances.assign((g_NumAsteroids + g_NumParticles) * 3, 0.0f);
+
+	//first tick right here so the renderer always has a snapshot
+	g_snapshots.reset();
+	simulate(g_snapshots.write_buffer());
+	g_snapshots.publish();
+	g_snapshots.acquire();
+	g_previous_snapshot = g_snapshots.read_buffer();
+
+	if (g_capture_path) return; //ticked by stepCaptureClock() on this thread
+	g_sim_running = true;
+	g_sim_thread = std::thread(simulationThread);
+}
+
+// ------------------------------------------------------------------------------------------
+// While capturing: moves the clock to the next frame and runs the ticks due by then, so every
+// frame is one fixed step of simulated time however long it takes to render
+// ------------------------------------------------------------------------------------------
+void stepCaptureClock() {
+	g_capture_clock = g_capture.frames / g_capture_fps;
+	while (g_sim_state.tick / g_tick_rate <= g_capture_clock) {
+		simulate(g_snapshots.write_buffer());
+		g_snapshots.publish();
+	}
+}
+
+void stopSimulation() {
+	if (!g_sim_thread.joinable()) return;
+	g_sim_running = false;
+	g_sim_thread.join();
+}
+
+// ------------------------------------------------------------------------------------------
+// Bounding spheres of the small bodies, read straight from their instance matrices
+// (uniform scale, no rotation: the radius is the first diagonal element)
+// ------------------------------------------------------------------------------------------
+BvhSpheres instanceSpheres()
+{
+	BvhSpheres spheres = { NULL, NULL, NULL, NULL, 16, g_instance_transforms.size() };
+	if (!g_instance_transforms.empty()) {
+		spheres.x = &g_instance_transforms[0][3][0];
+		spheres.y = &g_instance_transforms[0][3][1];
+		spheres.z = &g_instance_transforms[0][3][2];
+		spheres.r = &g_instance_transforms[0][0][0];
+	}
+	return spheres;
+}
+
+// ------------------------------------------------------------------------------------------
+// This function casts a ray through the cursor and selects the closest body it hits:
+// the bodies are tested directly, the small bodies through the BVH. Returns false on a miss.
+// ------------------------------------------------------------------------------------------
+bool pickBody(double x, double y)
+{
+	//cursor -> view space direction (works for both projections) -> render space, eye at the origin
+	float ndc_x = 2.0f * (float)x / g_ViewportWidth - 1.0f;
+	float ndc_y = 1.0f - 2.0f * (float)y / g_ViewportHeight;
+	vec3 view_dir(ndc_x / projection_matrix[0][0], ndc_y / projection_matrix[1][1], -1.0f);
+	vec3 dir = normalize(transpose(mat3(view_matrix)) * view_dir);
+	vec3 origin = eye;
+
+	g_picked_body = g_picked_instance = -1;
+	float closest = FLT_MAX;
+	for (int i = 0; i < (int)g_bodies.size(); i++) {
+		vec3 oc = renderPosition(i) - origin;
+		float r = g_bodies.scale[i];
+		float b = dot(oc, dir);
+		vec3 off_axis = oc - b * dir; //r^2 - |oc|^2 + b^2 without the cancellation far from the eye
+		float h = r * r - dot(off_axis, off_axis);
+		if (h < 0.0f) continue;
+		h = sqrtf(h);
+		if (b + h < 0.0f) continue;
+		float t = b - h >= 0.0f ? b - h : 0.0f; //from inside, the body itself
+		if (t < closest) { closest = t; g_picked_body = i; }
+	}
+
+	float t;
+	int instance = bvh_raycast(g_pick_bvh, instanceSpheres(), &origin[0], &dir[0], t);
+	if (instance >= 0 && t < closest) {
+		g_picked_body = -1;
+		g_picked_instance = instance;
+	}
+	return g_picked_body >= 0 || g_picked_instance >= 0;
 }
 
 // ------------------------------------------------------------------------------------------
@@ -542,54 +1698,297 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, 1);
 	//reload
-	if (key == GLFW_KEY_R && action == GLFW_PRESS)
+	if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+		stopSimulation();
 		load();
-	if (key == GLFW_KEY_Q && action == GLFW_PRESS) camera_mode = 0;
-	if (key == GLFW_KEY_E && action == GLFW_PRESS) camera_mode = 1;
+		startSimulation();
+	}
+	if ((key == GLFW_KEY_Q || key == GLFW_KEY_E) && action == GLFW_PRESS) {
+		camera_mode = key == GLFW_KEY_Q ? 0 : 1;
+		g_look_yaw = g_look_pitch = 0.0f;
+	}
+	if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+		FramePacerStats stats = framepacer_stats(g_pacer);
+		cout << "Input to frame done: " << stats.mean_ms << " ms mean, " << stats.median_ms << " median, " << stats.p99_ms
+			<< " p99, " << stats.max_ms << " max over " << stats.samples << " frames (" << g_pacer.max_frames_in_flight
+			<< " in flight" << (g_late_latch ? ", late latch" : "") << "), " << stats.wait_ms << " ms per frame waiting" << endl;
+		framepacer_reset_stats(g_pacer);
+	}
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) g_belt_rocks = !g_belt_rocks;
+	if (key == GLFW_KEY_I && action == GLFW_PRESS) g_impostor_mode = (g_impostor_mode + 1) % 3;
+	if (key == GLFW_KEY_J && action == GLFW_PRESS) {
+		jobs_print_stats();
+		jobs_reset_stats();
+		if (g_small_bodies_frames > 0) {
+			cout << "Small bodies: " << g_instance_transforms.size() << ", " << g_small_bodies_cpu_ms / g_small_bodies_frames
+				<< " ms per frame of CPU culling and submission (" << (g_gpu_culling ? "GPU" : "CPU") << " culling)" << endl;
+		}
+		cout << "Stream buffer: " << g_stream.high_water / 1024 << " of " << g_stream.region_size / 1024 << " KB used at most, "
+			<< g_stream.overflows << " uploads did not fit, " << g_stream.wait_ms << " ms waiting on fences" << endl;
+		g_small_bodies_cpu_ms = 0.0;
+		g_small_bodies_frames = 0;
+		g_stream.wait_ms = 0.0;
+		if (g_software) {
+			swraster_print_stats(g_sw_raster);
+			swraster_reset_stats(g_sw_raster);
+		}
+	}
+	if (key == GLFW_KEY_C && action == GLFW_PRESS && g_gpu_cull.command_buffer && !g_software) {
+		g_gpu_culling = !g_gpu_culling;
+		g_small_bodies_cpu_ms = 0.0;
+		g_small_bodies_frames = 0;
+	}
+	if (key == GLFW_KEY_S && action == GLFW_PRESS) g_eclipses = !g_eclipses;
+	if (key == GLFW_KEY_G && action == GLFW_PRESS) g_bloom_enabled = !g_bloom_enabled;
+	if (key == GLFW_KEY_A && action == GLFW_PRESS) g_atmosphere_enabled = !g_atmosphere_enabled;
+	if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		g_overdraw_mode = !g_overdraw_mode;
+		g_overdraw_sum = 0.0;
+		g_overdraw_frames = 0;
+		g_overdraw_report_time = wallSeconds();
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// This function reads the mouse look and applies it to the view matrix. update() calls it,
+// and with --late-latch the main loop calls it again just before drawing: only the rotation
+// is latched, so everything placed relative to the camera stays valid and the frame is drawn
+// from the freshest cursor position (culling used the earlier one, a few pixels at most)
+// ------------------------------------------------------------------------------------------
+void latchCamera() {
+	GLFWwindow* window = glfwGetCurrentContext();
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	bool dragging = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+	if (dragging && g_look_dragging) {
+		g_look_yaw += (float)(x - g_look_cursor_x) * LOOK_DEGREES_PER_PIXEL;
+		g_look_pitch = glm::clamp(g_look_pitch + (float)(y - g_look_cursor_y) * LOOK_DEGREES_PER_PIXEL, -89.0f, 89.0f);
+	}
+	g_look_dragging = dragging;
+	g_look_cursor_x = x;
+	g_look_cursor_y = y;
+
+	mat4 look = glm::rotate(mat4(1.0f), g_look_pitch, vec3(1.0f, 0.0f, 0.0f));
+	look = glm::rotate(look, g_look_yaw, vec3(0.0f, 1.0f, 0.0f));
+	view_matrix = look * g_camera_view;
+	framepacer_latch(g_pacer);
 }
 
 // ------------------------------------------------------------------------------------------
 // This function is called every time you click the mouse (You can use this is you want)
 // ------------------------------------------------------------------------------------------
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT) {
-        cout << "Left mouse down at" << mouse_x << ", " << mouse_y << endl;
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        if (!pickBody(mouse_x, mouse_y)) cout << "Nothing at " << mouse_x << ", " << mouse_y << endl;
+        else if (g_picked_body >= 0) cout << "Selected " << g_bodies.name(g_picked_body) << endl;
+        else cout << "Selected " << (g_picked_instance < g_NumAsteroids ? "asteroid " : "particle ")
+            << (g_picked_instance < g_NumAsteroids ? g_picked_instance : g_picked_instance - g_NumAsteroids) << endl;
     }
 }
 
 void update() {
-	for (int i = 1; i < g_NumPlanets; i++) {
-		bodies[i].position = vec3((dist_to_sun0 + i)*bodies[i].dist_to_sun*cos(bodies[i].orbit_angle), 0, (dist_to_sun0 + i)*bodies[i].dist_to_sun*sin(bodies[i].orbit_angle));
-		bodies[i].orbit_angle += bodies[i].orbit_speed * 0.001;
-		bodies[i].clouds_rotation +=  0.1f;
-		if (bodies[i].clouds_rotation > 360) bodies[i].clouds_rotation = 0;
-
-		bodies[i].rotacion += -0.05f;
-		if (bodies[i].rotacion > 360) bodies[i].rotacion = 0;
+	//newest snapshot from the simulation thread, the one it replaces is kept for interpolation
+	if (g_snapshots.has_new()) {
+		std::swap(g_previous_snapshot, g_snapshots.read_buffer());
+		g_snapshots.acquire();
 	}
+	const SimSnapshot& current = g_snapshots.read_buffer();
+
+	//render one tick in the past so there is always a pair of snapshots around that time
+	double render_wall = (g_capture_path ? g_capture_clock : wallSeconds()) - 1.0 / g_tick_rate;
+	double span = current.wall - g_previous_snapshot.wall;
+	float alpha = span > 0.0 ? (float)glm::clamp((render_wall - g_previous_snapshot.wall) / span, 0.0, 1.0) : 1.0f;
+	g_render_time = g_previous_snapshot.time + (current.time - g_previous_snapshot.time) * alpha;
+	snapshot_interpolate_bodies(g_previous_snapshot, current, alpha, g_bodies);
 
+	//camera in world space and in double
+	dvec3 target;
 	switch (camera_mode)
 	{
 	case 1: 
-		eye = vec3(bodies[3].position.x, bodies[3].position.y, bodies[3].position.z + 5);
-		center = bodies[3].position;
+		target = dvec3(g_bodies.pos_x[g_earth], g_bodies.pos_y[g_earth], g_bodies.pos_z[g_earth]);
+		g_camera_pos = target + dvec3(0.0, 0.0, 5.0 * g_bodies.scale[g_earth]);
 		
 		break;
 
 	default:
-		eye = vec3(0, 0, 50);
-		center = vec3(0.0, 0.0, 0.0);
+		target = dvec3(0.0, 0.0, 0.0);
+		g_camera_pos = dvec3(0.0, 2.0, 4.0) * (double)g_units_per_au;
 		up = vec3 (0, 1, 0);
 	}
 
-	view_matrix = glm::lookAt(eye, center, up); 
+	//render space is centered on the camera, so floats only ever hold nearby offsets
+	eye = vec3(0.0f, 0.0f, 0.0f);
+	center = vec3(target - g_camera_pos);
+	g_light_pos = renderPosition(0);
+	g_camera_view = glm::lookAt(eye, center, up);
+	latchCamera();
+
+	//bodies that may eclipse each other at the interpolated positions (the sun is the light)
+	eclipse_select_occluders(g_bodies, 0, g_camera_pos, g_eclipse_occluders);
+
+	snapshot_interpolate_instances(g_previous_snapshot, current, alpha, g_camera_pos, g_instance_transforms);
+
+	//picking structure follows the motion; rebuilt only when the boxes have grown loose
+	if (g_pick_bvh.size() != g_instance_transforms.size() || bvh_refit(g_pick_bvh, instanceSpheres()) > 2.0f) {
+		bvh_build(g_pick_bvh, instanceSpheres());
+	}
+
+	//small bodies outside the view are dropped before upload, or on the GPU
+	double cull_start = wallSeconds();
+	Frustum frustum = frustum_from_matrix(projection_matrix * view_matrix, g_reversed_z);
+	if (g_gpu_culling) {
+		float impostor_pixels = g_impostor_mode == 0 ? 0.0f : g_impostor_mode == 2 ? FLT_MAX : g_impostor_pixels;
+		gpucull_update(g_gpu_cull, g_stream, g_instance_transforms, frustum, focalPixels(), impostor_pixels);
+	}
+	else cull_instances(frustum, g_instance_transforms, g_visible_transforms);
+	g_small_bodies_cpu_ms += (wallSeconds() - cull_start) * 1000.0;
+
+	//collision events raised since the last frame, only the first few are printed
+	vector<CollisionEvent> events;
+	if (g_collision_events.pop_all(events) > 0) {
+		size_t shown = std::min(events.size(), (size_t)8);
+		for (size_t k = 0; k < shown; k++) {
+			const CollisionEvent& e = events[k];
+			cout << "Day " << e.time << ": " << (e.type == COLLISION_CONTACT ? "contact" : "close approach")
+				<< " between " << e.a << " and " << e.b << ", gap " << e.gap << endl;
+		}
+		if (events.size() > shown) cout << "  (+" << events.size() - shown << " more)" << endl;
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// This function renders the poster: the scene is updated once, then drawn tile by tile with
+// the tile's sub-frustum, each tile a frame of its own for the stream buffer
+// ------------------------------------------------------------------------------------------
+void renderPoster()
+{
+	streambuffer_begin_frame(g_stream);
+	update();
+	streambuffer_end_frame(g_stream);
+
+	mat4 full_projection = projection_matrix;
+	PosterStats stats;
+	cout << "Poster: " << g_poster_width << "x" << g_poster_height << " in " << g_poster_tile << " pixel tiles to " << g_poster_path << endl;
+	bool ok = poster_render(g_poster_path, g_poster_width, g_poster_height, g_poster_tile, full_projection,
+		[](const mat4& tile_projection, GLuint target) {
+			streambuffer_begin_frame(g_stream);
+			projection_matrix = tile_projection;
+			g_output_texture = target;
+			renderFrame();
+			streambuffer_end_frame(g_stream);
+		}, stats);
+	projection_matrix = full_projection;
+	g_output_texture = 0;
+
+	if (ok) {
+		cout << "Poster: " << stats.tiles << " tiles, " << stats.render_ms << " ms rendering, " << stats.readback_ms
+			<< " ms reading back, " << stats.write_ms << " ms writing; " << (stats.tile_bytes + stats.band_bytes) / 1048576
+			<< " MB for one tile and one band" << endl;
+	}
 }
 
+// ------------------------------------------------------------------------------------------
+// This function ray traces one frame into g_raytrace_path: the scene is updated once, the
+// bodies and every small body (off-screen ones cast shadows too) become spheres
+// ------------------------------------------------------------------------------------------
+void renderRaytrace()
+{
+	streambuffer_begin_frame(g_stream);
+	update();
+	streambuffer_end_frame(g_stream);
+
+	RaytraceScene& scene = g_raytrace_scene;
+	raytrace_clear(scene);
+	for (int i = 0; i < (int)g_bodies.size(); i++) {
+		raytrace_add_body(scene, renderPosition(i), g_bodies.scale[i], transpose(mat3(bodyRotation(i))), bodyMaterial(i));
+	}
+	for (size_t i = 0; i < g_instance_transforms.size(); i++) {
+		raytrace_add_small_body(scene, vec3(g_instance_transforms[i][3]), g_instance_transforms[i][0][0]);
+	}
+	scene.light = 0; //the sun
+	scene.small_body_material.texture = &g_sw_asteroid;
+	scene.small_body_material.light_pos = g_light_pos;
+	scene.small_body_material.light_radius = g_bodies.scale[0];
+	scene.small_body_material.eye = eye;
+
+	RaytraceStats stats;
+	raytrace_build(scene, stats);
+	vector<unsigned int> image;
+	raytrace_render(scene, projection_matrix, view_matrix, g_raytrace_width, g_raytrace_height, g_bloom.exposure, image, stats);
+
+	//rows are bottom first, the file top first
+	PngWriter png;
+	bool ok = png_begin(png, g_raytrace_path, g_raytrace_width, g_raytrace_height);
+	for (int y = g_raytrace_height - 1; ok && y >= 0; y--) png_write_row(png, (const unsigned char*)&image[(size_t)y * g_raytrace_width]);
+	ok = png_end(png) && ok;
+
+	double seconds = stats.trace_ms / 1000.0, busy = stats.busy_ms / 1000.0;
+	long long rays = stats.primary_rays + stats.shadow_rays;
+	cout << "Ray traced " << g_raytrace_width << "x" << g_raytrace_height << " (" << scene.spheres.size() / 4 << " spheres) "
+		<< (ok ? "to " : "but could not write ") << g_raytrace_path << ": " << stats.build_ms << " ms BVH build, " << stats.trace_ms
+		<< " ms tracing " << stats.primary_rays << " primary and " << stats.shadow_rays << " shadow rays, "
+		<< (seconds > 0.0 ? rays / seconds * 1e-6 : 0.0) << " Mrays/s on " << jobs_num_threads() << " threads, "
+		<< (busy > 0.0 ? rays / busy * 1e-6 : 0.0) << " Mrays/s per core" << endl;
+}
 
-int main(void)
+int main(int argc, char** argv)
 {
 	srand(time(NULL));
 
+	//command line options
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench-orbits") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			orbit_benchmark(count > 0 ? count : 1000000);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-pick") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			bvh_benchmark(count > 0 ? count : 1000000);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-collisions") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			collisions_benchmark(count > 0 ? count : 1000000);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-nbody") == 0) {
+			int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+			nbody_benchmark(count > 0 ? count : 1000000);
+			return 0;
+		}
+		if (strcmp(argv[i], "--asteroids") == 0 && i + 1 < argc) g_NumAsteroids = atoi(argv[++i]);
+		if (strcmp(argv[i], "--belt") == 0 && i + 1 < argc) g_NumBeltBodies = atoi(argv[++i]);
+		if (strcmp(argv[i], "--nbody") == 0 && i + 1 < argc) g_NumParticles = atoi(argv[++i]);
+		if (strcmp(argv[i], "--theta") == 0 && i + 1 < argc) g_nbody_theta = (float)atof(argv[++i]);
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) g_nbody_threads = atoi(argv[++i]);
+		if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) g_tick_rate = std::max(1.0, atof(argv[++i]));
+		if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) g_catalog_path = argv[++i];
+		if (strcmp(argv[i], "--catalog-limit") == 0 && i + 1 < argc) g_catalog_limit = atol(argv[++i]);
+		if (strcmp(argv[i], "--approach") == 0 && i + 1 < argc) g_approach_radii = (float)atof(argv[++i]);
+		if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) g_frames_in_flight = atoi(argv[++i]);
+		if (strcmp(argv[i], "--swap-interval") == 0 && i + 1 < argc) g_swap_interval = atoi(argv[++i]);
+		if (strcmp(argv[i], "--late-latch") == 0) g_late_latch = true;
+		if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) g_capture_path = argv[++i];
+		if (strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc) g_capture_fps = std::max(1.0, atof(argv[++i]));
+		if (strcmp(argv[i], "--capture-size") == 0 && i + 1 < argc) sscanf(argv[++i], "%dx%d", &g_capture_width, &g_capture_height);
+		if (strcmp(argv[i], "--capture-frames") == 0 && i + 1 < argc) g_capture_frames = atoi(argv[++i]);
+		if (strcmp(argv[i], "--poster") == 0 && i + 2 < argc) {
+			sscanf(argv[++i], "%dx%d", &g_poster_width, &g_poster_height);
+			g_poster_path = argv[++i];
+		}
+		if (strcmp(argv[i], "--poster-tile") == 0 && i + 1 < argc) g_poster_tile = atoi(argv[++i]);
+		if (strcmp(argv[i], "--software") == 0) g_software = true;
+		if (strcmp(argv[i], "--raytrace") == 0 && i + 1 < argc) g_raytrace_path = argv[++i];
+		if (strcmp(argv[i], "--raytrace-size") == 0 && i + 1 < argc) sscanf(argv[++i], "%dx%d", &g_raytrace_width, &g_raytrace_height);
+		if (strcmp(argv[i], "--real-scale") == 0) {
+			g_real_scale = true;
+			g_units_per_au = 149597870.7f; //km
+		}
+	}
+	g_cpu_scene = g_software || g_raytrace_path;
+
 	//setup window and boring stuff, defined in glfunctions.cpp
 	GLFWwindow* window;
 	if (!glfwInit())return -1;
@@ -597,41 +1996,132 @@ int main(void)
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (g_poster_path || g_raytrace_path) glfwWindowHint(GLFW_VISIBLE, GL_FALSE); //nothing to show, only the context is needed
 	window = glfwCreateWindow(g_ViewportWidth, g_ViewportHeight, "Solar System: Phong Test", NULL, NULL);
 	if (!window) {glfwTerminate();	return -1;}
 	glfwMakeContextCurrent(window);
 	glewExperimental = GL_TRUE;
 	glewInit();
+	if (g_capture_path) g_swap_interval = 0; //as fast as the GPU goes, the clock is fixed per frame
+	glfwSwapInterval(g_swap_interval);
+	framepacer_create(g_pacer, g_frames_in_flight);
+	cout << "Frame pacing: " << g_pacer.max_frames_in_flight << " frames in flight, swap interval " << g_swap_interval
+		<< (g_late_latch ? ", late-latched camera" : "") << endl;
+
+	//HDR scene, tonemapped (with bloom) into the window at the end of the frame; the targets
+	//are the frame graph's, in formats GL 3.x must render to
+	glfwGetFramebufferSize(window, &g_FramebufferWidth, &g_FramebufferHeight);
+	int window_width = g_FramebufferWidth, window_height = g_FramebufferHeight;
+
+	//capture: the scene at the capture size, the window only shows it scaled
+	if (g_capture_path) {
+		if (g_capture_width <= 0 || g_capture_height <= 0) {
+			g_capture_width = g_FramebufferWidth;
+			g_capture_height = g_FramebufferHeight;
+		}
+		g_FramebufferWidth = g_ViewportWidth = g_capture_width;
+		g_FramebufferHeight = g_ViewportHeight = g_capture_height;
+		if (!capture_open(g_capture, g_capture_path, g_capture_width, g_capture_height, g_capture_fps)) { glfwTerminate(); return -1; }
+		g_output_texture = g_capture.texture;
+		cout << "Capturing " << g_capture_width << "x" << g_capture_height << " at " << g_capture_fps << " fps to " << g_capture.path
+			<< (g_capture.format == CAPTURE_Y4M ? " (Y4M)" : " (PNG)") << endl;
+	}
+	//poster: projection and level of detail for the whole image, targets for one tile; bloom
+	//would stop at the tile edges, so it is off
+	if (g_poster_path) {
+		if (g_poster_width <= 0 || g_poster_height <= 0) { g_poster_width = g_FramebufferWidth; g_poster_height = g_FramebufferHeight; }
+		g_poster_tile = poster_tile_size(g_poster_tile);
+		g_ViewportWidth = g_poster_width;
+		g_ViewportHeight = g_poster_height;
+		g_FramebufferWidth = g_FramebufferHeight = g_poster_tile;
+		g_bloom_enabled = false;
+	}
+	//ray traced still: only the projection follows its size, GL loads the scene and draws nothing
+	if (g_raytrace_path) {
+		if (g_raytrace_width <= 0 || g_raytrace_height <= 0) { g_raytrace_width = g_FramebufferWidth; g_raytrace_height = g_FramebufferHeight; }
+		g_ViewportWidth = g_raytrace_width;
+		g_ViewportHeight = g_raytrace_height;
+	}
+	bloom_create(g_bloom, g_FramebufferWidth, g_FramebufferHeight);
+	cout << "Bloom: " << g_bloom.levels << " levels from " << g_bloom.widths[0] << "x" << g_bloom.heights[0] << endl;
+	oit_create(g_oit);
+
+	//reversed-Z: float depth, 1 at the near plane falling towards 0 at infinity. Needs the
+	//float depth of the scene target and glClipControl for a [0, 1] depth range.
+	if (GLEW_VERSION_4_5 || GLEW_ARB_clip_control) {
+		g_reversed_z = true;
+		glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+	}
+	glClearDepth(g_reversed_z ? 0.0 : 1.0);
+	glDepthFunc(g_reversed_z ? GL_GREATER : GL_LESS);
+	cout << "Depth buffer: " << (g_reversed_z ? "reversed-Z 32-bit float" : "standard (no glClipControl)") << endl;
+	glGenVertexArrays(1, &g_fullscreenVao);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); //the sky's mips filter across face edges
+
+	//small bodies culled on the GPU when compute shaders are there (C switches back); the
+	//software rasterizer draws what the CPU culling leaves
+	g_gpu_culling = gpucull_supported() && !g_software;
+	cout << "Small bodies: " << (g_gpu_culling ? "GPU culling and indirect draws" : g_software ? "CPU culling (software rendering)" : "CPU culling (no GL 4.3)") << endl;
 
 	//input callbacks
 	glfwSetKeyCallback(window, key_callback);
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, 1);
 
+	//worker threads for simulation and culling
+	jobs_init(g_nbody_threads);
+
+	//scattering tables, computed on the workers the first time and read back afterwards
+	AtmosphereLuts atmosphere_luts;
+	atmosphere_load(g_atmosphere_cache, g_atmosphere_params, atmosphere_luts);
+	atmosphere_create_textures(g_atmosphere, atmosphere_luts);
+	cout << "Atmosphere tables " << (atmosphere_luts.from_cache ? "read from " : "computed and saved to ") << g_atmosphere_cache
+		<< " in " << atmosphere_luts.compute_ms << " ms" << endl;
+
 	//load all the resources
 	load();
 
+	//from here on the simulation ticks on its own thread
+	startSimulation();
+
+	//a poster is one frame: render it and skip the loop
+	if (g_poster_path) {
+		renderPoster();
+		glfwSetWindowShouldClose(window, 1);
+	}
+	if (g_raytrace_path) {
+		renderRaytrace();
+		glfwSetWindowShouldClose(window, 1);
+	}
+
     // Loop until the user closes the window
-    while (!glfwWindowShouldClose(window))
+    double capture_start = wallSeconds();
+    while (!glfwWindowShouldClose(window) && (!g_capture_path || g_capture_frames <= 0 || g_capture.frames < g_capture_frames))
     {
+		//no more than g_frames_in_flight frames queued, then the ring region this frame writes
+		framepacer_begin_frame(g_pacer);
+		streambuffer_begin_frame(g_stream);
+		if (g_capture_path) stepCaptureClock();
+
 		update();
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		//the CPU work is done, the camera can take the newest cursor position
+		if (g_late_latch) latchCamera();
 
-		drawUniverse();
-		drawSun(bodies[0].position, bodies[0].texture_id, bodies[0].scale);
+		renderFrame();
+		streambuffer_end_frame(g_stream);
 
-		for (int i = 1; i < g_NumPlanets; i++) {
-			if (bodies[i].name == "Earth") {
-				drawEarth(bodies[i]);
-			}
-			else {
-				drawPlanet(bodies[i].position, bodies[i].texture_id, bodies[i].scale);
-			}
+		//queue the readback, and show the frame in the window
+		if (g_capture_path) {
+			capture_frame(g_capture);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, g_capture.fbo);
+			glBlitFramebuffer(0, 0, g_capture.width, g_capture.height, 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 		}
         
         // Swap front and back buffers
         glfwSwapBuffers(window);
+		framepacer_end_frame(g_pacer);
         
         // Poll for and process events
         glfwPollEvents();
@@ -640,7 +2130,23 @@ int main(void)
         glfwGetCursorPos(window, &mouse_x, &mouse_y);
     }
 
-    //terminate glfw and exit
+    //the frames still in flight go out before anything is torn down
+    if (g_capture_path) {
+        double seconds = wallSeconds() - capture_start;
+        capture_close(g_capture);
+        cout << "Captured " << g_capture.written << " frames (" << g_capture.written / g_capture_fps << " s of video) in " << seconds
+            << " s, " << g_capture.written / seconds << " fps; per frame " << g_capture.readback_ms / std::max(g_capture.written, 1)
+            << " ms readback, " << g_capture.queue_wait_ms / std::max(g_capture.written, 1) << " ms waiting for the writer, "
+            << g_capture.write_ms / std::max(g_capture.written, 1) << " ms writing" << endl;
+    }
+
+    //stop the simulation and the workers, terminate glfw and exit
+    framegraph_destroy(g_frameGraph);
+    streambuffer_destroy(g_stream);
+    glDeleteBuffers(1, &g_eclipse_fallback_ubo);
+    framepacer_destroy(g_pacer);
+    stopSimulation();
+    jobs_shutdown();
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,456 @@
+#include "nbody.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "jobs.h"
+
+// Top of the tree: the first two levels (64 cells) are split up front so every
+// cell below can be built by a different thread.
+#define NBODY_TOP_CELLS 64
+#define NBODY_FORCE_CHUNK 256
+
+typedef std::chrono::high_resolution_clock nbody_clock;
+
+static double elapsed_ms(nbody_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(nbody_clock::now() - start).count();
+}
+
+// Runs fn(slice) for slices 0..num_threads-1 as jobs, the calling thread taking slice 0
+template <class F>
+static void parallel_run(int num_threads, F fn) {
+	JobCounter counter;
+	for (int t = 1; t < num_threads; t++) jobs_run([&fn, t] { fn(t); }, &counter);
+	fn(0);
+	jobs_wait(&counter);
+}
+
+static inline size_t chunk_begin(size_t count, int t, int num_threads) {
+	return count * t / num_threads;
+}
+
+static inline int octant(float x, float y, float z, float cx, float cy, float cz) {
+	return (x >= cx ? 1 : 0) | (y >= cy ? 2 : 0) | (z >= cz ? 4 : 0);
+}
+
+static inline float child_offset(int oct, int axis, float quarter) {
+	return (oct & (1 << axis)) ? quarter : -quarter;
+}
+
+static void init_node(NBodyNode& node, float cx, float cy, float cz, float half, int start, int count) {
+	node.com_x = node.com_y = node.com_z = node.mass = 0.0f;
+	node.cx = cx; node.cy = cy; node.cz = cz; node.half = half;
+	for (int o = 0; o < 8; o++) node.child[o] = -1;
+	node.start = start;
+	node.count = count;
+	node.is_leaf = 0;
+}
+
+// Adds the mass moment of 'from' to 'to' (center of mass is normalized by finish_moments)
+static inline void add_moment(NBodyNode& to, const NBodyNode& from) {
+	to.com_x += from.com_x * from.mass;
+	to.com_y += from.com_y * from.mass;
+	to.com_z += from.com_z * from.mass;
+	to.mass += from.mass;
+}
+
+static inline void finish_moments(NBodyNode& node) {
+	if (node.mass > 0.0f) {
+		node.com_x /= node.mass;
+		node.com_y /= node.mass;
+		node.com_z /= node.mass;
+	}
+	else {
+		node.com_x = node.cx; node.com_y = node.cy; node.com_z = node.cz;
+	}
+}
+
+void NBodySystem::add(float x, float y, float z, float vx, float vy, float vz, float m) {
+	pos_x.push_back(x); pos_y.push_back(y); pos_z.push_back(z);
+	vel_x.push_back(vx); vel_y.push_back(vy); vel_z.push_back(vz);
+	acc_x.push_back(0); acc_y.push_back(0); acc_z.push_back(0);
+	mass.push_back(m);
+}
+
+void nbody_generate_disk(NBodySystem& sys, size_t count, float r_min, float r_max, float disk_mass, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+	float m = disk_mass / (float)std::max<size_t>(count, 1);
+	for (size_t i = 0; i < count; i++) {
+		//uniform surface density
+		float r = sqrtf(r_min * r_min + (r_max * r_max - r_min * r_min) * unit(rng));
+		float angle = 6.2831853f * unit(rng);
+		float height = 0.01f * r * gauss(rng);
+
+		//circular speed around the central mass plus a small dispersion
+		float v = sqrtf((float)NBODY_G * sys.central_mass / r);
+		float dispersion = 0.02f * v;
+
+		float x = r * cosf(angle), z = -r * sinf(angle);
+		float vx = -v * sinf(angle) + dispersion * gauss(rng);
+		float vz = -v * cosf(angle) + dispersion * gauss(rng);
+		sys.add(x, height, z, vx, dispersion * gauss(rng), vz, m);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Octree build
+// ------------------------------------------------------------------------------------------
+
+// Builds the cell holding order[start, start + count) into 'out' and returns its index there.
+// Only touches that slice of order/scratch, so disjoint cells can be built concurrently.
+static int build_cell(NBodySystem& sys, std::vector<NBodyNode>& out, int start, int count,
+	float cx, float cy, float cz, float half, int depth) {
+	int index = (int)out.size();
+	out.push_back(NBodyNode());
+	init_node(out[index], cx, cy, cz, half, start, count);
+
+	int* order = &sys.order[0];
+	if (count <= NBODY_LEAF_SIZE || depth >= NBODY_MAX_DEPTH) {
+		NBodyNode& leaf = out[index];
+		leaf.is_leaf = 1;
+		for (int k = start; k < start + count; k++) {
+			int p = order[k];
+			float m = sys.mass[p];
+			leaf.com_x += sys.pos_x[p] * m;
+			leaf.com_y += sys.pos_y[p] * m;
+			leaf.com_z += sys.pos_z[p] * m;
+			leaf.mass += m;
+		}
+		finish_moments(leaf);
+		return index;
+	}
+
+	//counting sort of the slice by octant
+	int counts[8] = { 0 };
+	for (int k = start; k < start + count; k++) {
+		int p = order[k];
+		counts[octant(sys.pos_x[p], sys.pos_y[p], sys.pos_z[p], cx, cy, cz)]++;
+	}
+	int offsets[8];
+	offsets[0] = start;
+	for (int o = 1; o < 8; o++) offsets[o] = offsets[o - 1] + counts[o - 1];
+	int* scratch = &sys.scratch[0];
+	for (int k = start; k < start + count; k++) {
+		int p = order[k];
+		scratch[offsets[octant(sys.pos_x[p], sys.pos_y[p], sys.pos_z[p], cx, cy, cz)]++] = p;
+	}
+	std::copy(scratch + start, scratch + start + count, order + start);
+
+	float quarter = half * 0.5f;
+	int child_start = start;
+	NBodyNode moments = out[index];
+	for (int o = 0; o < 8; o++) {
+		if (counts[o] > 0) {
+			int c = build_cell(sys, out, child_start, counts[o],
+				cx + child_offset(o, 0, quarter), cy + child_offset(o, 1, quarter), cz + child_offset(o, 2, quarter),
+				quarter, depth + 1);
+			out[index].child[o] = c;
+			add_moment(moments, out[c]);
+		}
+		child_start += counts[o];
+	}
+	finish_moments(moments);
+	out[index].com_x = moments.com_x; out[index].com_y = moments.com_y; out[index].com_z = moments.com_z;
+	out[index].mass = moments.mass;
+	return index;
+}
+
+void nbody_build_tree(NBodySystem& sys) {
+	int n = (int)sys.size();
+	int num_threads = std::max(1, sys.num_threads);
+	sys.nodes.clear();
+	if (n == 0) return;
+
+	sys.order.resize(n);
+	sys.scratch.resize(n);
+	sys.bucket.resize(n);
+	sys.sorted_x.resize(n); sys.sorted_y.resize(n); sys.sorted_z.resize(n); sys.sorted_m.resize(n);
+
+	//bounding cube
+	std::vector<float> bounds(num_threads * 6);
+	parallel_run(num_threads, [&](int t) {
+		float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+		for (size_t i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t + 1, num_threads); i++) {
+			lo[0] = std::min(lo[0], sys.pos_x[i]); hi[0] = std::max(hi[0], sys.pos_x[i]);
+			lo[1] = std::min(lo[1], sys.pos_y[i]); hi[1] = std::max(hi[1], sys.pos_y[i]);
+			lo[2] = std::min(lo[2], sys.pos_z[i]); hi[2] = std::max(hi[2], sys.pos_z[i]);
+		}
+		for (int a = 0; a < 3; a++) { bounds[t * 6 + a] = lo[a]; bounds[t * 6 + 3 + a] = hi[a]; }
+	});
+	float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+	for (int t = 0; t < num_threads; t++) {
+		for (int a = 0; a < 3; a++) {
+			lo[a] = std::min(lo[a], bounds[t * 6 + a]);
+			hi[a] = std::max(hi[a], bounds[t * 6 + 3 + a]);
+		}
+	}
+	float cx = 0.5f * (lo[0] + hi[0]), cy = 0.5f * (lo[1] + hi[1]), cz = 0.5f * (lo[2] + hi[2]);
+	float half = 0.5f * std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2])) * 1.001f + 1e-6f;
+
+	//bucket every particle into one of the 64 cells two levels down (parallel counting sort)
+	std::vector<int> histogram(num_threads * NBODY_TOP_CELLS, 0);
+	float quarter = half * 0.5f;
+	parallel_run(num_threads, [&](int t) {
+		int* hist = &histogram[t * NBODY_TOP_CELLS];
+		for (size_t i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t + 1, num_threads); i++) {
+			float x = sys.pos_x[i], y = sys.pos_y[i], z = sys.pos_z[i];
+			int o1 = octant(x, y, z, cx, cy, cz);
+			int o2 = octant(x, y, z, cx + child_offset(o1, 0, quarter), cy + child_offset(o1, 1, quarter), cz + child_offset(o1, 2, quarter));
+			sys.bucket[i] = (unsigned char)(o1 * 8 + o2);
+			hist[o1 * 8 + o2]++;
+		}
+	});
+	int bucket_start[NBODY_TOP_CELLS + 1];
+	int running = 0;
+	for (int b = 0; b < NBODY_TOP_CELLS; b++) {
+		bucket_start[b] = running;
+		for (int t = 0; t < num_threads; t++) {
+			int c = histogram[t * NBODY_TOP_CELLS + b];
+			histogram[t * NBODY_TOP_CELLS + b] = running;
+			running += c;
+		}
+	}
+	bucket_start[NBODY_TOP_CELLS] = running;
+	parallel_run(num_threads, [&](int t) {
+		int* offset = &histogram[t * NBODY_TOP_CELLS];
+		for (size_t i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t + 1, num_threads); i++) {
+			sys.order[offset[sys.bucket[i]]++] = (int)i;
+		}
+	});
+
+	//build the 64 subtrees, threads pull cells from a shared counter
+	std::vector<NBodyNode> subtrees[NBODY_TOP_CELLS];
+	std::atomic<int> next_cell(0);
+	float eighth = quarter * 0.5f;
+	parallel_run(num_threads, [&](int) {
+		int b;
+		while ((b = next_cell++) < NBODY_TOP_CELLS) {
+			int count = bucket_start[b + 1] - bucket_start[b];
+			if (count == 0) continue;
+			int o1 = b / 8, o2 = b % 8;
+			float x = cx + child_offset(o1, 0, quarter) + child_offset(o2, 0, eighth);
+			float y = cy + child_offset(o1, 1, quarter) + child_offset(o2, 1, eighth);
+			float z = cz + child_offset(o1, 2, quarter) + child_offset(o2, 2, eighth);
+			build_cell(sys, subtrees[b], bucket_start[b], count, x, y, z, eighth, 2);
+		}
+	});
+
+	//stitch: root, the level-one cells, then every subtree with its child indices shifted
+	sys.nodes.push_back(NBodyNode());
+	init_node(sys.nodes[0], cx, cy, cz, half, 0, n);
+	int level_one[8];
+	for (int o1 = 0; o1 < 8; o1++) {
+		int count = bucket_start[o1 * 8 + 8] - bucket_start[o1 * 8];
+		level_one[o1] = -1;
+		if (count == 0) continue;
+		level_one[o1] = (int)sys.nodes.size();
+		sys.nodes[0].child[o1] = level_one[o1];
+		sys.nodes.push_back(NBodyNode());
+		init_node(sys.nodes.back(), cx + child_offset(o1, 0, quarter), cy + child_offset(o1, 1, quarter), cz + child_offset(o1, 2, quarter),
+			quarter, bucket_start[o1 * 8], count);
+	}
+	size_t total = sys.nodes.size();
+	for (int b = 0; b < NBODY_TOP_CELLS; b++) total += subtrees[b].size();
+	sys.nodes.reserve(total);
+	for (int b = 0; b < NBODY_TOP_CELLS; b++) {
+		if (subtrees[b].empty()) continue;
+		int offset = (int)sys.nodes.size();
+		for (size_t k = 0; k < subtrees[b].size(); k++) {
+			NBodyNode node = subtrees[b][k];
+			for (int o = 0; o < 8; o++) if (node.child[o] >= 0) node.child[o] += offset;
+			sys.nodes.push_back(node);
+		}
+		NBodyNode& parent = sys.nodes[level_one[b / 8]];
+		parent.child[b % 8] = offset;
+		add_moment(parent, sys.nodes[offset]);
+	}
+	for (int o1 = 0; o1 < 8; o1++) {
+		if (level_one[o1] < 0) continue;
+		finish_moments(sys.nodes[level_one[o1]]);
+		add_moment(sys.nodes[0], sys.nodes[level_one[o1]]);
+	}
+	finish_moments(sys.nodes[0]);
+
+	//gather particles in tree order so leaves read contiguous memory
+	parallel_run(num_threads, [&](int t) {
+		for (size_t k = chunk_begin(n, t, num_threads); k < chunk_begin(n, t + 1, num_threads); k++) {
+			int p = sys.order[k];
+			sys.sorted_x[k] = sys.pos_x[p];
+			sys.sorted_y[k] = sys.pos_y[p];
+			sys.sorted_z[k] = sys.pos_z[p];
+			sys.sorted_m[k] = sys.mass[p];
+		}
+	});
+}
+
+// ------------------------------------------------------------------------------------------
+// Force evaluation
+// ------------------------------------------------------------------------------------------
+void nbody_compute_forces(NBodySystem& sys) {
+	int n = (int)sys.size();
+	if (n == 0 || sys.nodes.empty()) return;
+	int num_threads = std::max(1, sys.num_threads);
+
+	const float G = (float)NBODY_G;
+	const float eps2 = sys.softening * sys.softening;
+	const float theta2 = sys.theta * sys.theta;
+	const NBodyNode* nodes = &sys.nodes[0];
+
+	//particles are walked in tree order so consecutive ones traverse almost the same nodes
+	std::atomic<int> next_chunk(0);
+	parallel_run(num_threads, [&](int) {
+		int stack[8 * (NBODY_MAX_DEPTH + 2)];
+		int chunk;
+		while ((chunk = next_chunk.fetch_add(NBODY_FORCE_CHUNK)) < n) {
+			int chunk_end = std::min(n, chunk + NBODY_FORCE_CHUNK);
+			for (int s = chunk; s < chunk_end; s++) {
+				float px = sys.sorted_x[s], py = sys.sorted_y[s], pz = sys.sorted_z[s];
+				float ax = 0.0f, ay = 0.0f, az = 0.0f;
+
+				int sp = 0;
+				stack[sp++] = 0;
+				while (sp > 0) {
+					const NBodyNode& node = nodes[stack[--sp]];
+					if (node.is_leaf) {
+						for (int k = node.start; k < node.start + node.count; k++) {
+							if (k == s) continue;
+							float dx = sys.sorted_x[k] - px, dy = sys.sorted_y[k] - py, dz = sys.sorted_z[k] - pz;
+							float r2 = dx * dx + dy * dy + dz * dz + eps2;
+							float inv_r = 1.0f / sqrtf(r2);
+							float f = sys.sorted_m[k] * inv_r * inv_r * inv_r;
+							ax += f * dx; ay += f * dy; az += f * dz;
+						}
+						continue;
+					}
+
+					float dx = node.com_x - px, dy = node.com_y - py, dz = node.com_z - pz;
+					float d2 = dx * dx + dy * dy + dz * dz;
+					float size = 2.0f * node.half;
+					bool inside = fabsf(px - node.cx) <= node.half && fabsf(py - node.cy) <= node.half && fabsf(pz - node.cz) <= node.half;
+					if (!inside && size * size < theta2 * d2) {
+						//far enough: the whole cell acts as a point mass
+						float r2 = d2 + eps2;
+						float inv_r = 1.0f / sqrtf(r2);
+						float f = node.mass * inv_r * inv_r * inv_r;
+						ax += f * dx; ay += f * dy; az += f * dz;
+					}
+					else {
+						for (int o = 0; o < 8; o++) if (node.child[o] >= 0) stack[sp++] = node.child[o];
+					}
+				}
+
+				//fixed central mass at the origin
+				float r2 = px * px + py * py + pz * pz + eps2;
+				float inv_r = 1.0f / sqrtf(r2);
+				float fc = -sys.central_mass * inv_r * inv_r * inv_r;
+
+				int p = sys.order[s];
+				sys.acc_x[p] = G * (ax + fc * px);
+				sys.acc_y[p] = G * (ay + fc * py);
+				sys.acc_z[p] = G * (az + fc * pz);
+			}
+		}
+	});
+}
+
+// ------------------------------------------------------------------------------------------
+// Leapfrog integration
+// ------------------------------------------------------------------------------------------
+static void kick(NBodySystem& sys, float dt) {
+	int n = (int)sys.size();
+	int num_threads = std::max(1, sys.num_threads);
+	parallel_run(num_threads, [&](int t) {
+		for (size_t i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t + 1, num_threads); i++) {
+			sys.vel_x[i] += sys.acc_x[i] * dt;
+			sys.vel_y[i] += sys.acc_y[i] * dt;
+			sys.vel_z[i] += sys.acc_z[i] * dt;
+		}
+	});
+}
+
+static void drift(NBodySystem& sys, float dt) {
+	int n = (int)sys.size();
+	int num_threads = std::max(1, sys.num_threads);
+	parallel_run(num_threads, [&](int t) {
+		for (size_t i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t + 1, num_threads); i++) {
+			sys.pos_x[i] += sys.vel_x[i] * dt;
+			sys.pos_y[i] += sys.vel_y[i] * dt;
+			sys.pos_z[i] += sys.vel_z[i] * dt;
+		}
+	});
+}
+
+static void rebuild_and_evaluate(NBodySystem& sys) {
+	nbody_clock::time_point start = nbody_clock::now();
+	nbody_build_tree(sys);
+	sys.build_ms = elapsed_ms(start);
+
+	start = nbody_clock::now();
+	nbody_compute_forces(sys);
+	sys.force_ms = elapsed_ms(start);
+}
+
+void nbody_init(NBodySystem& sys) {
+	rebuild_and_evaluate(sys);
+}
+
+void nbody_step(NBodySystem& sys, float dt) {
+	nbody_clock::time_point start = nbody_clock::now();
+	kick(sys, 0.5f * dt);
+	drift(sys, dt);
+	rebuild_and_evaluate(sys);
+	kick(sys, 0.5f * dt);
+	sys.step_ms = elapsed_ms(start);
+}
+
+void nbody_write_positions(const NBodySystem& sys, float units_per_au, float* out_x, float* out_y, float* out_z, size_t stride) {
+	for (size_t i = 0; i < sys.size(); i++) {
+		out_x[i * stride] = sys.pos_x[i] * units_per_au;
+		out_y[i * stride] = sys.pos_y[i] * units_per_au;
+		out_z[i * stride] = sys.pos_z[i] * units_per_au;
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Benchmark
+// ------------------------------------------------------------------------------------------
+void nbody_benchmark(size_t max_count) {
+	int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> thread_counts;
+	for (int t = 1; t < hardware; t *= 2) thread_counts.push_back(t);
+	thread_counts.push_back(hardware);
+
+	printf("Barnes-Hut N-body: theta 0.5, leaf size %d, %d hardware threads\n", NBODY_LEAF_SIZE, hardware);
+	printf("  %10s %8s %10s %10s %10s %12s %8s\n", "particles", "threads", "build ms", "force ms", "step ms", "Mpart/s", "speedup");
+	for (size_t count = 10000; count <= max_count; count *= 10) {
+		double single_step = 0.0;
+		for (size_t k = 0; k < thread_counts.size(); k++) {
+			NBodySystem sys;
+			jobs_init(thread_counts[k]);
+			sys.num_threads = thread_counts[k];
+			nbody_generate_disk(sys, count, 1.0f, 5.0f, 1e-3f, 7);
+			nbody_init(sys);
+
+			const int steps = 3;
+			double build = 0.0, force = 0.0, step = 0.0;
+			for (int s = 0; s < steps; s++) {
+				nbody_step(sys, 1.0f);
+				build += sys.build_ms; force += sys.force_ms; step += sys.step_ms;
+			}
+			build /= steps; force /= steps; step /= steps;
+			if (k == 0) single_step = step;
+
+			printf("  %10u %8d %10.2f %10.2f %10.2f %12.2f %7.2fx\n", (unsigned int)count, sys.num_threads,
+				build, force, step, count / (step * 1000.0), single_step / step);
+		}
+	}
+	jobs_shutdown();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Gravitational constant in AU^3 / (solar mass * day^2)
+#define NBODY_G 2.9591220828559e-4
+// Particles per octree leaf
+#define NBODY_LEAF_SIZE 8
+#define NBODY_MAX_DEPTH 21
+
+// Octree cell. Leaves reference a range of the Morton-ordered particle arrays.
+struct NBodyNode {
+	float com_x, com_y, com_z, mass; //center of mass
+	float cx, cy, cz, half; //cube center and half size
+	int child[8]; //-1 when empty
+	int start, count; //particle range in sorted order
+	int is_leaf;
+};
+
+// Barnes-Hut gravitational N-body system: particles in structure-of-arrays,
+// an octree rebuilt every step in parallel and a kick-drift-kick leapfrog.
+// Units: AU, days and solar masses.
+struct NBodySystem {
+	std::vector<float> pos_x, pos_y, pos_z;
+	std::vector<float> vel_x, vel_y, vel_z;
+	std::vector<float> acc_x, acc_y, acc_z;
+	std::vector<float> mass;
+
+	float theta; //opening angle, smaller is more accurate
+	float softening; //AU
+	float central_mass; //fixed mass at the origin (the sun), solar masses
+	int num_threads;
+
+	//tree, rebuilt every step
+	std::vector<NBodyNode> nodes;
+	std::vector<int> order; //particle index for each sorted slot
+	std::vector<float> sorted_x, sorted_y, sorted_z, sorted_m;
+	std::vector<int> scratch; //partition buffer, same size as order
+	std::vector<unsigned char> bucket; //top-level cell of each particle
+
+	//timings of the last step, in milliseconds
+	double build_ms, force_ms, step_ms;
+
+	NBodySystem() : theta(0.5f), softening(0.01f), central_mass(1.0f), num_threads(1),
+		build_ms(0), force_ms(0), step_ms(0) {}
+
+	size_t size() const { return pos_x.size(); }
+	void add(float x, float y, float z, float vx, float vy, float vz, float m);
+};
+
+// Thin disk of 'count' particles on near-circular orbits between r_min and r_max (AU)
+void nbody_generate_disk(NBodySystem& sys, size_t count, float r_min, float r_max, float disk_mass, unsigned int seed);
+
+void nbody_build_tree(NBodySystem& sys);
+void nbody_compute_forces(NBodySystem& sys);
+
+// Computes the initial accelerations; call once after adding particles
+void nbody_init(NBodySystem& sys);
+// One leapfrog step of dt days (kick, drift, rebuild + forces, kick)
+void nbody_step(NBodySystem& sys, float dt);
+
+// Writes positions scaled to scene units with a stride in floats (see orbit_propagate)
+void nbody_write_positions(const NBodySystem& sys, float units_per_au, float* out_x, float* out_y, float* out_z, size_t stride);
+
+// Times tree build and force evaluation for particle counts up to max_count and 1..N threads
+void nbody_benchmark(size_t max_count);
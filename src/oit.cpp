@@ -0,0 +1,48 @@
+#include "oit.h"
+
+#include "glfunctions.h"
+
+void oit_create(Oit& oit) {
+	oit_destroy(oit);
+	glGenVertexArrays(1, &oit.vao);
+}
+
+void oit_destroy(Oit& oit) {
+	if (oit.vao) glDeleteVertexArrays(1, &oit.vao);
+	oit.vao = 0;
+}
+
+void oit_begin() {
+	//rgb: sums on both targets; alpha: product of (1 - alpha) on the accumulation target
+	glEnable(GL_BLEND);
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE); //both sides of a translucent shell are visible
+}
+
+void oit_composite(const Oit& oit, GLuint composite_shader, GLuint accumulation_texture, GLuint weight_texture) {
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+
+	//average colour over the scene, weighted by the coverage: src * (1 - revealage) + dst * revealage
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+	glUseProgram(composite_shader);
+	glUniform1i(glGetUniformLocation(composite_shader, "u_accumulation"), 0);
+	glUniform1i(glGetUniformLocation(composite_shader, "u_weights"), 1);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, weight_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, accumulation_texture);
+
+	gl_bindVAO(oit.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_unbindVAO();
+
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <GL/glew.h>
+
+// Weighted blended order-independent transparency (McGuire and Bavoil). Translucent
+// surfaces are drawn in any order, with depth testing against the opaque scene but no depth
+// writes, into two targets:
+//   accumulation (RGBA16F): rgb += premultiplied colour * weight, a *= 1 - alpha (revealage)
+//   weights (R16F): r += alpha * weight
+// Keeping the revealage product in the accumulation alpha lets one blend state serve both
+// targets (GL 3.3 has no per-target blend functions). The composite pass then blends the
+// weighted average colour over the scene by 1 - revealage. Translucent shaders output
+// through oitOutput(), see shader_transparency.frag. The targets come from the frame graph,
+// cleared to OIT_ACCUMULATION_CLEAR and zero.
+struct Oit {
+	GLuint vao; //empty, for the fullscreen triangle
+
+	Oit() : vao(0) {}
+};
+
+// Nothing accumulated yet, fully revealed
+#define OIT_ACCUMULATION_CLEAR { 0.0f, 0.0f, 0.0f, 1.0f }
+
+void oit_create(Oit& oit);
+void oit_destroy(Oit& oit);
+
+// Sets the blend and depth state for translucent draws into the bound targets
+void oit_begin();
+
+// Blends the translucent layers over the bound framebuffer and restores the usual state
+void oit_composite(const Oit& oit, GLuint composite_shader, GLuint accumulation_texture, GLuint weight_texture);
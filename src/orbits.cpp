@@ -0,0 +1,426 @@
+#include "orbits.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ORBIT_AVX2_TARGET
+#else
+#define ORBIT_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+#define ORBIT_PI 3.14159265358979323846
+#define ORBIT_TWO_PI 6.28318530717958647692
+
+void OrbitSet::clear() {
+	semi_major_axis.clear(); eccentricity.clear(); inclination.clear();
+	ascending_node.clear(); arg_periapsis.clear(); mean_anomaly.clear(); mean_motion.clear();
+	px.clear(); py.clear(); pz.clear();
+	qx.clear(); qy.clear(); qz.clear();
+}
+
+void OrbitSet::reserve(size_t count) {
+	semi_major_axis.reserve(count); eccentricity.reserve(count); inclination.reserve(count);
+	ascending_node.reserve(count); arg_periapsis.reserve(count); mean_anomaly.reserve(count); mean_motion.reserve(count);
+	px.reserve(count); py.reserve(count); pz.reserve(count);
+	qx.reserve(count); qy.reserve(count); qz.reserve(count);
+}
+
+// Perifocal P (towards periapsis) and Q axes in ecliptic coordinates
+static void perifocal_basis(double i, double node, double peri, double P[3], double Q[3]) {
+	double ci = cos(i), si = sin(i);
+	double cn = cos(node), sn = sin(node);
+	double cw = cos(peri), sw = sin(peri);
+	P[0] = cw * cn - sw * sn * ci; P[1] = cw * sn + sw * cn * ci; P[2] = sw * si;
+	Q[0] = -sw * cn - cw * sn * ci; Q[1] = -sw * sn + cw * cn * ci; Q[2] = cw * si;
+}
+
+size_t OrbitSet::add(float a, float e, float i, float node, float peri, float m0, float n) {
+	semi_major_axis.push_back(a);
+	eccentricity.push_back(e);
+	inclination.push_back(i);
+	ascending_node.push_back(node);
+	arg_periapsis.push_back(peri);
+	mean_anomaly.push_back(m0);
+	mean_motion.push_back(n > 0.0f ? n : orbit_mean_motion(a));
+	px.push_back(0); py.push_back(0); pz.push_back(0);
+	qx.push_back(0); qy.push_back(0); qz.push_back(0);
+
+	size_t index = size() - 1;
+	double a_units = (double)a * units_per_au;
+	double b_units = a_units * sqrt(1.0 - (double)e * e);
+	double P[3], Q[3];
+	perifocal_basis(i, node, peri, P, Q);
+
+	//Ecliptic (x, y, z-north) -> scene (x, y-up, z) = (x, z, -y)
+	px[index] = (float)(a_units * P[0]); py[index] = (float)(a_units * P[2]); pz[index] = (float)(-a_units * P[1]);
+	qx[index] = (float)(b_units * Q[0]); qy[index] = (float)(b_units * Q[2]); qz[index] = (float)(-b_units * Q[1]);
+	return index;
+}
+
+template <class T>
+static void append_array(std::vector<T>& dst, const std::vector<T>& src) {
+	dst.insert(dst.end(), src.begin(), src.end());
+}
+
+void OrbitSet::append(const OrbitSet& other) {
+	append_array(semi_major_axis, other.semi_major_axis);
+	append_array(eccentricity, other.eccentricity);
+	append_array(inclination, other.inclination);
+	append_array(ascending_node, other.ascending_node);
+	append_array(arg_periapsis, other.arg_periapsis);
+	append_array(mean_anomaly, other.mean_anomaly);
+	append_array(mean_motion, other.mean_motion);
+	append_array(px, other.px); append_array(py, other.py); append_array(pz, other.pz);
+	append_array(qx, other.qx); append_array(qy, other.qy); append_array(qz, other.qz);
+}
+
+float orbit_mean_motion(float semi_major_axis) {
+	return (float)(ORBIT_GAUSS_K / pow((double)semi_major_axis, 1.5));
+}
+
+void orbit_set_scale(OrbitSet& set, float units_per_au) {
+	OrbitSet scaled;
+	scaled.epoch = set.epoch;
+	scaled.units_per_au = units_per_au;
+	scaled.reserve(set.size());
+	for (size_t i = 0; i < set.size(); i++) {
+		scaled.add(set.semi_major_axis[i], set.eccentricity[i], set.inclination[i],
+			set.ascending_node[i], set.arg_periapsis[i], set.mean_anomaly[i], set.mean_motion[i]);
+	}
+	set = scaled;
+}
+
+void orbit_generate_belt(OrbitSet& set, size_t count, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	set.reserve(set.size() + count);
+	for (size_t i = 0; i < count; i++) {
+		float a = 2.1f + 1.2f * unit(rng);
+		float e = 0.25f * unit(rng);
+		float inc = (float)(20.0 * ORBIT_PI / 180.0) * unit(rng);
+		float node = (float)ORBIT_TWO_PI * unit(rng);
+		float peri = (float)ORBIT_TWO_PI * unit(rng);
+		float m0 = (float)ORBIT_TWO_PI * unit(rng);
+		set.add(a, e, inc, node, peri, m0);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// CPU feature detection
+// ------------------------------------------------------------------------------------------
+static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!fma || !osxsave) return false;
+	if ((_xgetbv(0) & 6) != 6) return false; //OS saves the YMM registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+int orbit_simd_level() {
+	static int level = cpu_has_avx2() ? ORBIT_SIMD_AVX2 : ORBIT_SIMD_SSE; //SSE2 is baseline on x64
+	return level;
+}
+
+const char* orbit_simd_name(int level) {
+	switch (level) {
+	case ORBIT_SIMD_AVX2: return "AVX2";
+	case ORBIT_SIMD_SSE: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Scalar reference path, also used for the tails of the SIMD loops
+// ------------------------------------------------------------------------------------------
+static void propagate_scalar(const OrbitSet& s, float dt, float* ox, float* oy, float* oz, size_t stride, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+		float e = s.eccentricity[i];
+		float M = s.mean_anomaly[i] + s.mean_motion[i] * dt;
+		M -= (float)ORBIT_TWO_PI * floorf(M * (float)(1.0 / ORBIT_TWO_PI) + 0.5f);
+
+		float E = M + 0.85f * e * (sinf(M) < 0.0f ? -1.0f : 1.0f);
+		for (int k = 0; k < ORBIT_KEPLER_ITERATIONS; k++) {
+			E -= (E - e * sinf(E) - M) / (1.0f - e * cosf(E));
+		}
+		float x = cosf(E) - e;
+		float y = sinf(E);
+
+		ox[i * stride] = s.px[i] * x + s.qx[i] * y;
+		oy[i * stride] = s.py[i] * x + s.qy[i] * y;
+		oz[i * stride] = s.pz[i] * x + s.qz[i] * y;
+	}
+}
+
+// Range reduction to [-pi/4, pi/4] by quadrants (Cody-Waite) and Cephes minimax polynomials
+#define SINCOS_2_OVER_PI 0.636619772367581343f
+#define SINCOS_DP1 1.5703125f
+#define SINCOS_DP2 4.837512969970703125e-4f
+#define SINCOS_DP3 7.54978995489188216e-8f
+#define SINCOS_S1 -1.6666654611e-1f
+#define SINCOS_S2 8.3321608736e-3f
+#define SINCOS_S3 -1.9515295891e-4f
+#define SINCOS_C1 4.166664568298827e-2f
+#define SINCOS_C2 -1.388731625493765e-3f
+#define SINCOS_C3 2.443315711809948e-5f
+
+// ------------------------------------------------------------------------------------------
+// SSE2 path, 4 bodies per iteration
+// ------------------------------------------------------------------------------------------
+static inline __m128 round_sse(__m128 x) {
+	return _mm_cvtepi32_ps(_mm_cvtps_epi32(x));
+}
+
+static inline void sincos_sse(__m128 x, __m128* s, __m128* c) {
+	__m128 q = round_sse(_mm_mul_ps(x, _mm_set1_ps(SINCOS_2_OVER_PI)));
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(SINCOS_DP1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(SINCOS_DP2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(SINCOS_DP3)));
+	__m128 z = _mm_mul_ps(r, r);
+
+	__m128 ps = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(SINCOS_S3)), _mm_set1_ps(SINCOS_S2));
+	ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(SINCOS_S1));
+	ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), r), r);
+
+	__m128 pc = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(SINCOS_C3)), _mm_set1_ps(SINCOS_C2));
+	pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(SINCOS_C1));
+	pc = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(pc, z), z), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, _mm_set1_ps(0.5f))));
+
+	//quadrant = q mod 4, computed in float
+	__m128 quad = _mm_sub_ps(q, _mm_mul_ps(_mm_set1_ps(4.0f), round_sse(_mm_mul_ps(_mm_sub_ps(q, _mm_set1_ps(1.5f)), _mm_set1_ps(0.25f)))));
+	__m128 odd = _mm_or_ps(_mm_cmpeq_ps(quad, _mm_set1_ps(1.0f)), _mm_cmpeq_ps(quad, _mm_set1_ps(3.0f)));
+	__m128 sin_neg = _mm_and_ps(_mm_cmpge_ps(quad, _mm_set1_ps(2.0f)), _mm_set1_ps(-0.0f));
+	__m128 cos_neg = _mm_and_ps(_mm_or_ps(_mm_cmpeq_ps(quad, _mm_set1_ps(1.0f)), _mm_cmpeq_ps(quad, _mm_set1_ps(2.0f))), _mm_set1_ps(-0.0f));
+
+	__m128 sv = _mm_or_ps(_mm_and_ps(odd, pc), _mm_andnot_ps(odd, ps));
+	__m128 cv = _mm_or_ps(_mm_and_ps(odd, ps), _mm_andnot_ps(odd, pc));
+	*s = _mm_xor_ps(sv, sin_neg);
+	*c = _mm_xor_ps(cv, cos_neg);
+}
+
+static void propagate_sse(const OrbitSet& st, float dt, float* ox, float* oy, float* oz, size_t stride, size_t begin, size_t end) {
+	const __m128 two_pi = _mm_set1_ps((float)ORBIT_TWO_PI);
+	const __m128 inv_two_pi = _mm_set1_ps((float)(1.0 / ORBIT_TWO_PI));
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	const __m128 dt_v = _mm_set1_ps(dt);
+	float tmp[3][4];
+
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 e = _mm_loadu_ps(&st.eccentricity[i]);
+		__m128 M = _mm_add_ps(_mm_loadu_ps(&st.mean_anomaly[i]), _mm_mul_ps(_mm_loadu_ps(&st.mean_motion[i]), dt_v));
+		M = _mm_sub_ps(M, _mm_mul_ps(two_pi, round_sse(_mm_mul_ps(M, inv_two_pi))));
+
+		//Danby's starting guess E0 = M + 0.85 e sign(sin M); sin M has the sign of M in [-pi, pi]
+		__m128 guess = _mm_or_ps(_mm_mul_ps(_mm_set1_ps(0.85f), e), _mm_and_ps(M, sign_mask));
+		__m128 E = _mm_add_ps(M, guess);
+		__m128 sE, cE;
+		for (int k = 0; k < ORBIT_KEPLER_ITERATIONS; k++) {
+			sincos_sse(E, &sE, &cE);
+			__m128 f = _mm_sub_ps(_mm_sub_ps(E, _mm_mul_ps(e, sE)), M);
+			__m128 fp = _mm_sub_ps(one, _mm_mul_ps(e, cE));
+			E = _mm_sub_ps(E, _mm_div_ps(f, fp));
+		}
+		sincos_sse(E, &sE, &cE);
+		__m128 x = _mm_sub_ps(cE, e);
+
+		__m128 rx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&st.px[i]), x), _mm_mul_ps(_mm_loadu_ps(&st.qx[i]), sE));
+		__m128 ry = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&st.py[i]), x), _mm_mul_ps(_mm_loadu_ps(&st.qy[i]), sE));
+		__m128 rz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&st.pz[i]), x), _mm_mul_ps(_mm_loadu_ps(&st.qz[i]), sE));
+
+		if (stride == 1) {
+			_mm_storeu_ps(ox + i, rx);
+			_mm_storeu_ps(oy + i, ry);
+			_mm_storeu_ps(oz + i, rz);
+		}
+		else {
+			_mm_storeu_ps(tmp[0], rx);
+			_mm_storeu_ps(tmp[1], ry);
+			_mm_storeu_ps(tmp[2], rz);
+			for (int l = 0; l < 4; l++) {
+				ox[(i + l) * stride] = tmp[0][l];
+				oy[(i + l) * stride] = tmp[1][l];
+				oz[(i + l) * stride] = tmp[2][l];
+			}
+		}
+	}
+	propagate_scalar(st, dt, ox, oy, oz, stride, i, end);
+}
+
+// ------------------------------------------------------------------------------------------
+// AVX2 + FMA path, 8 bodies per iteration
+// ------------------------------------------------------------------------------------------
+ORBIT_AVX2_TARGET static inline __m256 round_avx(__m256 x) {
+	return _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+ORBIT_AVX2_TARGET static inline void sincos_avx(__m256 x, __m256* s, __m256* c) {
+	__m256 q = round_avx(_mm256_mul_ps(x, _mm256_set1_ps(SINCOS_2_OVER_PI)));
+	__m256 r = _mm256_fnmadd_ps(q, _mm256_set1_ps(SINCOS_DP1), x);
+	r = _mm256_fnmadd_ps(q, _mm256_set1_ps(SINCOS_DP2), r);
+	r = _mm256_fnmadd_ps(q, _mm256_set1_ps(SINCOS_DP3), r);
+	__m256 z = _mm256_mul_ps(r, r);
+
+	__m256 ps = _mm256_fmadd_ps(z, _mm256_set1_ps(SINCOS_S3), _mm256_set1_ps(SINCOS_S2));
+	ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(SINCOS_S1));
+	ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), r, r);
+
+	__m256 pc = _mm256_fmadd_ps(z, _mm256_set1_ps(SINCOS_C3), _mm256_set1_ps(SINCOS_C2));
+	pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(SINCOS_C1));
+	pc = _mm256_fmadd_ps(_mm256_mul_ps(pc, z), z, _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), _mm256_set1_ps(1.0f)));
+
+	__m256 quad = _mm256_fnmadd_ps(_mm256_set1_ps(4.0f), _mm256_floor_ps(_mm256_mul_ps(q, _mm256_set1_ps(0.25f))), q);
+	__m256 odd = _mm256_or_ps(_mm256_cmp_ps(quad, _mm256_set1_ps(1.0f), _CMP_EQ_OQ), _mm256_cmp_ps(quad, _mm256_set1_ps(3.0f), _CMP_EQ_OQ));
+	__m256 sin_neg = _mm256_and_ps(_mm256_cmp_ps(quad, _mm256_set1_ps(2.0f), _CMP_GE_OQ), _mm256_set1_ps(-0.0f));
+	__m256 cos_neg = _mm256_and_ps(_mm256_or_ps(_mm256_cmp_ps(quad, _mm256_set1_ps(1.0f), _CMP_EQ_OQ),
+		_mm256_cmp_ps(quad, _mm256_set1_ps(2.0f), _CMP_EQ_OQ)), _mm256_set1_ps(-0.0f));
+
+	*s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, odd), sin_neg);
+	*c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, odd), cos_neg);
+}
+
+ORBIT_AVX2_TARGET static void propagate_avx2(const OrbitSet& st, float dt, float* ox, float* oy, float* oz, size_t stride, size_t begin, size_t end) {
+	const __m256 two_pi = _mm256_set1_ps((float)ORBIT_TWO_PI);
+	const __m256 inv_two_pi = _mm256_set1_ps((float)(1.0 / ORBIT_TWO_PI));
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+	const __m256 dt_v = _mm256_set1_ps(dt);
+	float tmp[3][8];
+
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 e = _mm256_loadu_ps(&st.eccentricity[i]);
+		__m256 M = _mm256_fmadd_ps(_mm256_loadu_ps(&st.mean_motion[i]), dt_v, _mm256_loadu_ps(&st.mean_anomaly[i]));
+		M = _mm256_fnmadd_ps(two_pi, round_avx(_mm256_mul_ps(M, inv_two_pi)), M);
+
+		__m256 guess = _mm256_or_ps(_mm256_mul_ps(_mm256_set1_ps(0.85f), e), _mm256_and_ps(M, sign_mask));
+		__m256 E = _mm256_add_ps(M, guess);
+		__m256 sE, cE;
+		for (int k = 0; k < ORBIT_KEPLER_ITERATIONS; k++) {
+			sincos_avx(E, &sE, &cE);
+			__m256 f = _mm256_sub_ps(_mm256_fnmadd_ps(e, sE, E), M);
+			__m256 fp = _mm256_fnmadd_ps(e, cE, one);
+			E = _mm256_sub_ps(E, _mm256_div_ps(f, fp));
+		}
+		sincos_avx(E, &sE, &cE);
+		__m256 x = _mm256_sub_ps(cE, e);
+
+		__m256 rx = _mm256_fmadd_ps(_mm256_loadu_ps(&st.px[i]), x, _mm256_mul_ps(_mm256_loadu_ps(&st.qx[i]), sE));
+		__m256 ry = _mm256_fmadd_ps(_mm256_loadu_ps(&st.py[i]), x, _mm256_mul_ps(_mm256_loadu_ps(&st.qy[i]), sE));
+		__m256 rz = _mm256_fmadd_ps(_mm256_loadu_ps(&st.pz[i]), x, _mm256_mul_ps(_mm256_loadu_ps(&st.qz[i]), sE));
+
+		if (stride == 1) {
+			_mm256_storeu_ps(ox + i, rx);
+			_mm256_storeu_ps(oy + i, ry);
+			_mm256_storeu_ps(oz + i, rz);
+		}
+		else {
+			_mm256_storeu_ps(tmp[0], rx);
+			_mm256_storeu_ps(tmp[1], ry);
+			_mm256_storeu_ps(tmp[2], rz);
+			for (int l = 0; l < 8; l++) {
+				ox[(i + l) * stride] = tmp[0][l];
+				oy[(i + l) * stride] = tmp[1][l];
+				oz[(i + l) * stride] = tmp[2][l];
+			}
+		}
+	}
+	propagate_scalar(st, dt, ox, oy, oz, stride, i, end);
+}
+
+void orbit_propagate(const OrbitSet& set, double t, float* out_x, float* out_y, float* out_z,
+	size_t stride, size_t begin, size_t end, int simd_level) {
+	if (end > set.size()) end = set.size();
+	if (begin >= end) return;
+	if (simd_level < 0 || simd_level > orbit_simd_level()) simd_level = orbit_simd_level();
+
+	float dt = (float)(t - set.epoch);
+	switch (simd_level) {
+	case ORBIT_SIMD_AVX2: propagate_avx2(set, dt, out_x, out_y, out_z, stride, begin, end); break;
+	case ORBIT_SIMD_SSE: propagate_sse(set, dt, out_x, out_y, out_z, stride, begin, end); break;
+	default: propagate_scalar(set, dt, out_x, out_y, out_z, stride, begin, end);
+	}
+}
+
+void orbit_propagate(const OrbitSet& set, double t, float* out_x, float* out_y, float* out_z, size_t stride) {
+	orbit_propagate(set, t, out_x, out_y, out_z, stride, 0, set.size());
+}
+
+void orbit_propagate_double(const OrbitSet& set, double t, double* out_x, double* out_y, double* out_z, size_t stride) {
+	double dt = t - set.epoch;
+	for (size_t i = 0; i < set.size(); i++) {
+		double e = set.eccentricity[i];
+		double M = set.mean_anomaly[i] + set.mean_motion[i] * dt;
+		M -= ORBIT_TWO_PI * floor(M / ORBIT_TWO_PI + 0.5);
+
+		//Newton until converged to double precision
+		double E = M + 0.85 * e * (sin(M) < 0.0 ? -1.0 : 1.0);
+		for (int k = 0; k < 32; k++) {
+			double step = (E - e * sin(E) - M) / (1.0 - e * cos(E));
+			E -= step;
+			if (fabs(step) < 1e-15) break;
+		}
+
+		double a_units = (double)set.semi_major_axis[i] * set.units_per_au;
+		double x = a_units * (cos(E) - e);
+		double y = a_units * sqrt(1.0 - e * e) * sin(E);
+		double P[3], Q[3];
+		perifocal_basis(set.inclination[i], set.ascending_node[i], set.arg_periapsis[i], P, Q);
+
+		//Ecliptic (x, y, z-north) -> scene (x, y-up, z) = (x, z, -y)
+		out_x[i * stride] = P[0] * x + Q[0] * y;
+		out_y[i * stride] = P[2] * x + Q[2] * y;
+		out_z[i * stride] = -(P[1] * x + Q[1] * y);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Benchmark
+// ------------------------------------------------------------------------------------------
+void orbit_benchmark(size_t count) {
+	OrbitSet belt;
+	orbit_generate_belt(belt, count, 1234);
+
+	std::vector<float> reference(count * 3);
+	std::vector<float> positions(count * 3);
+	orbit_propagate(belt, 100.0, &reference[0], &reference[1], &reference[2], 3, 0, count, ORBIT_SIMD_SCALAR);
+
+	printf("Kepler propagator: %u bodies, %d Newton iterations\n", (unsigned int)count, ORBIT_KEPLER_ITERATIONS);
+	for (int level = ORBIT_SIMD_SCALAR; level <= orbit_simd_level(); level++) {
+		int passes = 0;
+		double elapsed = 0.0;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		while (elapsed < 1.0 || passes < 3) {
+			orbit_propagate(belt, 100.0 + passes, &positions[0], &positions[1], &positions[2], 3, 0, count, level);
+			passes++;
+			elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		//Accuracy check against the scalar reference (same time)
+		orbit_propagate(belt, 100.0, &positions[0], &positions[1], &positions[2], 3, 0, count, level);
+		float max_error = 0.0f;
+		for (size_t i = 0; i < count * 3; i++) {
+			float error = fabsf(positions[i] - reference[i]);
+			if (error > max_error) max_error = error;
+		}
+
+		printf("  %-6s %8.2f Mbodies/s per core (max deviation from scalar %.2e AU)\n",
+			orbit_simd_name(level), count * (double)passes / elapsed / 1.0e6, max_error);
+	}
+}
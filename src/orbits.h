@@ -0,0 +1,72 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Gaussian gravitational constant: mean motion (rad/day) of a 1 AU orbit around the Sun
+#define ORBIT_GAUSS_K 0.01720209895
+// Newton steps used by the batched Kepler solver (converges to float precision for e < 0.95)
+#define ORBIT_KEPLER_ITERATIONS 6
+
+enum OrbitSimdLevel {
+	ORBIT_SIMD_SCALAR = 0,
+	ORBIT_SIMD_SSE = 1,
+	ORBIT_SIMD_AVX2 = 2
+};
+
+// Classical Keplerian elements of bodies orbiting the same primary, stored as
+// structure-of-arrays so the propagator can stream them through SIMD registers.
+// Elements are ecliptic J2000: angles in radians, distances in AU, time in days.
+struct OrbitSet {
+	std::vector<float> semi_major_axis;
+	std::vector<float> eccentricity;
+	std::vector<float> inclination;
+	std::vector<float> ascending_node;
+	std::vector<float> arg_periapsis;
+	std::vector<float> mean_anomaly; //at epoch
+	std::vector<float> mean_motion; //rad/day
+
+	//Perifocal basis scaled to scene units (a*P and b*Q), rotated into the y-up scene frame.
+	//This is all the propagator reads besides mean_anomaly, mean_motion and eccentricity.
+	std::vector<float> px, py, pz;
+	std::vector<float> qx, qy, qz;
+
+	double epoch; //days
+	float units_per_au; //scene units per AU
+
+	OrbitSet() : epoch(0.0), units_per_au(1.0f) {}
+
+	size_t size() const { return eccentricity.size(); }
+	void clear();
+	void reserve(size_t count);
+
+	//Adds a body and returns its index. A mean motion of 0 is derived from the semi-major axis.
+	size_t add(float a, float e, float i, float node, float peri, float m0, float n = 0.0f);
+	//Appends all bodies of a set built with the same epoch and scale
+	void append(const OrbitSet& other);
+};
+
+float orbit_mean_motion(float semi_major_axis);
+void orbit_set_scale(OrbitSet& set, float units_per_au);
+
+// Fills the set with 'count' random main-belt-like orbits (a 2.1-3.3 AU, e < 0.25, i < 20 deg)
+void orbit_generate_belt(OrbitSet& set, size_t count, unsigned int seed);
+
+int orbit_simd_level(); //best level supported by this CPU
+const char* orbit_simd_name(int level);
+
+// Solves Kepler's equation for bodies [begin, end) at time t (days) and writes the
+// positions to out_x/out_y/out_z with a stride in floats, so the output can go straight
+// into a render buffer: stride 1 for separate arrays, 3 for vec3 arrays, or 16 with
+// out_x = &models[0][3][0] to write the translation column of a mat4 array.
+// simd_level < 0 picks the best level available.
+void orbit_propagate(const OrbitSet& set, double t, float* out_x, float* out_y, float* out_z,
+	size_t stride, size_t begin, size_t end, int simd_level = -1);
+void orbit_propagate(const OrbitSet& set, double t, float* out_x, float* out_y, float* out_z, size_t stride);
+
+// Scalar double-precision version for the few bodies that need it (planets at real scale,
+// where float positions would be off by hundreds of km). Basis recomputed from the elements.
+void orbit_propagate_double(const OrbitSet& set, double t, double* out_x, double* out_y, double* out_z, size_t stride);
+
+// Propagates a synthetic belt of 'count' bodies with every supported SIMD level and
+// prints the throughput in bodies/second on one core.
+void orbit_benchmark(size_t count);
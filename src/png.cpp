@@ -0,0 +1,124 @@
+#include "png.h"
+
+static unsigned int crc_table[256];
+static bool crc_table_ready = false;
+
+static void make_crc_table() {
+	for (unsigned int n = 0; n < 256; n++) {
+		unsigned int c = n;
+		for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+	crc_table_ready = true;
+}
+
+static unsigned int crc_update(unsigned int crc, const unsigned char* data, size_t size) {
+	for (size_t i = 0; i < size; i++) crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void put_u32(std::vector<unsigned char>& out, unsigned int v) {
+	out.push_back((unsigned char)(v >> 24));
+	out.push_back((unsigned char)(v >> 16));
+	out.push_back((unsigned char)(v >> 8));
+	out.push_back((unsigned char)v);
+}
+
+// 'data' starts with 8 bytes of room for the length and type, filled in here
+static void put_chunk(PngWriter& png, const char* type, std::vector<unsigned char>& data) {
+	unsigned int length = (unsigned int)data.size() - 8;
+	data[0] = (unsigned char)(length >> 24);
+	data[1] = (unsigned char)(length >> 16);
+	data[2] = (unsigned char)(length >> 8);
+	data[3] = (unsigned char)length;
+	for (int i = 0; i < 4; i++) data[4 + i] = (unsigned char)type[i];
+	put_u32(data, crc_update(0xffffffffu, &data[4], data.size() - 4) ^ 0xffffffffu);
+	if (fwrite(&data[0], 1, data.size(), png.file) != data.size()) png.failed = true;
+}
+
+// The pending bytes as stored blocks in one IDAT chunk; the zlib header goes in front of
+// the first, the Adler-32 after the last
+static void flush(PngWriter& png, bool last) {
+	std::vector<unsigned char>& chunk = png.chunk;
+	chunk.assign(8, 0);
+	if (!png.zlib_started) {
+		chunk.push_back(0x78);
+		chunk.push_back(0x01);
+		png.zlib_started = true;
+	}
+	size_t pos = 0;
+	do {
+		size_t len = png.pending.size() - pos < 65535 ? png.pending.size() - pos : 65535;
+		bool final_block = last && pos + len == png.pending.size();
+		chunk.push_back(final_block ? 1 : 0);
+		chunk.push_back((unsigned char)len);
+		chunk.push_back((unsigned char)(len >> 8));
+		chunk.push_back((unsigned char)~len);
+		chunk.push_back((unsigned char)(~len >> 8));
+		chunk.insert(chunk.end(), png.pending.begin() + pos, png.pending.begin() + pos + len);
+		pos += len;
+	} while (pos < png.pending.size());
+	if (last) put_u32(chunk, (png.adler_b << 16) | png.adler_a);
+	put_chunk(png, "IDAT", chunk);
+	png.pending.clear();
+}
+
+bool png_begin(PngWriter& png, const char* path, int width, int height) {
+	if (!crc_table_ready) make_crc_table();
+	png.file = fopen(path, "wb");
+	if (!png.file) return false;
+	png.width = width;
+	png.height = height;
+	png.rows = 0;
+	png.adler_a = 1;
+	png.adler_b = 0;
+	png.zlib_started = false;
+	png.failed = false;
+	png.pending.clear();
+	png.pending.reserve(PNG_CHUNK_BYTES + 1 + width * 3);
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(signature, 1, 8, png.file);
+	std::vector<unsigned char> header(8, 0);
+	put_u32(header, (unsigned int)width);
+	put_u32(header, (unsigned int)height);
+	header.push_back(8); //bits per channel
+	header.push_back(2); //RGB
+	header.push_back(0); //deflate
+	header.push_back(0); //adaptive filtering, every row filter 0 here
+	header.push_back(0); //not interlaced
+	put_chunk(png, "IHDR", header);
+	return !png.failed;
+}
+
+void png_write_row(PngWriter& png, const unsigned char* rgba) {
+	size_t start = png.pending.size();
+	png.pending.push_back(0); //filter: none
+	for (int x = 0; x < png.width; x++, rgba += 4) {
+		png.pending.push_back(rgba[0]);
+		png.pending.push_back(rgba[1]);
+		png.pending.push_back(rgba[2]);
+	}
+	//Adler-32, reduced every 4096 bytes (the sums cannot overflow before 5552)
+	unsigned int a = png.adler_a, b = png.adler_b;
+	for (size_t i = start; i < png.pending.size(); i++) {
+		a += png.pending[i];
+		b += a;
+		if ((i - start) % 4096 == 4095) { a %= 65521; b %= 65521; }
+	}
+	png.adler_a = a % 65521;
+	png.adler_b = b % 65521;
+	png.rows++;
+	if (png.pending.size() >= PNG_CHUNK_BYTES) flush(png, false);
+}
+
+bool png_end(PngWriter& png) {
+	if (!png.file) return false;
+	flush(png, true);
+	std::vector<unsigned char> end(8, 0);
+	put_chunk(png, "IEND", end);
+	bool ok = !png.failed && png.rows == png.height && ferror(png.file) == 0;
+	fclose(png.file);
+	png.file = NULL;
+	return ok;
+}
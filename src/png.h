@@ -0,0 +1,28 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+// Raw bytes per IDAT chunk; each chunk holds whole stored deflate blocks
+#define PNG_CHUNK_BYTES (16 * 65535)
+
+// Streaming PNG writer, 8-bit RGB. Rows are appended top to bottom and written out as they
+// come, in IDAT chunks of stored (uncompressed) deflate blocks, so memory stays at one chunk
+// whatever the image size and writing is bounded by the disk rather than by compression.
+struct PngWriter {
+	FILE* file;
+	int width, height;
+	int rows; //appended so far
+	unsigned int adler_a, adler_b; //Adler-32 of everything appended
+	std::vector<unsigned char> pending; //filtered rows not yet written
+	std::vector<unsigned char> chunk; //scratch for the chunk being written
+	bool zlib_started; //the zlib header went out with the first IDAT
+	bool failed;
+
+	PngWriter() : file(NULL), width(0), height(0), rows(0), adler_a(1), adler_b(0), zlib_started(false), failed(false) {}
+};
+
+bool png_begin(PngWriter& png, const char* path, int width, int height);
+// One row of 'width' RGBA pixels, alpha dropped
+void png_write_row(PngWriter& png, const unsigned char* rgba);
+// Writes what is left and closes the file; false if anything failed or rows are missing
+bool png_end(PngWriter& png);
@@ -0,0 +1,139 @@
+#include "poster.h"
+
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+#include "png.h"
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int poster_tile_size(int requested) {
+	GLint max_texture = 0, max_viewport[2] = { 0, 0 };
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+	int size = requested;
+	if (max_texture > 0 && size > max_texture) size = max_texture;
+	if (max_viewport[0] > 0 && size > max_viewport[0]) size = max_viewport[0];
+	if (max_viewport[1] > 0 && size > max_viewport[1]) size = max_viewport[1];
+	return size > 1 ? size : 1;
+}
+
+glm::mat4 poster_tile_projection(const glm::mat4& projection, int width, int height, int x, int y, int tile_size) {
+	//x_ndc' = x_ndc * width / tile_size + offset, taking the tile's NDC range to [-1, 1];
+	//applied to clip coordinates, the offset is multiplied by w
+	glm::mat4 tile(1.0f);
+	tile[0][0] = (float)width / tile_size;
+	tile[1][1] = (float)height / tile_size;
+	tile[3][0] = (float)(width - 2 * x - tile_size) / tile_size;
+	tile[3][1] = (float)(height - 2 * y - tile_size) / tile_size;
+	return tile * projection;
+}
+
+struct PendingTile {
+	int slot;
+	int x, y; //lower left corner in the image, GL pixel coordinates
+	GLsync fence;
+};
+
+// Copies the part of a read-back tile that lies inside the image into the band, whose first
+// row is image row band_top (counted from the top)
+static void copy_tile(const PendingTile& tile, GLuint pbo, int width, int height, int tile_size, int band_top,
+	std::vector<unsigned char>& band) {
+	while (glClientWaitSync(tile.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+	glDeleteSync(tile.fence);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+		(GLsizeiptr)tile_size * tile_size * 4, GL_MAP_READ_BIT);
+	if (pixels) {
+		int columns = width - tile.x < tile_size ? width - tile.x : tile_size;
+		for (int row = tile.y < 0 ? -tile.y : 0; row < tile_size && tile.y + row < height; row++) {
+			int band_row = height - 1 - (tile.y + row) - band_top;
+			memcpy(&band[((size_t)band_row * width + tile.x) * 4], pixels + (size_t)row * tile_size * 4, (size_t)columns * 4);
+		}
+	}
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool poster_render(const char* path, int width, int height, int tile_size, const glm::mat4& projection,
+	const PosterRenderTile& render, PosterStats& stats) {
+	PngWriter png;
+	if (!png_begin(png, path, width, height)) {
+		printf("Poster: cannot open %s\n", path);
+		return false;
+	}
+
+	GLuint target, fbo, pbos[POSTER_PBO_COUNT];
+	glGenTextures(1, &target);
+	glBindTexture(GL_TEXTURE_2D, target);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tile_size, tile_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGenBuffers(POSTER_PBO_COUNT, pbos);
+	for (int i = 0; i < POSTER_PBO_COUNT; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)tile_size * tile_size * 4, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	int tiles_x = (width + tile_size - 1) / tile_size, tiles_y = (height + tile_size - 1) / tile_size;
+	std::vector<unsigned char> band((size_t)tile_size * width * 4);
+	stats = PosterStats();
+	stats.band_bytes = (long long)band.size();
+	stats.tile_bytes = (long long)tile_size * tile_size * 4;
+
+	//tile k is read back while tile k + 1 renders; a band is written once its last tile is in
+	int count = tiles_x * tiles_y;
+	std::vector<PendingTile> tiles(count);
+	for (int k = 0; k <= count; k++) {
+		if (k < count) {
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			PendingTile& tile = tiles[k];
+			tile.slot = k % POSTER_PBO_COUNT;
+			tile.x = (k % tiles_x) * tile_size;
+			tile.y = height - (k / tiles_x + 1) * tile_size; //bands from the top, the last one may hang below 0
+			render(poster_tile_projection(projection, width, height, tile.x, tile.y, tile_size), target);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[tile.slot]);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, tile_size, tile_size, GL_RGBA, GL_UNSIGNED_BYTE, 0); //returns at once, into the buffer
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			tile.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			stats.render_ms += elapsed_ms(start);
+			stats.tiles++;
+		}
+		if (k == 0) continue;
+
+		const PendingTile& done = tiles[k - 1];
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		int band_top = height - done.y - tile_size;
+		copy_tile(done, pbos[done.slot], width, height, tile_size, band_top, band);
+		stats.readback_ms += elapsed_ms(start);
+
+		//the band's last tile: append its rows
+		if (k % tiles_x == 0) {
+			start = std::chrono::high_resolution_clock::now();
+			int rows = height - band_top < tile_size ? height - band_top : tile_size;
+			for (int row = 0; row < rows; row++) png_write_row(png, &band[(size_t)row * width * 4]);
+			stats.write_ms += elapsed_ms(start);
+		}
+	}
+
+	glDeleteBuffers(POSTER_PBO_COUNT, pbos);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &target);
+	bool ok = png_end(png);
+	if (!ok) printf("Poster: writing %s failed\n", path);
+	return ok;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <functional>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Tiles are read back through this many pixel pack buffers: the next tile renders while
+// the last one is copied out
+#define POSTER_PBO_COUNT 2
+
+// Tiled still rendering, for images larger than any framebuffer. The image is cut into
+// square tiles of tile_size pixels; each is rendered into one tile_size texture with an
+// off-center sub-frustum of the full projection, which scales and shifts clip space so the
+// tile's part of the image fills the viewport. Edge tiles are rendered whole and cropped.
+// Tiles go row band by row band, top first, and each finished band is appended to a PNG,
+// so memory is one tile on the GPU plus one band of the image on the CPU.
+//
+// Screen-space effects that reach across tile edges (bloom) would show seams; the caller
+// turns them off.
+typedef std::function<void(const glm::mat4& tile_projection, GLuint target)> PosterRenderTile;
+
+struct PosterStats {
+	int tiles;
+	long long band_bytes, tile_bytes; //CPU band, GPU target
+	double render_ms; //submitting the tiles
+	double readback_ms; //waiting for and copying the tiles
+	double write_ms;
+
+	PosterStats() : tiles(0), band_bytes(0), tile_bytes(0), render_ms(0.0), readback_ms(0.0), write_ms(0.0) {}
+};
+
+// Largest tile the GL can render to, at most 'requested'
+int poster_tile_size(int requested);
+
+// Off-center sub-frustum: 'projection' narrowed to the tile_size square whose lower left
+// corner is (x, y) in the width x height image (GL pixel coordinates, y up)
+glm::mat4 poster_tile_projection(const glm::mat4& projection, int width, int height, int x, int y, int tile_size);
+
+// Renders every tile with 'render', which draws the frame into 'target' (a tile_size RGBA8
+// texture) with 'tile_projection', and writes the image to 'path'
+bool poster_render(const char* path, int width, int height, int tile_size, const glm::mat4& projection,
+	const PosterRenderTile& render, PosterStats& stats);
@@ -0,0 +1,169 @@
+#include "raytrace.h"
+
+#include <math.h>
+#include <float.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "jobs.h"
+
+static const float RAYTRACE_PI = 3.14159265358979f;
+
+static double now_ms() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void raytrace_clear(RaytraceScene& scene) {
+	scene.spheres.clear();
+	scene.num_bodies = 0;
+	scene.light = -1;
+	scene.materials.clear();
+	scene.to_object.clear();
+}
+
+void raytrace_add_body(RaytraceScene& scene, const glm::vec3& center, float radius, const glm::mat3& to_object, const SwMaterial& material) {
+	//bodies stay in front of the small bodies, so sphere i is body i
+	float sphere[4] = { center.x, center.y, center.z, radius };
+	scene.spheres.insert(scene.spheres.begin() + 4 * scene.num_bodies, sphere, sphere + 4);
+	scene.materials.push_back(material);
+	scene.to_object.push_back(to_object);
+	scene.num_bodies++;
+}
+
+void raytrace_add_small_body(RaytraceScene& scene, const glm::vec3& center, float radius) {
+	float sphere[4] = { center.x, center.y, center.z, radius };
+	scene.spheres.insert(scene.spheres.end(), sphere, sphere + 4);
+}
+
+static BvhSpheres scene_spheres(const RaytraceScene& scene) {
+	BvhSpheres spheres = { NULL, NULL, NULL, NULL, 4, scene.spheres.size() / 4 };
+	if (!scene.spheres.empty()) {
+		spheres.x = &scene.spheres[0];
+		spheres.y = &scene.spheres[1];
+		spheres.z = &scene.spheres[2];
+		spheres.r = &scene.spheres[3];
+	}
+	return spheres;
+}
+
+void raytrace_build(RaytraceScene& scene, RaytraceStats& stats) {
+	double start = now_ms();
+	bvh_build(scene.bvh, scene_spheres(scene));
+	stats.build_ms += now_ms() - start;
+}
+
+// Texture coordinates of a point on the unit sphere, as the sphere mesh has them: u from
+// atan(x, z), v from the latitude
+static glm::vec2 sphere_uv(const glm::vec3& n) {
+	return glm::vec2(atan2f(n.x, n.z) / (2.0f * RAYTRACE_PI) + 0.5f, asinf(glm::clamp(n.y, -1.0f, 1.0f)) / RAYTRACE_PI + 0.5f);
+}
+
+// One tile, returns the shadow rays it traced
+static long long trace_tile(const RaytraceScene& scene, const BvhSpheres& spheres, const glm::mat4& projection,
+	const glm::mat4& inverse_view, int x_begin, int y_begin, int width, int height, float exposure, std::vector<unsigned int>& rgba) {
+	glm::vec3 origin(inverse_view[3]);
+	glm::mat3 to_render(inverse_view);
+	int x_end = std::min(x_begin + RAYTRACE_TILE_SIZE, width), y_end = std::min(y_begin + RAYTRACE_TILE_SIZE, height);
+	long long shadow_rays = 0;
+
+	for (int y = y_begin; y < y_end; y += 2) {
+		for (int x = x_begin; x < x_end; x += 2) {
+			//the quad's primary rays, through the pixel centres
+			BvhPacket primary;
+			int px[4], py[4];
+			for (int k = 0; k < 4; k++) {
+				px[k] = x + (k & 1);
+				py[k] = y + (k >> 1);
+				//view space direction at z = -1, for any perspective projection with clip w = -z
+				float ndc_x = (px[k] + 0.5f) / width * 2.0f - 1.0f, ndc_y = (py[k] + 0.5f) / height * 2.0f - 1.0f;
+				glm::vec3 dir = glm::normalize(to_render * glm::vec3((ndc_x + projection[2][0]) / projection[0][0],
+					(ndc_y + projection[2][1]) / projection[1][1], -1.0f));
+				for (int a = 0; a < 3; a++) {
+					primary.origin[a][k] = origin[a];
+					primary.dir[a][k] = dir[a];
+				}
+				primary.t[k] = px[k] < x_end && py[k] < y_end ? FLT_MAX : -1.0f;
+				primary.skip_below[k] = 0;
+				primary.ignore[0][k] = primary.ignore[1][k] = -1;
+			}
+			bvh_raycast4(scene.bvh, spheres, primary);
+
+			//surface points, and a shadow ray from each lit one
+			glm::vec3 position[4], normal[4];
+			const SwMaterial* material[4];
+			BvhPacket shadow;
+			for (int k = 0; k < 4; k++) {
+				shadow.t[k] = -1.0f;
+				shadow.skip_below[k] = 0;
+				shadow.ignore[0][k] = shadow.ignore[1][k] = -1;
+				for (int a = 0; a < 3; a++) shadow.origin[a][k] = shadow.dir[a][k] = 0.0f;
+				int i = primary.hit[k];
+				if (i < 0) continue;
+				glm::vec3 dir(primary.dir[0][k], primary.dir[1][k], primary.dir[2][k]);
+				glm::vec3 center(scene.spheres[4 * i], scene.spheres[4 * i + 1], scene.spheres[4 * i + 2]);
+				position[k] = origin + dir * primary.t[k];
+				normal[k] = glm::normalize(position[k] - center);
+				material[k] = i < scene.num_bodies ? &scene.materials[i] : &scene.small_body_material;
+				if (material[k]->shader == SW_SHADER_SIMPLE) continue;
+
+				glm::vec3 to_light = material[k]->light_pos - position[k];
+				float light_distance = glm::length(to_light);
+				if (glm::dot(to_light, normal[k]) <= 0.0f) continue; //facing away, no direct light to block
+				for (int a = 0; a < 3; a++) {
+					shadow.origin[a][k] = position[k][a];
+					shadow.dir[a][k] = to_light[a] / light_distance;
+				}
+				//from the surface itself: the sphere left and the light are skipped by index, no bias
+				shadow.t[k] = light_distance;
+				shadow.skip_below[k] = i < scene.num_bodies ? scene.num_bodies : 0;
+				shadow.ignore[0][k] = i;
+				shadow.ignore[1][k] = scene.light;
+				shadow_rays++;
+			}
+			int blocked = bvh_occluded4(scene.bvh, spheres, shadow);
+
+			for (int k = 0; k < 4; k++) {
+				if (px[k] >= x_end || py[k] >= y_end) continue;
+				glm::vec3 color(0.0f);
+				int i = primary.hit[k];
+				if (i >= 0) {
+					const SwMaterial& m = *material[k];
+					glm::vec3 object_normal = i < scene.num_bodies ? scene.to_object[i] * normal[k] : normal[k];
+					float light = (blocked & (1 << k)) ? 0.0f : 1.0f;
+					if (light > 0.0f && m.shader != SW_SHADER_SIMPLE && m.occluders.count > 0) light *= swraster_eclipse_visibility(m, position[k]);
+					color = swraster_shade(m, sphere_uv(object_normal), normal[k], position[k], light);
+				}
+				rgba[(size_t)py[k] * width + px[k]] = swraster_tonemap(color, exposure);
+			}
+		}
+	}
+	return shadow_rays;
+}
+
+void raytrace_render(const RaytraceScene& scene, const glm::mat4& projection, const glm::mat4& view,
+	int width, int height, float exposure, std::vector<unsigned int>& rgba, RaytraceStats& stats) {
+	rgba.assign((size_t)width * height, 0xff000000u);
+	if (width <= 0 || height <= 0) return;
+	BvhSpheres spheres = scene_spheres(scene);
+	glm::mat4 inverse_view = glm::inverse(view);
+	int tiles_x = (width + RAYTRACE_TILE_SIZE - 1) / RAYTRACE_TILE_SIZE;
+	int tiles_y = (height + RAYTRACE_TILE_SIZE - 1) / RAYTRACE_TILE_SIZE;
+
+	std::atomic<long long> busy_us(0), shadow_rays(0);
+	double start = now_ms();
+	parallel_for(0, (size_t)tiles_x * tiles_y, 4, [&](size_t begin, size_t end) {
+		double job_start = now_ms();
+		long long count = 0;
+		for (size_t tile = begin; tile < end; tile++) {
+			count += trace_tile(scene, spheres, projection, inverse_view, (int)(tile % tiles_x) * RAYTRACE_TILE_SIZE,
+				(int)(tile / tiles_x) * RAYTRACE_TILE_SIZE, width, height, exposure, rgba);
+		}
+		shadow_rays += count;
+		busy_us += (long long)((now_ms() - job_start) * 1000.0);
+	});
+	stats.trace_ms += now_ms() - start;
+	stats.busy_ms += busy_us / 1000.0;
+	stats.primary_rays += (long long)width * height;
+	stats.shadow_rays += shadow_rays;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "swraster.h"
+
+// Pixels per job: square tiles of 2x2 quads, one ray packet per quad
+#define RAYTRACE_TILE_SIZE 16
+
+// Analytic ray tracer: every body and small body is a sphere, so the scene is intersected
+// exactly, no mesh involved. Spheres go into one BVH (bvh.h), traced four rays at a time:
+//  - primary rays through the pixel centres of a 2x2 quad, closest hit
+//  - shading as the fragment shaders do it (swraster_shade), texture coordinates from the
+//    hit normal in the body's own frame, as on the sphere mesh
+//  - one hard shadow ray per lit hit towards the light's centre. The bodies keep their soft
+//    eclipse term instead, so rays leaving a body ignore the other bodies and only the small
+//    bodies cast hard shadows on them; small bodies are shadowed by everything.
+// Tiles are traced in parallel on the job system. Shadow rays start on the surface and skip
+// the sphere they leave and the light's sphere by index, so neither can shadow the point.
+struct RaytraceScene {
+	std::vector<float> spheres; //x, y, z, r per sphere, render space: bodies first, then small bodies
+	int num_bodies;
+	int light; //the body that is the light, -1 for none
+	std::vector<SwMaterial> materials; //per body
+	std::vector<glm::mat3> to_object; //per body, render space to the mesh's frame
+	SwMaterial small_body_material;
+	Bvh bvh;
+
+	RaytraceScene() : num_bodies(0), light(-1) {}
+};
+
+struct RaytraceStats {
+	long long primary_rays, shadow_rays;
+	double build_ms, trace_ms; //BVH build, then the image
+	double busy_ms; //trace time summed over the threads, for the per-core figure
+
+	RaytraceStats() : primary_rays(0), shadow_rays(0), build_ms(0.0), trace_ms(0.0), busy_ms(0.0) {}
+};
+
+void raytrace_clear(RaytraceScene& scene);
+// Bodies first: the i-th body added is sphere i
+void raytrace_add_body(RaytraceScene& scene, const glm::vec3& center, float radius, const glm::mat3& to_object, const SwMaterial& material);
+void raytrace_add_small_body(RaytraceScene& scene, const glm::vec3& center, float radius);
+void raytrace_build(RaytraceScene& scene, RaytraceStats& stats);
+
+// Traces a width x height image into 'rgba' (RGBA8, bottom row first, tonemapped with
+// exposure). The camera is the one the projection and view describe, off-centre
+// projections (poster tiles) included; the background is black.
+void raytrace_render(const RaytraceScene& scene, const glm::mat4& projection, const glm::mat4& view,
+	int width, int height, float exposure, std::vector<unsigned int>& rgba, RaytraceStats& stats);
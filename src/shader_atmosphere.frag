@@ -0,0 +1,140 @@
+#version 330
+
+in vec2 v_uv;
+in vec3 v_normal; 
+in vec3 v_pos;
+
+out vec4 fragColor;
+
+uniform sampler2D u_transmittance;
+uniform sampler3D u_scattering;
+uniform vec3 u_eye; 
+uniform vec3 u_center; //the planet's, render space
+uniform float u_km_per_unit; //render space to the LUTs' kilometres
+uniform vec3 u_sun_dir; //unit
+uniform float u_sun_intensity; //HDR scale of the radiance
+
+//must match atmosphere.h / AtmosphereParams
+uniform float u_bottom_radius;
+uniform float u_top_radius;
+uniform vec3 u_rayleigh_scattering;
+uniform float u_mie_scattering;
+uniform float u_mie_g;
+uniform float u_mu_s_min;
+
+const int TRANSMITTANCE_W = 256;
+const int TRANSMITTANCE_H = 64;
+const int SCATTERING_R = 32;
+const int SCATTERING_MU = 128;
+const int SCATTERING_MU_S = 32;
+const int SCATTERING_NU = 8;
+const float PI = 3.14159265359;
+
+float safeSqrt(float a) { return sqrt(max(a, 0.0)); }
+float coordFromUnit(float x, int size) { return 0.5 / float(size) + x * (1.0 - 1.0 / float(size)); }
+
+float distanceToTop(float r, float mu)
+{
+	return max(0.0, -r * mu + safeSqrt(r * r * (mu * mu - 1.0) + u_top_radius * u_top_radius));
+}
+
+vec3 transmittanceToTop(float r, float mu)
+{
+	float H = sqrt(u_top_radius * u_top_radius - u_bottom_radius * u_bottom_radius);
+	float rho = safeSqrt(r * r - u_bottom_radius * u_bottom_radius);
+	float d_min = u_top_radius - r;
+	float d_max = rho + H;
+	vec2 uv = vec2(coordFromUnit((distanceToTop(r, mu) - d_min) / (d_max - d_min), TRANSMITTANCE_W),
+		coordFromUnit(rho / H, TRANSMITTANCE_H));
+	return texture(u_transmittance, uv).rgb;
+}
+
+// Between the point at (r, mu) and the one d further along the ray
+vec3 transmittance(float r, float mu, float d, bool ground)
+{
+	float r_d = clamp(sqrt(d * d + 2.0 * r * mu * d + r * r), u_bottom_radius, u_top_radius);
+	float mu_d = clamp((r * mu + d) / r_d, -1.0, 1.0);
+	vec3 ratio = ground ? transmittanceToTop(r_d, -mu_d) / transmittanceToTop(r, -mu) :
+		transmittanceToTop(r, mu) / transmittanceToTop(r_d, mu_d);
+	return min(ratio, vec3(1.0));
+}
+
+// Rayleigh in rgb, Mie's red in alpha, 4D lookup as two 3D ones blended along nu
+vec4 scattering(float r, float mu, float mu_s, float nu, bool ground)
+{
+	float H = sqrt(u_top_radius * u_top_radius - u_bottom_radius * u_bottom_radius);
+	float rho = safeSqrt(r * r - u_bottom_radius * u_bottom_radius);
+	float u_r = coordFromUnit(rho / H, SCATTERING_R);
+
+	float r_mu = r * mu;
+	float discriminant = r_mu * r_mu - r * r + u_bottom_radius * u_bottom_radius;
+	float u_mu;
+	if (ground) {
+		float d = -r_mu - safeSqrt(discriminant);
+		float d_min = r - u_bottom_radius;
+		float d_max = rho;
+		u_mu = 0.5 - 0.5 * coordFromUnit(d_max == d_min ? 0.0 : (d - d_min) / (d_max - d_min), SCATTERING_MU / 2);
+	}
+	else {
+		float d = -r_mu + safeSqrt(discriminant + H * H);
+		float d_min = u_top_radius - r;
+		float d_max = rho + H;
+		u_mu = 0.5 + 0.5 * coordFromUnit((d - d_min) / (d_max - d_min), SCATTERING_MU / 2);
+	}
+
+	float d_min = u_top_radius - u_bottom_radius;
+	float d_max = H;
+	float a = (distanceToTop(u_bottom_radius, mu_s) - d_min) / (d_max - d_min);
+	float A = (distanceToTop(u_bottom_radius, u_mu_s_min) - d_min) / (d_max - d_min);
+	float u_mu_s = coordFromUnit(max(1.0 - a / A, 0.0) / (1.0 + a), SCATTERING_MU_S);
+
+	float x = (nu + 1.0) * 0.5 * float(SCATTERING_NU - 1);
+	float cell = floor(x);
+	vec4 s0 = texture(u_scattering, vec3((cell + u_mu_s) / float(SCATTERING_NU), u_mu, u_r));
+	vec4 s1 = texture(u_scattering, vec3((cell + 1.0 + u_mu_s) / float(SCATTERING_NU), u_mu, u_r));
+	return mix(s0, s1, x - cell);
+}
+
+float rayleighPhase(float nu) { return 3.0 / (16.0 * PI) * (1.0 + nu * nu); }
+
+float miePhase(float g, float nu)
+{
+	float k = 3.0 / (8.0 * PI) * (1.0 - g * g) / (2.0 + g * g);
+	return k * (1.0 + nu * nu) / pow(1.0 + g * g - 2.0 * g * nu, 1.5);
+}
+
+void main(void)
+{
+	//the view ray in the planet's frame, in km
+	vec3 camera = (u_eye - u_center) * u_km_per_unit;
+	vec3 view = normalize(v_pos - u_eye);
+
+	//from outside, start where the ray enters the atmosphere
+	float r = length(camera);
+	float r_mu = dot(camera, view);
+	float distance_to_top = -r_mu - safeSqrt(r_mu * r_mu - r * r + u_top_radius * u_top_radius);
+	if (distance_to_top > 0.0) {
+		camera += view * distance_to_top;
+		r = u_top_radius;
+		r_mu += distance_to_top;
+	}
+	else if (r > u_top_radius) discard; //misses the atmosphere
+
+	float mu = r_mu / r;
+	float mu_s = dot(camera, u_sun_dir) / r;
+	float nu = dot(view, u_sun_dir);
+	bool ground = mu < 0.0 && r * r * (mu * mu - 1.0) + u_bottom_radius * u_bottom_radius >= 0.0;
+
+	vec4 s = scattering(r, mu, mu_s, nu, ground);
+	vec3 rayleigh = s.rgb;
+	vec3 mie = s.r > 0.0 ? s.rgb * s.a / s.r * (u_rayleigh_scattering.r / u_mie_scattering) *
+		(vec3(u_mie_scattering) / u_rayleigh_scattering) : vec3(0.0);
+	vec3 radiance = rayleigh * rayleighPhase(nu) + mie * miePhase(u_mie_g, nu);
+
+	//what is behind (the ground, or space) is dimmed by the transmittance along the ray
+	float d = ground ? -r_mu - safeSqrt(r_mu * r_mu - r * r + u_bottom_radius * u_bottom_radius) : distanceToTop(r, mu);
+	vec3 t = transmittance(r, mu, d, ground);
+
+	//blended with ONE, SRC_ALPHA: added radiance, grey transmittance
+	fragColor = vec4(radiance * u_sun_intensity, dot(t, vec3(1.0 / 3.0)));
+}
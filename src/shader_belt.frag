@@ -0,0 +1,33 @@
+#version 330
+
+in vec3 v_normal;
+in vec3 v_light;
+in vec3 v_light_view;
+
+out vec4 fragColor;
+
+uniform int u_points; //1: round point sprites, 0: rock meshes
+uniform vec3 u_color;
+uniform vec3 u_ambient;
+
+void main(void)
+{
+	vec3 N;
+	vec3 L;
+	if (u_points == 1) {
+		//sphere normal reconstructed from the sprite coordinate, in view space
+		vec2 p = gl_PointCoord * 2.0 - 1.0;
+		p.y = -p.y;
+		float r2 = dot(p, p);
+		if (r2 > 1.0) discard;
+		N = vec3(p, sqrt(1.0 - r2));
+		L = normalize(v_light_view);
+	}
+	else {
+		N = normalize(v_normal);
+		L = normalize(v_light);
+	}
+
+	float NdotL = max(dot(N, L), 0.0); //Lambertian
+	fragColor = vec4(u_color * (u_ambient + NdotL), 1.0);
+}
@@ -0,0 +1,54 @@
+#version 330
+
+in vec3 a_vertex; //rock mesh, not read when drawing points
+in vec4 a_orbit; //mean anomaly at epoch, mean motion (rad/day), eccentricity, size
+in vec3 a_axis_p; //a * P, scene units
+in vec3 a_axis_q; //b * Q, scene units
+
+out vec3 v_normal;
+out vec3 v_light;
+out vec3 v_light_view;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+uniform float u_time; //days since the epoch of the elements
+uniform vec3 u_light_pos;
+uniform float u_point_scale;
+uniform int u_points; //1: points, a_vertex has no array then
+
+const float TWO_PI = 6.28318530718;
+
+// Kepler's equation M = E - e sin(E) by Newton iterations from Danby's guess
+vec3 orbit_position()
+{
+	float e = a_orbit.z;
+	float M = a_orbit.x + a_orbit.y * u_time;
+	M -= TWO_PI * floor(M / TWO_PI + 0.5);
+
+	float E = M + 0.85 * e * sign(M);
+	for (int k = 0; k < 5; k++) {
+		E -= (E - e * sin(E) - M) / (1.0 - e * cos(E));
+	}
+	return a_axis_p * (cos(E) - e) + a_axis_q * sin(E);
+}
+
+void main()
+{
+	vec3 center = orbit_position();
+	float size = a_orbit.w;
+
+	//every rock gets its own slowly spinning orientation and shape
+	float angle = fract(a_orbit.x * 43758.5453) * TWO_PI + u_time * 0.05;
+	float c = cos(angle);
+	float s = sin(angle);
+	vec3 v = u_points == 1 ? vec3(0.0) : a_vertex; //a disabled array reads whatever generic value is current
+	vec3 local = vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z) * vec3(1.0, 0.7, 0.85);
+
+	v_normal = local;
+	v_light = normalize(u_light_pos - center);
+	v_light_view = mat3(u_view) * v_light;
+
+	vec4 view_pos = u_view * vec4(center + local * size, 1.0);
+	gl_Position = u_projection * view_pos;
+	gl_PointSize = clamp(u_point_scale * size / max(-view_pos.z, 0.001), 1.0, 16.0);
+}
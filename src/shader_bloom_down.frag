@@ -0,0 +1,28 @@
+#version 330
+
+in vec2 v_uv;
+
+out vec4 fragColor;
+
+uniform sampler2D u_texture; //the level above (or the HDR scene)
+uniform vec2 u_texel; //its texel size
+uniform int u_prefilter; //first pass: keep only what is above the threshold
+uniform float u_threshold;
+
+void main(void)
+{
+	//dual filter downsample: the center and the four diagonal 2x2 blocks, all bilinear
+	vec3 color = texture(u_texture, v_uv).rgb * 4.0;
+	color += texture(u_texture, v_uv + vec2(-u_texel.x, -u_texel.y)).rgb;
+	color += texture(u_texture, v_uv + vec2( u_texel.x, -u_texel.y)).rgb;
+	color += texture(u_texture, v_uv + vec2(-u_texel.x,  u_texel.y)).rgb;
+	color += texture(u_texture, v_uv + vec2( u_texel.x,  u_texel.y)).rgb;
+	color *= 0.125;
+
+	if (u_prefilter == 1) {
+		float brightness = max(color.r, max(color.g, color.b));
+		color *= max(brightness - u_threshold, 0.0) / max(brightness, 1e-4);
+	}
+
+	fragColor = vec4(color, 1.0);
+}
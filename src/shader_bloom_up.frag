@@ -0,0 +1,24 @@
+#version 330
+
+in vec2 v_uv;
+
+out vec4 fragColor;
+
+uniform sampler2D u_texture; //the level below
+uniform vec2 u_texel; //its texel size
+
+void main(void)
+{
+	//dual filter upsample: four edge taps and four (heavier) diagonal taps in a tent
+	vec2 h = u_texel * 0.5;
+	vec3 color = texture(u_texture, v_uv + vec2(-h.x * 2.0, 0.0)).rgb;
+	color += texture(u_texture, v_uv + vec2( h.x * 2.0, 0.0)).rgb;
+	color += texture(u_texture, v_uv + vec2(0.0, -h.y * 2.0)).rgb;
+	color += texture(u_texture, v_uv + vec2(0.0,  h.y * 2.0)).rgb;
+	color += texture(u_texture, v_uv + vec2(-h.x, -h.y)).rgb * 2.0;
+	color += texture(u_texture, v_uv + vec2( h.x, -h.y)).rgb * 2.0;
+	color += texture(u_texture, v_uv + vec2(-h.x,  h.y)).rgb * 2.0;
+	color += texture(u_texture, v_uv + vec2( h.x,  h.y)).rgb * 2.0;
+
+	fragColor = vec4(color / 12.0, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330
+
+out vec2 v_uv;
+
+// One triangle covering the screen, no vertex buffer: ids 0, 1, 2 give (0,0), (2,0), (0,2)
+void main()
+{
+	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	v_uv = p;
+	gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,64 @@
+#version 330
+
+in vec3 v_view_pos;
+flat in vec3 v_center;
+flat in float v_radius;
+flat in mat3 v_to_local;
+
+out vec4 fragColor;
+
+uniform mat4 u_projection;
+uniform sampler2D u_texture; 
+uniform vec3 u_light_pos; //view space
+uniform vec3 u_ambient;
+uniform vec3 u_light_color; 
+uniform float u_glossiness;
+uniform int u_unlit; //the sun
+uniform float u_emissive; //HDR intensity of unlit bodies
+uniform int u_clip_zero_to_one; //glClipControl depth range: window depth = NDC depth
+
+//occluders in view space, like the light
+#include "eclipse.glsl"
+
+void main(void)
+{
+	//ray from the eye (view space origin) through this fragment against the sphere
+	vec3 D = normalize(v_view_pos);
+	float b = dot(D, v_center);
+	float h = b * b - dot(v_center, v_center) + v_radius * v_radius;
+	if (h < 0.0) discard;
+	float t = b - sqrt(h);
+	if (t <= 0.0) discard;
+	vec3 P = D * t;
+	vec3 N = (P - v_center) / v_radius;
+
+	//depth of the real surface, not of the quad
+	vec4 clip = u_projection * vec4(P, 1.0);
+	float ndc_depth = clip.z / clip.w;
+	gl_FragDepth = u_clip_zero_to_one != 0 ? ndc_depth : ndc_depth * 0.5 + 0.5;
+
+	//equirectangular coordinates from the body-space normal
+	vec3 n = v_to_local * N;
+	vec2 uv = vec2(atan(n.x, n.z) / (2.0 * PI) + 0.5, asin(clamp(n.y, -1.0, 1.0)) / PI + 0.5);
+	vec3 texture_color = texture(u_texture, uv).xyz;
+
+	if (u_unlit == 1) {
+		fragColor = vec4(texture_color * u_emissive, 1.0);
+		return;
+	}
+
+	vec3 L = normalize(u_light_pos - P);
+	vec3 R = reflect(-L, N);
+	vec3 E = normalize(-P);
+
+	float NdotL = max(dot(N, L), 0.0);
+	float RdotE = max(0.0, dot(R, E));
+
+	vec3 ambient_color = texture_color * u_ambient; 
+	float shadow = u_num_occluders > 0 ? eclipseVisibility(P, u_light_pos) : 1.0;
+
+	vec3 diffuse_color = texture_color * NdotL * shadow; 
+	vec3 specular_color = u_light_color * pow(RdotE, u_glossiness) * shadow;
+
+	fragColor = vec4(ambient_color + diffuse_color + specular_color, 1.0);
+}
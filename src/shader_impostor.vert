@@ -0,0 +1,30 @@
+#version 330
+
+in mat4 a_model; //per instance, or a constant attribute for single bodies
+
+out vec3 v_view_pos;
+flat out vec3 v_center; //view space
+flat out float v_radius;
+flat out mat3 v_to_local; //view space -> body space, for the texture coordinates
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+
+void main()
+{
+	v_radius = length(a_model[0].xyz); //uniform scale
+	v_center = (u_view * a_model[3]).xyz;
+	v_to_local = transpose(mat3(a_model) / v_radius) * transpose(mat3(u_view));
+
+	//quad facing the camera through the sphere center, large enough to hold the silhouette
+	float d = length(v_center);
+	vec3 dir = v_center / d;
+	vec3 right = normalize(cross(dir, abs(dir.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+	vec3 up = cross(right, dir);
+	float extent = v_radius * d / sqrt(max(d * d - v_radius * v_radius, 1e-4 * d * d));
+
+	vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+	v_view_pos = v_center + (right * corner.x + up * corner.y) * extent;
+
+	gl_Position = u_projection * vec4(v_view_pos, 1.0);
+}
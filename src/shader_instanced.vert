@@ -0,0 +1,22 @@
+#version 330
+
+in vec3 a_vertex;
+in vec2 a_uv;
+in vec3 a_normal; 
+in mat4 a_model; //per instance
+
+out vec2 v_uv;
+out vec3 v_normal; 
+out vec3 v_pos;
+
+uniform mat4 u_projection;
+uniform mat4 u_view;
+
+void main()
+{
+	v_uv = a_uv;
+	v_normal = mat3(a_model) * a_normal; //uniform scale only, the fragment shader normalizes
+	v_pos = (a_model * vec4(a_vertex, 1.0)).xyz;
+
+	gl_Position =  u_projection * u_view * vec4( v_pos , 1.0 );
+}
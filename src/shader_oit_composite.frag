@@ -0,0 +1,20 @@
+#version 330
+
+out vec4 fragColor;
+
+uniform sampler2D u_accumulation; //rgb: weighted premultiplied colour, a: revealage
+uniform sampler2D u_weights; //r: sum of the weights
+
+void main(void)
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 accumulation = texelFetch(u_accumulation, pixel, 0);
+	float revealage = accumulation.a;
+	if (revealage >= 1.0) discard; //nothing translucent here
+
+	float weight = texelFetch(u_weights, pixel, 0).r;
+	vec3 average = accumulation.rgb / max(weight, 1e-5);
+
+	//blended with ONE_MINUS_SRC_ALPHA, SRC_ALPHA
+	fragColor = vec4(min(average, vec3(65504.0)), revealage);
+}
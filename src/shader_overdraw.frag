@@ -0,0 +1,16 @@
+#version 330
+
+out vec4 fragColor;
+
+uniform sampler2D u_counts; //fragments per pixel in alpha
+
+void main(void)
+{
+	float count = texelFetch(u_counts, ivec2(gl_FragCoord.xy), 0).a;
+
+	//black (none), blue (1), green (2), yellow (3), red (4 or more)
+	vec3 ramp[5] = vec3[5](vec3(0.0), vec3(0.0, 0.2, 1.0), vec3(0.0, 1.0, 0.2), vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0));
+	float x = clamp(count, 0.0, 4.0);
+	int i = int(min(floor(x), 3.0));
+	fragColor = vec4(mix(ramp[i], ramp[i + 1], x - float(i)), 1.0);
+}
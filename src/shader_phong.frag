@@ -7,16 +7,18 @@ in vec3 v_pos;
 out vec4 fragColor;
 
 uniform sampler2D u_texture; 
-uniform vec3 u_light_dir;
+uniform vec3 u_light_pos;
 uniform vec3 u_ambient;
 uniform vec3 u_light_color; 
 uniform vec3 u_eye; 
 uniform float u_glossiness;
 
+#include "eclipse.glsl"
+
 void main(void)
 {
 	vec3 N = normalize (v_normal);
-	vec3 L = normalize (u_light_dir);
+	vec3 L = normalize (u_light_pos - v_pos);
 	vec3 R = reflect (-L, N);
 	vec3 E = normalize (u_eye - v_pos);
 
@@ -25,9 +27,11 @@ void main(void)
 
 	vec3 texture_color = texture(u_texture, v_uv).xyz;
 	
+	float shadow = u_num_occluders > 0 ? eclipseVisibility(v_pos, u_light_pos) : 1.0;
+
 	vec3 ambient_color = texture_color * u_ambient; 
-	vec3 diffuse_color = texture_color * NdotL; 
-	vec3 specular_color = u_light_color * pow (RdotE, u_glossiness);
+	vec3 diffuse_color = texture_color * NdotL * shadow; 
+	vec3 specular_color = u_light_color * pow (RdotE, u_glossiness) * shadow;
 
 	// We're just going to paint the interpolated colour from the vertex shader
 	fragColor =  vec4(ambient_color + diffuse_color + specular_color, 1.0);
@@ -17,6 +17,11 @@ uniform vec3 u_ambient;
 uniform vec3 u_light_color; 
 uniform vec3 u_eye; 
 uniform float u_glossiness;
+uniform vec3 u_light_pos; //the light itself, for the eclipse term
+uniform sampler2D u_irradiance; //sky irradiance over (mu_s, altitude), see atmosphere.h
+uniform float u_sky_intensity; //0 without the atmosphere
+
+#include "eclipse.glsl"
 
 void main(void)
 {
@@ -36,18 +41,27 @@ void main(void)
 
 
 	float NdotL = max(dot(N, L), 0.0); //Lambertian
+	float shadow = u_num_occluders > 0 ? eclipseVisibility(v_pos, u_light_pos) : 1.0;
 	if (NdotL > 0.1){
 		vec3 R = reflect (-L, N);
 		vec3 E = normalize (u_eye - v_pos);
 
 		float RdotE = max(0.0, dot (R, E));
-		specular = pow (RdotE, u_glossiness);
-		diffuse_color = texture_color * NdotL; 
+		specular = pow (RdotE, u_glossiness) * shadow;
+		diffuse_color = mix(texture_night, texture_color * NdotL, shadow); 
 	}
 	else{
 		diffuse_color = texture_night; 
 	}
-	vec3 ambient_color = texture_color * u_ambient; 
+	//sky light at ground level (bottom row of the table), by the sun's height over the surface
+	vec3 sky = vec3(0.0);
+	if (u_sky_intensity > 0.0) {
+		float mu_s = dot(normalize(v_normal), L);
+		vec2 uv = vec2(0.5 / 64.0 + (mu_s * 0.5 + 0.5) * (1.0 - 1.0 / 64.0), 0.5 / 16.0);
+		sky = texture(u_irradiance, uv).rgb * u_sky_intensity * shadow;
+	}
+
+	vec3 ambient_color = texture_color * (u_ambient + sky); 
 	vec3 specular_color = texture_spec * u_light_color * specular;
 
 	// We're just going to paint the interpolated colour from the vertex shader
@@ -5,11 +5,12 @@ in vec2 v_uv;
 out vec4 fragColor;
 
 uniform sampler2D u_texture; 
+uniform float u_emissive; //HDR intensity: 1 for the sky, above 1 for the sun
 
 void main(void)
 {
 	vec3 texture_color = texture(u_texture, v_uv).xyz;
 
 	// We're just going to paint the interpolated colour from the vertex shader
-	fragColor =  vec4(texture_color, 1.0);
+	fragColor =  vec4(texture_color * u_emissive, 1.0);
 }
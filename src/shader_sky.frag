@@ -0,0 +1,12 @@
+#version 330
+
+in vec3 v_dir;
+
+out vec4 fragColor;
+
+uniform samplerCube u_texture;
+
+void main(void)
+{
+	fragColor = vec4(texture(u_texture, v_dir).rgb, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 330
+
+out vec3 v_dir;
+
+uniform mat4 u_inverse_view_projection;
+uniform float u_near_depth; //NDC depth of the near plane: -1, or 1 with reversed-Z
+uniform float u_far_depth; //NDC depth of the far plane: 1, or 0 with reversed-Z
+
+// One triangle covering the screen at the far plane. The view ray of each corner is its
+// point on the near plane (the eye is the origin of render space); rays are affine in
+// screen space, so interpolating them is exact.
+void main()
+{
+	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+	vec4 near = u_inverse_view_projection * vec4(p, u_near_depth, 1.0);
+	v_dir = near.xyz / near.w;
+	gl_Position = vec4(p, u_far_depth, 1.0);
+}
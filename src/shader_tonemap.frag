@@ -0,0 +1,24 @@
+#version 330
+
+in vec2 v_uv;
+
+out vec4 fragColor;
+
+uniform sampler2D u_scene; //HDR
+uniform sampler2D u_bloom; //level 0 of the bloom chain
+uniform float u_bloom_intensity;
+uniform float u_exposure;
+
+// Filmic curve (Narkowicz's fit of ACES): linear toe, soft shoulder towards white
+vec3 tonemap(vec3 x)
+{
+	return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main(void)
+{
+	vec3 hdr = texture(u_scene, v_uv).rgb;
+	if (u_bloom_intensity > 0.0) hdr += texture(u_bloom, v_uv).rgb * u_bloom_intensity;
+
+	fragColor = vec4(tonemap(hdr * u_exposure), 1.0);
+}
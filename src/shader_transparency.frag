@@ -1,11 +1,28 @@
 #version 330
 
 in vec2 v_uv;
+in vec3 v_pos;
 
-out vec4 fragColor;
+layout(location = 0) out vec4 fragColor; //OIT accumulation
+layout(location = 1) out vec4 fragWeight; //OIT weights
 
 uniform sampler2D u_texture; 
 uniform float u_transparency;
+uniform float u_depth_unit; //scene units per unit of the weight's distance (the Earth's radius)
+
+// McGuire and Bavoil's distance weight (their equation 9): nearer layers count for more
+float oitWeight(float distance, float alpha)
+{
+	return alpha * clamp(10.0 / (1e-5 + pow(distance / 5.0, 2.0) + pow(distance / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+void oitOutput(vec3 color, float alpha)
+{
+	//render space has the eye at the origin
+	float weight = oitWeight(length(v_pos) / u_depth_unit, alpha);
+	fragColor = vec4(color * alpha * weight, alpha);
+	fragWeight = vec4(alpha * weight, 0.0, 0.0, 0.0);
+}
 
 void main(void)
 {
@@ -13,6 +30,5 @@ void main(void)
 	vec4 color = vec4 (vec3(1.0 - texture_color.r, 1.0 - texture_color.g, 1.0 - texture_color.b), u_transparency);
 	if(color.a < 0.1) discard;
 
-	// We're just going to paint the interpolated colour from the vertex shader
-	fragColor =  color;
+	oitOutput(color.rgb, color.a);
 }
@@ -0,0 +1,107 @@
+#include "skybox.h"
+
+#include <math.h>
+#include <chrono>
+
+#include "jobs.h"
+
+#define SKYBOX_GRAIN 8 //face rows per job
+
+static const float SKYBOX_PI = 3.14159265358979f;
+
+int skybox_face_size(int equirect_width, int max_size) {
+	//a face spans 90 degrees, a quarter of the map's width at the equator
+	int size = 1;
+	while (size * 2 <= equirect_width / 4 && size * 2 <= max_size) size *= 2;
+	return size;
+}
+
+// Direction through (a, b) in [-1, 1] on a face, following the GL cube map selection rules
+static void face_direction(int face, float a, float b, float dir[3]) {
+	switch (face) {
+	case 0: dir[0] = 1.0f; dir[1] = -b; dir[2] = -a; break; //+X
+	case 1: dir[0] = -1.0f; dir[1] = -b; dir[2] = a; break; //-X
+	case 2: dir[0] = a; dir[1] = 1.0f; dir[2] = b; break; //+Y
+	case 3: dir[0] = a; dir[1] = -1.0f; dir[2] = -b; break; //-Y
+	case 4: dir[0] = a; dir[1] = -b; dir[2] = 1.0f; break; //+Z
+	default: dir[0] = -a; dir[1] = -b; dir[2] = -1.0f; break; //-Z
+	}
+}
+
+// Bilinear sample of the map along a direction, wrapping in longitude
+static void sample_equirect(const unsigned char* equirect, int width, int height, const float dir[3], float rgb[3]) {
+	float length = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	float y = dir[1] / length;
+	if (y > 1.0f) y = 1.0f;
+	if (y < -1.0f) y = -1.0f;
+	float u = atan2f(dir[0], dir[2]) / (2.0f * SKYBOX_PI) + 0.5f;
+	float v = asinf(y) / SKYBOX_PI + 0.5f;
+
+	float x = u * width - 0.5f, row = v * height - 0.5f;
+	int x0 = (int)floorf(x), y0 = (int)floorf(row);
+	float fx = x - x0, fy = row - y0;
+	int x1 = x0 + 1, y1 = y0 + 1;
+	x0 = ((x0 % width) + width) % width;
+	x1 = ((x1 % width) + width) % width;
+	if (y0 < 0) y0 = 0;
+	if (y1 > height - 1) y1 = height - 1;
+	if (y0 > height - 1) y0 = height - 1;
+
+	const unsigned char* p00 = equirect + 3 * ((size_t)y0 * width + x0);
+	const unsigned char* p10 = equirect + 3 * ((size_t)y0 * width + x1);
+	const unsigned char* p01 = equirect + 3 * ((size_t)y1 * width + x0);
+	const unsigned char* p11 = equirect + 3 * ((size_t)y1 * width + x1);
+	for (int c = 0; c < 3; c++) {
+		float bottom = p00[c] + (p10[c] - p00[c]) * fx;
+		float top = p01[c] + (p11[c] - p01[c]) * fx;
+		rgb[c] = bottom + (top - bottom) * fy;
+	}
+}
+
+void skybox_convert(const unsigned char* equirect, int width, int height, int face_size, SkyboxFaces& faces) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	faces.size = face_size;
+	for (int face = 0; face < 6; face++) faces.pixels[face].resize((size_t)face_size * face_size * 3);
+
+	//one range over the rows of all six faces
+	parallel_for(0, (size_t)6 * face_size, SKYBOX_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t r = begin; r < end; r++) {
+			int face = (int)(r / face_size), j = (int)(r % face_size);
+			unsigned char* out = &faces.pixels[face][(size_t)j * face_size * 3];
+			for (int i = 0; i < face_size; i++) {
+				float sum[3] = { 0.0f, 0.0f, 0.0f };
+				for (int s = 0; s < 4; s++) {
+					float a = 2.0f * (i + 0.25f + 0.5f * (s & 1)) / face_size - 1.0f;
+					float b = 2.0f * (j + 0.25f + 0.5f * (s >> 1)) / face_size - 1.0f;
+					float dir[3], rgb[3];
+					face_direction(face, a, b, dir);
+					sample_equirect(equirect, width, height, dir, rgb);
+					for (int c = 0; c < 3; c++) sum[c] += rgb[c];
+				}
+				for (int c = 0; c < 3; c++) out[3 * i + c] = (unsigned char)(sum[c] * 0.25f + 0.5f);
+			}
+		}
+	});
+
+	faces.convert_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+GLuint skybox_create_cubemap(const SkyboxFaces& faces) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //rows of 3 * size bytes
+	for (int face = 0; face < 6; face++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, faces.size, faces.size, 0,
+			GL_RGB, GL_UNSIGNED_BYTE, &faces.pixels[face][0]);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	return texture;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+
+// Largest cube face the conversion produces
+#define SKYBOX_MAX_FACE_SIZE 2048
+
+// Cube faces resampled from an equirectangular map, RGB8 rows packed tightly, in GL face
+// order (+X, -X, +Y, -Y, +Z, -Z). A cube spends its texels evenly over the sphere where the
+// equirectangular map crowds them at the poles, and its view rays need no trigonometry.
+struct SkyboxFaces {
+	int size;
+	std::vector<unsigned char> pixels[6];
+	double convert_ms;
+
+	SkyboxFaces() : size(0), convert_ms(0.0) {}
+};
+
+// Power of two face size matching the texel density of the map at its equator
+int skybox_face_size(int equirect_width, int max_size);
+
+// Resamples the map (rows bottom to top, as loadBMP gives them) with parallel_for, 2x2
+// bilinear samples per texel. The directions use the same longitude/latitude mapping as the
+// sphere mesh, so the sky does not move against the old one.
+void skybox_convert(const unsigned char* equirect, int width, int height, int face_size, SkyboxFaces& faces);
+
+// Uploads the faces and builds the mip chain; sample with seamless cube filtering
+GLuint skybox_create_cubemap(const SkyboxFaces& faces);
@@ -0,0 +1,49 @@
+#include "snapshot.h"
+
+#include <algorithm>
+
+#include "jobs.h"
+
+#define SNAPSHOT_GRAIN 8192
+
+static inline float lerp_angle(float a, float b, float alpha) {
+	float d = b - a;
+	d = d > 180.0f ? d - 360.0f : d;
+	d = d < -180.0f ? d + 360.0f : d;
+	return a + d * alpha;
+}
+
+//'a' can be missing or from before a reload, then 'b' is shown as is
+static const SimSnapshot& blend_source(const SimSnapshot& a, const SimSnapshot& b) {
+	return a.pos_x.size() == b.pos_x.size() && a.instances.size() == b.instances.size() ? a : b;
+}
+
+void snapshot_interpolate_bodies(const SimSnapshot& a, const SimSnapshot& b, float alpha, BodyStore& bodies) {
+	const SimSnapshot& from = blend_source(a, b);
+
+	size_t num_bodies = std::min(bodies.size(), b.pos_x.size());
+	for (size_t i = 0; i < num_bodies; i++) {
+		bodies.pos_x[i] = from.pos_x[i] + (b.pos_x[i] - from.pos_x[i]) * alpha;
+		bodies.pos_y[i] = from.pos_y[i] + (b.pos_y[i] - from.pos_y[i]) * alpha;
+		bodies.pos_z[i] = from.pos_z[i] + (b.pos_z[i] - from.pos_z[i]) * alpha;
+		bodies.rotation[i] = lerp_angle(from.rotation[i], b.rotation[i], alpha);
+		bodies.clouds_rotation[i] = lerp_angle(from.clouds_rotation[i], b.clouds_rotation[i], alpha);
+	}
+}
+
+void snapshot_interpolate_instances(const SimSnapshot& a, const SimSnapshot& b, float alpha, const glm::dvec3& origin,
+	std::vector<glm::mat4>& instances) {
+	const SimSnapshot& from = blend_source(a, b);
+	size_t num_instances = std::min(instances.size(), b.instances.size() / 3);
+	double ox = origin.x, oy = origin.y, oz = origin.z;
+	parallel_for(0, num_instances, SNAPSHOT_GRAIN, [&](size_t begin, size_t end) {
+		const float* p0 = &from.instances[0];
+		const float* p1 = &b.instances[0];
+		for (size_t i = begin; i < end; i++) {
+			glm::vec4& t = instances[i][3];
+			t.x = (float)(p0[i * 3 + 0] + (p1[i * 3 + 0] - p0[i * 3 + 0]) * alpha - ox);
+			t.y = (float)(p0[i * 3 + 1] + (p1[i * 3 + 1] - p0[i * 3 + 1]) * alpha - oy);
+			t.z = (float)(p0[i * 3 + 2] + (p1[i * 3 + 2] - p0[i * 3 + 2]) * alpha - oz);
+		}
+	});
+}
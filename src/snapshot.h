@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bodies.h"
+
+// Single-producer single-consumer triple buffer. The writer fills write_buffer() and
+// publishes it with one atomic exchange; the reader takes the newest published buffer
+// the same way. Neither side ever waits for the other: a slow reader skips snapshots
+// and a slow writer leaves the reader on the last one.
+template <class T>
+struct TripleBuffer {
+	enum { INDEX_MASK = 3, FRESH = 4 };
+
+	T buffers[3];
+	std::atomic<int> shared; //index of the buffer in the middle, plus FRESH once published
+	int back; //writer's
+	int front; //reader's
+
+	TripleBuffer() : shared(1), back(0), front(2) {}
+
+	//writer side
+	T& write_buffer() { return buffers[back]; }
+	void publish() { back = shared.exchange(back | FRESH) & INDEX_MASK; }
+
+	//reader side
+	bool has_new() const { return (shared.load() & FRESH) != 0; }
+	//swaps in the newest buffer, returns false if nothing was published since the last call
+	bool acquire() {
+		if (!has_new()) return false;
+		front = shared.exchange(front) & INDEX_MASK;
+		return true;
+	}
+	T& read_buffer() { return buffers[front]; }
+
+	//only while no other thread touches the buffer
+	void reset() { shared = 1; back = 0; front = 2; }
+};
+
+// State published by the simulation thread after every tick
+struct SimSnapshot {
+	unsigned long long tick;
+	double time; //simulated days
+	double wall; //seconds on the steady clock when the tick was published
+
+	//solar system bodies, same indices as the BodyStore
+	std::vector<double> pos_x, pos_y, pos_z;
+	std::vector<float> rotation, clouds_rotation;
+
+	//small bodies (asteroids then N-body particles), xyz in scene units
+	std::vector<float> instances;
+
+	SimSnapshot() : tick(0), time(0.0), wall(0.0) {}
+};
+
+// Blend two snapshots (alpha 0 = a, 1 = b) into the render state. Bodies: positions and
+// spins into the BodyStore, angles taking the short way around 360 degrees. Small bodies:
+// the translation column of the instance matrices, relative to 'origin' (the camera).
+void snapshot_interpolate_bodies(const SimSnapshot& a, const SimSnapshot& b, float alpha, BodyStore& bodies);
+void snapshot_interpolate_instances(const SimSnapshot& a, const SimSnapshot& b, float alpha, const glm::dvec3& origin,
+	std::vector<glm::mat4>& instances);
@@ -0,0 +1,93 @@
+#include "streambuffer.h"
+
+#include <string.h>
+#include <chrono>
+
+bool streambuffer_persistent() {
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+void streambuffer_create(StreamBuffer& stream, size_t region_size) {
+	streambuffer_destroy(stream);
+	stream.region_size = (region_size + STREAM_BUFFER_REGION_ALIGNMENT - 1) / STREAM_BUFFER_REGION_ALIGNMENT * STREAM_BUFFER_REGION_ALIGNMENT;
+	stream.region = 0;
+	stream.offset = 0;
+	stream.requested = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &stream.uniform_alignment);
+	if (GLEW_VERSION_4_3) glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &stream.storage_alignment);
+
+	GLsizeiptr size = (GLsizeiptr)(stream.region_size * STREAM_BUFFER_FRAMES);
+	glGenBuffers(1, &stream.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+	if (streambuffer_persistent()) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+		stream.mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		stream.mapped = NULL;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void streambuffer_destroy(StreamBuffer& stream) {
+	for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+		if (!stream.fences[i]) continue;
+		glClientWaitSync(stream.fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(stream.fences[i]);
+		stream.fences[i] = 0;
+	}
+	if (stream.buffer) {
+		if (stream.mapped) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &stream.buffer);
+	}
+	stream.buffer = 0;
+	stream.mapped = NULL;
+}
+
+void streambuffer_begin_frame(StreamBuffer& stream) {
+	//the last frame did not fit: half as much again, once the GPU is done with all of it
+	if (stream.requested > stream.region_size) streambuffer_create(stream, stream.requested + stream.requested / 2);
+
+	stream.region = (stream.region + 1) % STREAM_BUFFER_FRAMES;
+	GLsync& fence = stream.fences[stream.region];
+	if (fence) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+		stream.wait_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		glDeleteSync(fence);
+		fence = 0;
+	}
+	stream.offset = 0;
+	stream.requested = 0;
+}
+
+void streambuffer_end_frame(StreamBuffer& stream) {
+	stream.fences[stream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (stream.offset > stream.high_water) stream.high_water = stream.offset;
+}
+
+GLintptr streambuffer_upload(StreamBuffer& stream, const void* data, size_t bytes, size_t alignment) {
+	size_t start = (stream.offset + alignment - 1) / alignment * alignment;
+	if (start + bytes > stream.region_size) {
+		stream.overflows++;
+		stream.requested = (stream.requested > stream.offset ? stream.requested : stream.offset) + bytes + alignment;
+		return -1;
+	}
+	stream.offset = start + bytes;
+	if (stream.offset > stream.requested) stream.requested = stream.offset;
+
+	size_t position = stream.region * stream.region_size + start;
+	if (stream.mapped) memcpy(stream.mapped + position, data, bytes);
+	else {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)position, (GLsizeiptr)bytes, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	return (GLintptr)position;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <GL/glew.h>
+
+// Frames the ring is split into: the CPU writes one region while the GPU may still read the
+// two before it
+#define STREAM_BUFFER_FRAMES 3
+// Regions start on this boundary, a multiple of every offset alignment GL asks for
+#define STREAM_BUFFER_REGION_ALIGNMENT 4096
+
+// Ring buffer for data written every frame: instance matrices, uniform block ranges,
+// indirect commands. One buffer, persistently and coherently mapped when ARB_buffer_storage
+// (GL 4.4) is there, split into STREAM_BUFFER_FRAMES regions; each frame takes the next
+// region, waits on the fence of the frame that last used it, and hands out aligned ranges
+// from it front to back. An upload is a memcpy into the mapping, with no driver allocation
+// (orphaning) and no synchronisation beyond the once-a-frame fence. Without buffer storage
+// the same offsets are filled with glBufferSubData.
+//
+// A frame that asks for more than a region holds gets -1 for the uploads that do not fit;
+// the next frame then grows the ring (once every region is idle).
+struct StreamBuffer {
+	GLuint buffer;
+	unsigned char* mapped; //NULL without buffer storage
+	size_t region_size;
+	int region; //being written this frame
+	size_t offset; //next free byte in it
+	GLsync fences[STREAM_BUFFER_FRAMES];
+	GLint uniform_alignment, storage_alignment; //offset alignments for glBindBufferRange
+
+	size_t requested; //bytes this frame asked for, including what did not fit
+	size_t high_water; //most bytes one frame used
+	int overflows; //uploads that did not fit, since creation
+	double wait_ms; //CPU time blocked on fences, since creation
+
+	StreamBuffer() : buffer(0), mapped(NULL), region_size(0), region(0), offset(0), uniform_alignment(256),
+		storage_alignment(256), requested(0), high_water(0), overflows(0), wait_ms(0.0) {
+		for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) fences[i] = 0;
+	}
+};
+
+bool streambuffer_persistent();
+
+void streambuffer_create(StreamBuffer& stream, size_t region_size);
+// Waits for the GPU to finish with every region first
+void streambuffer_destroy(StreamBuffer& stream);
+
+// Moves to the next region, waiting until the GPU is done with it
+void streambuffer_begin_frame(StreamBuffer& stream);
+// Fences the region written this frame, after its last draw was issued
+void streambuffer_end_frame(StreamBuffer& stream);
+
+// Copies 'bytes' into the current region at the next multiple of 'alignment' and returns
+// that offset within the buffer, or -1 if the region is full
+GLintptr streambuffer_upload(StreamBuffer& stream, const void* data, size_t bytes, size_t alignment);
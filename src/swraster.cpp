@@ -0,0 +1,429 @@
+#include "swraster.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "jobs.h"
+
+static const float SW_PI = 3.14159265359f;
+
+static double now_ms() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void swtexture_create(SwTexture& texture, const char* rgb, int width, int height) {
+	texture.width = width;
+	texture.height = height;
+	texture.rgb.assign((const unsigned char*)rgb, (const unsigned char*)rgb + (size_t)width * height * 3);
+}
+
+// GL_LINEAR with GL_REPEAT, as the GL path samples its textures
+static glm::vec3 sample(const SwTexture* texture, float u, float v) {
+	if (!texture || texture->width == 0) return glm::vec3(1.0f);
+	float x = u * texture->width - 0.5f, y = v * texture->height - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	float tx = x - fx, ty = y - fy;
+	int x0 = (int)fx % texture->width, y0 = (int)fy % texture->height;
+	if (x0 < 0) x0 += texture->width;
+	if (y0 < 0) y0 += texture->height;
+	int x1 = x0 + 1 == texture->width ? 0 : x0 + 1, y1 = y0 + 1 == texture->height ? 0 : y0 + 1;
+	const unsigned char* p00 = &texture->rgb[((size_t)y0 * texture->width + x0) * 3];
+	const unsigned char* p10 = &texture->rgb[((size_t)y0 * texture->width + x1) * 3];
+	const unsigned char* p01 = &texture->rgb[((size_t)y1 * texture->width + x0) * 3];
+	const unsigned char* p11 = &texture->rgb[((size_t)y1 * texture->width + x1) * 3];
+	glm::vec3 c;
+	for (int i = 0; i < 3; i++) {
+		float top = p00[i] + (p10[i] - p00[i]) * tx, bottom = p01[i] + (p11[i] - p01[i]) * tx;
+		c[i] = (top + (bottom - top) * ty) * (1.0f / 255.0f);
+	}
+	return c;
+}
+
+// ------------------------------------------------------------------------------------------
+// Fragment shaders, line for line with the GLSL ones
+// ------------------------------------------------------------------------------------------
+static float disc_overlap(float r1, float r2, float d) {
+	if (d >= r1 + r2) return 0.0f;
+	if (d <= fabsf(r1 - r2)) return SW_PI * std::min(r1, r2) * std::min(r1, r2);
+	float a1 = acosf(glm::clamp((d * d + r1 * r1 - r2 * r2) / (2.0f * d * r1), -1.0f, 1.0f));
+	float a2 = acosf(glm::clamp((d * d + r2 * r2 - r1 * r1) / (2.0f * d * r2), -1.0f, 1.0f));
+	float k = sqrtf(std::max((-d + r1 + r2) * (d + r1 - r2) * (d - r1 + r2) * (d + r1 + r2), 0.0f));
+	return r1 * r1 * a1 + r2 * r2 * a2 - 0.5f * k;
+}
+
+float swraster_eclipse_visibility(const SwMaterial& m, const glm::vec3& P) {
+	glm::vec3 to_light = m.light_pos - P;
+	float light_distance = glm::length(to_light);
+	glm::vec3 L = to_light / light_distance;
+	float light_angle = asinf(std::min(m.light_radius / light_distance, 1.0f));
+	float light_area = SW_PI * light_angle * light_angle;
+
+	float visible = 1.0f;
+	for (int i = 0; i < m.occluders.count; i++) {
+		glm::vec3 to_occluder = glm::vec3(m.occluders.spheres[i]) - P;
+		float occluder_distance = glm::length(to_occluder);
+		glm::vec3 O = to_occluder / occluder_distance;
+		float occluder_angle = asinf(std::min(m.occluders.spheres[i].w / occluder_distance, 1.0f));
+		float separation = atan2f(glm::length(glm::cross(L, O)), glm::dot(L, O));
+		visible *= 1.0f - std::min(disc_overlap(light_angle, occluder_angle, separation) / light_area, 1.0f);
+	}
+	return visible;
+}
+
+glm::vec3 swraster_shade(const SwMaterial& m, const glm::vec2& uv, const glm::vec3& normal, const glm::vec3& pos, float shadow) {
+	glm::vec3 texture_color = sample(m.texture, uv.x, uv.y);
+	if (m.shader == SW_SHADER_SIMPLE) return texture_color * m.emissive;
+
+	if (m.shader == SW_SHADER_PHONG) {
+		glm::vec3 N = glm::normalize(normal);
+		glm::vec3 L = glm::normalize(m.light_pos - pos);
+		glm::vec3 R = glm::reflect(-L, N);
+		glm::vec3 E = glm::normalize(m.eye - pos);
+		float NdotL = std::max(glm::dot(N, L), 0.0f);
+		float RdotE = std::max(0.0f, glm::dot(R, E));
+		return texture_color * m.ambient + texture_color * NdotL * shadow + m.light_color * powf(RdotE, m.glossiness) * shadow;
+	}
+
+	glm::vec3 texture_night = sample(m.night, uv.x, uv.y);
+	glm::vec3 texture_spec = sample(m.spec, uv.x, uv.y);
+	glm::vec3 texture_normal = glm::normalize(sample(m.normal_map, uv.x, uv.y) * 2.0f - glm::vec3(1.0f));
+	glm::vec3 N = glm::normalize(normal + texture_normal);
+	glm::vec3 L = glm::normalize(m.light_dir);
+	float NdotL = std::max(glm::dot(N, L), 0.0f);
+	float specular = 0.0f;
+	glm::vec3 diffuse_color;
+	if (NdotL > 0.1f) {
+		glm::vec3 R = glm::reflect(-L, N);
+		glm::vec3 E = glm::normalize(m.eye - pos);
+		specular = powf(std::max(0.0f, glm::dot(R, E)), m.glossiness) * shadow;
+		diffuse_color = glm::mix(texture_night, texture_color * NdotL, shadow);
+	}
+	else diffuse_color = texture_night;
+	return texture_color * m.ambient + diffuse_color + texture_spec * m.light_color * specular;
+}
+
+static glm::vec3 shade(const SwMaterial& m, const float* a) {
+	glm::vec3 pos(a[5], a[6], a[7]);
+	float shadow = m.shader != SW_SHADER_SIMPLE && m.occluders.count > 0 ? swraster_eclipse_visibility(m, pos) : 1.0f;
+	return swraster_shade(m, glm::vec2(a[0], a[1]), glm::vec3(a[2], a[3], a[4]), pos, shadow);
+}
+
+unsigned int swraster_tonemap(const glm::vec3& hdr, float exposure) {
+	unsigned int rgba = 0xff000000u;
+	for (int i = 0; i < 3; i++) {
+		float x = hdr[i] * exposure;
+		float c = glm::clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.0f, 1.0f);
+		rgba |= (unsigned int)(c * 255.0f + 0.5f) << (8 * i);
+	}
+	return rgba;
+}
+
+// ------------------------------------------------------------------------------------------
+// Vertex processing and setup
+// ------------------------------------------------------------------------------------------
+struct ClipVertex {
+	glm::vec4 clip;
+	float attributes[SW_ATTRIBUTES];
+};
+
+// Inside when dot(plane, clip) >= 0: w above the near limit, then the guard band
+static const glm::vec4 clip_planes[5] = {
+	glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+	glm::vec4(1.0f, 0.0f, 0.0f, SW_GUARD_BAND), glm::vec4(-1.0f, 0.0f, 0.0f, SW_GUARD_BAND),
+	glm::vec4(0.0f, 1.0f, 0.0f, SW_GUARD_BAND), glm::vec4(0.0f, -1.0f, 0.0f, SW_GUARD_BAND),
+};
+
+static float plane_distance(int plane, const glm::vec4& clip) {
+	return glm::dot(clip_planes[plane], clip) - (plane == 0 ? SW_NEAR_W : 0.0f);
+}
+
+static void emit_triangle(const SwRaster& raster, const ClipVertex* in[3], int material, std::vector<SwTriangle>& out) {
+	SwTriangle t;
+	for (int k = 0; k < 3; k++) {
+		const glm::vec4& c = in[k]->clip;
+		float inv_w = 1.0f / c.w;
+		SwVertex& v = t.v[k];
+		v.x = (c.x * inv_w * 0.5f + 0.5f) * raster.width;
+		v.y = (c.y * inv_w * 0.5f + 0.5f) * raster.height;
+		v.z = c.z * inv_w;
+		v.inv_w = inv_w;
+		for (int a = 0; a < SW_ATTRIBUTES; a++) v.attributes[a] = in[k]->attributes[a];
+	}
+	//counter-clockwise in window coordinates is the front face, as in GL
+	float area = (t.v[1].x - t.v[0].x) * (t.v[2].y - t.v[0].y) - (t.v[2].x - t.v[0].x) * (t.v[1].y - t.v[0].y);
+	if (!(area > 0.0f)) return;
+
+	float min_x = std::min(t.v[0].x, std::min(t.v[1].x, t.v[2].x)), max_x = std::max(t.v[0].x, std::max(t.v[1].x, t.v[2].x));
+	float min_y = std::min(t.v[0].y, std::min(t.v[1].y, t.v[2].y)), max_y = std::max(t.v[0].y, std::max(t.v[1].y, t.v[2].y));
+	t.min_x = std::max(0, (int)ceilf(min_x - 0.5f));
+	t.max_x = std::min(raster.width - 1, (int)floorf(max_x - 0.5f));
+	t.min_y = std::max(0, (int)ceilf(min_y - 0.5f));
+	t.max_y = std::min(raster.height - 1, (int)floorf(max_y - 0.5f));
+	if (t.min_x > t.max_x || t.min_y > t.max_y) return; //between pixel centres
+	t.material = material;
+	out.push_back(t);
+}
+
+static ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t) {
+	ClipVertex v;
+	v.clip = a.clip + (b.clip - a.clip) * t;
+	for (int i = 0; i < SW_ATTRIBUTES; i++) v.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * t;
+	return v;
+}
+
+// Sutherland-Hodgman against the planes the triangle crosses, then a fan
+static void clip_triangle(const SwRaster& raster, const ClipVertex* tri[3], int planes, int material, std::vector<SwTriangle>& out) {
+	ClipVertex buffers[2][3 + 5];
+	int count = 3;
+	for (int k = 0; k < 3; k++) buffers[0][k] = *tri[k];
+	int current = 0;
+	for (int p = 0; p < 5 && count > 0; p++) {
+		if (!(planes & (1 << p))) continue;
+		const ClipVertex* in = buffers[current];
+		ClipVertex* result = buffers[1 - current];
+		int n = 0;
+		for (int k = 0; k < count; k++) {
+			const ClipVertex& a = in[k];
+			const ClipVertex& b = in[(k + 1) % count];
+			float da = plane_distance(p, a.clip), db = plane_distance(p, b.clip);
+			if (da >= 0.0f) result[n++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f)) result[n++] = lerp(a, b, da / (da - db));
+		}
+		count = n;
+		current = 1 - current;
+	}
+	for (int k = 1; k + 1 < count; k++) {
+		const ClipVertex* fan[3] = { &buffers[current][0], &buffers[current][k], &buffers[current][k + 1] };
+		emit_triangle(raster, fan, material, out);
+	}
+}
+
+static void setup_draw(const SwRaster& raster, const SwDraw& draw, std::vector<ClipVertex>& vertices, std::vector<SwTriangle>& out) {
+	const SwMesh& mesh = *draw.mesh;
+	glm::mat4 mvp = raster.view_projection * draw.model;
+	glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(draw.model)));
+	vertices.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++) {
+		glm::vec4 p(mesh.positions[i], 1.0f);
+		ClipVertex& v = vertices[i];
+		v.clip = mvp * p;
+		glm::vec2 uv = i < mesh.uvs.size() ? mesh.uvs[i] : glm::vec2(0.0f);
+		glm::vec3 n = normal_matrix * (i < mesh.normals.size() ? mesh.normals[i] : glm::vec3(0.0f));
+		glm::vec3 world = glm::vec3(draw.model * p);
+		float attributes[SW_ATTRIBUTES] = { uv.x, uv.y, n.x, n.y, n.z, world.x, world.y, world.z };
+		for (int a = 0; a < SW_ATTRIBUTES; a++) v.attributes[a] = attributes[a];
+	}
+
+	out.clear();
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const ClipVertex* tri[3] = { &vertices[mesh.indices[i]], &vertices[mesh.indices[i + 1]], &vertices[mesh.indices[i + 2]] };
+		int outside_all = 31, crossing = 0;
+		for (int p = 0; p < 5; p++) {
+			for (int k = 0; k < 3; k++) {
+				if (plane_distance(p, tri[k]->clip) < 0.0f) crossing |= 1 << p;
+				else outside_all &= ~(1 << p);
+			}
+		}
+		if (outside_all) continue; //all three beyond one plane
+		if (crossing) clip_triangle(raster, tri, crossing, draw.material, out);
+		else emit_triangle(raster, tri, draw.material, out);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+// Rasterization, one tile at a time
+// ------------------------------------------------------------------------------------------
+static long long raster_tile(SwRaster& raster, int tile) {
+	int x_begin = (tile % raster.tiles_x) * SW_TILE_SIZE, y_begin = (tile / raster.tiles_x) * SW_TILE_SIZE;
+	int x_end = std::min(x_begin + SW_TILE_SIZE, raster.width), y_end = std::min(y_begin + SW_TILE_SIZE, raster.height);
+	float clear_depth = raster.reversed_z ? 0.0f : 1.0f;
+	float depth_min = raster.reversed_z ? 0.0f : -1.0f;
+	for (int y = y_begin; y < y_end; y++) {
+		size_t row = (size_t)y * raster.stride;
+		for (int x = x_begin; x < x_end; x++) raster.color[row + x] = raster.clear_color;
+		std::fill(raster.depth.begin() + row + x_begin, raster.depth.begin() + row + x_begin + SW_TILE_SIZE, clear_depth);
+	}
+
+	long long shaded = 0;
+	const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const std::vector<const SwTriangle*>& bin = raster.bins[tile];
+	for (size_t b = 0; b < bin.size(); b++) {
+		const SwTriangle& t = *bin[b];
+		const SwMaterial& material = raster.materials[t.material];
+		const SwVertex& v0 = t.v[0];
+		const SwVertex& v1 = t.v[1];
+		const SwVertex& v2 = t.v[2];
+
+		//edge i is opposite vertex i, positive inside: E(x, y) = A x + B y + C
+		float A[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+		float B[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+		float C[3] = { v1.x * v2.y - v1.y * v2.x, v2.x * v0.y - v2.y * v0.x, v0.x * v1.y - v0.y * v1.x };
+		float inv_area = 1.0f / (C[0] + C[1] + C[2]);
+
+		int min_x = std::max(t.min_x, x_begin) & ~3, max_x = std::min(t.max_x, x_end - 1);
+		int min_y = std::max(t.min_y, y_begin), max_y = std::min(t.max_y, y_end - 1);
+		__m128 a0 = _mm_set1_ps(A[0] * inv_area), a1 = _mm_set1_ps(A[1] * inv_area), a2 = _mm_set1_ps(A[2] * inv_area);
+		__m128 z0 = _mm_set1_ps(v0.z), z1 = _mm_set1_ps(v1.z), z2 = _mm_set1_ps(v2.z);
+		__m128 w0 = _mm_set1_ps(v0.inv_w), w1 = _mm_set1_ps(v1.inv_w), w2 = _mm_set1_ps(v2.inv_w);
+		__m128 zero = _mm_setzero_ps();
+		__m128 lo = _mm_set1_ps(depth_min), hi = _mm_set1_ps(1.0f);
+		__m128i first = _mm_set1_epi32(std::max(t.min_x, x_begin)), last = _mm_set1_epi32(max_x);
+		for (int y = min_y; y <= max_y; y++) {
+			float py = y + 0.5f;
+			float* depth_row = &raster.depth[(size_t)y * raster.stride];
+			glm::vec3* color_row = &raster.color[(size_t)y * raster.stride];
+			//barycentrics at the first quad of the row, stepped by 4 A / area
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)min_x), lane_offsets);
+			__m128 b0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps((B[0] * py + C[0]) * inv_area));
+			__m128 b1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps((B[1] * py + C[1]) * inv_area));
+			__m128 b2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps((B[2] * py + C[2]) * inv_area));
+			__m128 step0 = _mm_mul_ps(a0, _mm_set1_ps(4.0f)), step1 = _mm_mul_ps(a1, _mm_set1_ps(4.0f)), step2 = _mm_mul_ps(a2, _mm_set1_ps(4.0f));
+			for (int x = min_x; x <= max_x; x += 4) {
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(b0, zero), _mm_cmpge_ps(b1, zero)), _mm_cmpge_ps(b2, zero));
+				__m128i lane_x = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+				__m128i in_span = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(lane_x, first), _mm_cmpgt_epi32(lane_x, last)), _mm_set1_epi32(-1));
+				inside = _mm_and_ps(inside, _mm_castsi128_ps(in_span));
+				if (_mm_movemask_ps(inside)) {
+					__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, z0), _mm_mul_ps(b1, z1)), _mm_mul_ps(b2, z2));
+					__m128 stored = _mm_loadu_ps(depth_row + x);
+					__m128 pass = raster.reversed_z ? _mm_cmpgt_ps(z, stored) : _mm_cmplt_ps(z, stored);
+					pass = _mm_and_ps(pass, _mm_and_ps(_mm_cmpge_ps(z, lo), _mm_cmple_ps(z, hi))); //past the near plane
+					pass = _mm_and_ps(pass, inside);
+					int mask = _mm_movemask_ps(pass);
+					if (mask) {
+						_mm_storeu_ps(depth_row + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+						//perspective-correct weights: barycentrics over w, renormalized
+						__m128 p0 = _mm_mul_ps(b0, w0), p1 = _mm_mul_ps(b1, w1), p2 = _mm_mul_ps(b2, w2);
+						__m128 inv_sum = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(p0, p1), p2));
+						float q0[4], q1[4], q2[4];
+						_mm_storeu_ps(q0, _mm_mul_ps(p0, inv_sum));
+						_mm_storeu_ps(q1, _mm_mul_ps(p1, inv_sum));
+						_mm_storeu_ps(q2, _mm_mul_ps(p2, inv_sum));
+						for (int lane = 0; lane < 4; lane++) {
+							if (!(mask & (1 << lane))) continue;
+							float attributes[SW_ATTRIBUTES];
+							for (int a = 0; a < SW_ATTRIBUTES; a++) {
+								attributes[a] = q0[lane] * v0.attributes[a] + q1[lane] * v1.attributes[a] + q2[lane] * v2.attributes[a];
+							}
+							color_row[x + lane] = shade(material, attributes);
+							shaded++;
+						}
+					}
+				}
+				b0 = _mm_add_ps(b0, step0);
+				b1 = _mm_add_ps(b1, step1);
+				b2 = _mm_add_ps(b2, step2);
+			}
+		}
+	}
+
+	for (int y = y_begin; y < y_end; y++) {
+		size_t row = (size_t)y * raster.stride;
+		for (int x = x_begin; x < x_end; x++) raster.output[(size_t)y * raster.width + x] = swraster_tonemap(raster.color[row + x], raster.exposure);
+	}
+	return shaded;
+}
+
+// ------------------------------------------------------------------------------------------
+
+void swraster_resize(SwRaster& raster, int width, int height) {
+	if (raster.width == width && raster.height == height) return;
+	raster.width = width;
+	raster.height = height;
+	raster.tiles_x = (width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	raster.tiles_y = (height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	//whole tiles wide, so a tile's rows can be cleared and read four pixels at a time
+	raster.stride = raster.tiles_x * SW_TILE_SIZE;
+	raster.color.assign((size_t)raster.stride * height, glm::vec3(0.0f));
+	raster.depth.assign((size_t)raster.stride * height, 1.0f);
+	raster.output.assign((size_t)width * height, 0);
+	raster.bins.assign(raster.tiles_x * raster.tiles_y, std::vector<const SwTriangle*>());
+}
+
+void swraster_begin(SwRaster& raster, const glm::mat4& projection, const glm::mat4& view, bool reversed_z,
+	const glm::vec3& clear_color, float exposure) {
+	raster.view_projection = projection * view;
+	raster.reversed_z = reversed_z;
+	raster.clear_color = clear_color;
+	raster.exposure = exposure;
+	raster.draws.clear();
+	raster.materials.clear();
+}
+
+int swraster_material(SwRaster& raster, const SwMaterial& material) {
+	raster.materials.push_back(material);
+	return (int)raster.materials.size() - 1;
+}
+
+void swraster_draw(SwRaster& raster, const SwMesh& mesh, const glm::mat4& model, int material) {
+	SwDraw draw;
+	draw.mesh = &mesh;
+	draw.model = model;
+	draw.material = material;
+	raster.draws.push_back(draw);
+}
+
+void swraster_end(SwRaster& raster) {
+	if (raster.width == 0 || raster.height == 0) return;
+	std::atomic<long long> busy_us(0), shaded(0);
+
+	//vertices and triangles, a few draws per job (the per-draw vectors keep their memory)
+	double start = now_ms();
+	if (raster.triangles.size() < raster.draws.size()) raster.triangles.resize(raster.draws.size());
+	parallel_for(0, raster.draws.size(), 4, [&raster, &busy_us](size_t begin, size_t end) {
+		double job_start = now_ms();
+		std::vector<ClipVertex> vertices;
+		for (size_t d = begin; d < end; d++) setup_draw(raster, raster.draws[d], vertices, raster.triangles[d]);
+		busy_us += (long long)((now_ms() - job_start) * 1000.0);
+	});
+	raster.stats.setup_ms += now_ms() - start;
+
+	//bins, in draw order so equal depths resolve as on the GPU
+	for (size_t i = 0; i < raster.bins.size(); i++) raster.bins[i].clear();
+	for (size_t d = 0; d < raster.draws.size(); d++) {
+		const std::vector<SwTriangle>& triangles = raster.triangles[d];
+		raster.stats.triangles_in += raster.draws[d].mesh->indices.size() / 3;
+		raster.stats.triangles_binned += triangles.size();
+		for (size_t i = 0; i < triangles.size(); i++) {
+			const SwTriangle& t = triangles[i];
+			for (int ty = t.min_y / SW_TILE_SIZE; ty <= t.max_y / SW_TILE_SIZE; ty++) {
+				for (int tx = t.min_x / SW_TILE_SIZE; tx <= t.max_x / SW_TILE_SIZE; tx++) raster.bins[ty * raster.tiles_x + tx].push_back(&t);
+			}
+		}
+	}
+
+	start = now_ms();
+	parallel_for(0, raster.bins.size(), 1, [&raster, &busy_us, &shaded](size_t begin, size_t end) {
+		double job_start = now_ms();
+		long long count = 0;
+		for (size_t tile = begin; tile < end; tile++) count += raster_tile(raster, (int)tile);
+		shaded += count;
+		busy_us += (long long)((now_ms() - job_start) * 1000.0);
+	});
+	raster.stats.raster_ms += now_ms() - start;
+
+	raster.stats.busy_ms += busy_us / 1000.0;
+	raster.stats.pixels_shaded += shaded;
+	raster.stats.pixels_written += (long long)raster.width * raster.height;
+	raster.stats.frames++;
+}
+
+void swraster_print_stats(const SwRaster& raster) {
+	const SwStats& s = raster.stats;
+	if (s.frames == 0) return;
+	double seconds = (s.setup_ms + s.raster_ms) / 1000.0, busy = s.busy_ms / 1000.0;
+	printf("Software rasterizer: %lld frames at %dx%d, %.2f ms setup + %.2f ms raster per frame, %lld of %lld triangles binned per frame\n",
+		s.frames, raster.width, raster.height, s.setup_ms / s.frames, s.raster_ms / s.frames,
+		s.triangles_binned / s.frames, s.triangles_in / s.frames);
+	printf("  %.1f Mpixels/s written, %.1f Mpixels/s shaded on %d threads, %.1f Mpixels/s shaded per core\n",
+		seconds > 0.0 ? s.pixels_written / seconds * 1e-6 : 0.0, seconds > 0.0 ? s.pixels_shaded / seconds * 1e-6 : 0.0,
+		jobs_num_threads(), busy > 0.0 ? s.pixels_shaded / busy * 1e-6 : 0.0);
+}
+
+void swraster_reset_stats(SwRaster& raster) {
+	raster.stats = SwStats();
+}
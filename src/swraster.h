@@ -0,0 +1,141 @@
+#pragma once
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "eclipse.h"
+
+// Screen tiles the triangles are binned into, rasterized one per job
+#define SW_TILE_SIZE 64
+// Interpolated per vertex: uv, normal, position (render space)
+#define SW_ATTRIBUTES 8
+// Clip space x and y are kept within this many times w, so edge functions stay in range
+#define SW_GUARD_BAND 4.0f
+// Nearest w a vertex may have after clipping
+#define SW_NEAR_W 1e-5f
+
+// Software rasterizer for the bodies, for machines without a usable GPU. Draws are recorded
+// with swraster_draw and rendered by swraster_end:
+//  - vertex processing and triangle setup run per draw on the job system: transform, clip
+//    against w > 0 and a guard band, back-face cull as GL does (counter-clockwise front),
+//    and drop triangles that cover no pixel centre
+//  - triangles are binned into SW_TILE_SIZE tiles, in draw order
+//  - tiles are rasterized in parallel. Edge functions, depth and the perspective-correct
+//    weights are evaluated four pixels at a time with SSE; covered pixels that pass the
+//    depth test are shaded one by one with the fragment shader's equivalent
+//  - each tile is tonemapped into the 8-bit output (same curve as shader_tonemap.frag,
+//    without bloom) as soon as it is done
+// Depth follows the projection: reversed-Z (greater passes, cleared to 0) or the usual
+// [-1, 1] (less passes, cleared to 1). Images are stored bottom row first, like GL's.
+struct SwTexture {
+	int width, height;
+	std::vector<unsigned char> rgb; //bottom row first, as loadBMP gives it
+
+	SwTexture() : width(0), height(0) {}
+};
+
+struct SwMesh {
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<unsigned int> indices;
+};
+
+// What the GL shaders take as uniforms
+enum SwShader {
+	SW_SHADER_SIMPLE, //shader_simple.frag: texture times emissive
+	SW_SHADER_PHONG, //shader_phong.frag
+	SW_SHADER_PHONG_EARTH, //shader_phong_earth.frag, without the sky irradiance term
+};
+
+struct SwMaterial {
+	SwShader shader;
+	const SwTexture* texture;
+	const SwTexture* spec; //earth only
+	const SwTexture* normal_map;
+	const SwTexture* night;
+	float emissive; //simple only
+	glm::vec3 light_pos, light_dir; //light_dir: earth only
+	glm::vec3 light_color, ambient, eye;
+	float glossiness;
+	float light_radius;
+	EclipseOccluders occluders;
+
+	SwMaterial() : shader(SW_SHADER_PHONG), texture(NULL), spec(NULL), normal_map(NULL), night(NULL), emissive(1.0f),
+		light_color(1.0f), ambient(0.1f), eye(0.0f), glossiness(50.0f), light_radius(0.0f) {
+		occluders.count = 0;
+	}
+};
+
+struct SwVertex {
+	float x, y, z, inv_w; //window coordinates (y up), depth, 1 / clip w
+	float attributes[SW_ATTRIBUTES];
+};
+
+struct SwTriangle {
+	SwVertex v[3];
+	int material;
+	int min_x, min_y, max_x, max_y; //pixels whose centres the bounding box holds
+};
+
+struct SwDraw {
+	const SwMesh* mesh;
+	glm::mat4 model;
+	int material;
+};
+
+struct SwStats {
+	long long frames;
+	long long triangles_in, triangles_binned;
+	long long pixels_shaded; //fragments that passed the depth test
+	long long pixels_written; //framebuffer pixels, frames x width x height
+	double setup_ms, raster_ms; //wall time of the two parallel phases
+	double busy_ms; //time summed over the threads, for the per-core figure
+
+	SwStats() : frames(0), triangles_in(0), triangles_binned(0), pixels_shaded(0), pixels_written(0),
+		setup_ms(0.0), raster_ms(0.0), busy_ms(0.0) {}
+};
+
+struct SwRaster {
+	int width, height, stride; //stride: width rounded up to the SIMD width
+	int tiles_x, tiles_y;
+	std::vector<glm::vec3> color; //HDR
+	std::vector<float> depth;
+	std::vector<unsigned int> output; //RGBA8, tonemapped
+
+	//this frame
+	glm::mat4 view_projection;
+	bool reversed_z;
+	glm::vec3 clear_color;
+	float exposure;
+	std::vector<SwDraw> draws;
+	std::vector<SwMaterial> materials;
+	std::vector<std::vector<SwTriangle> > triangles; //per draw
+	std::vector<std::vector<const SwTriangle*> > bins; //per tile
+
+	SwStats stats;
+
+	SwRaster() : width(0), height(0), stride(0), tiles_x(0), tiles_y(0), reversed_z(false), clear_color(0.0f), exposure(1.0f) {}
+};
+
+void swtexture_create(SwTexture& texture, const char* rgb, int width, int height);
+
+void swraster_resize(SwRaster& raster, int width, int height);
+
+void swraster_begin(SwRaster& raster, const glm::mat4& projection, const glm::mat4& view, bool reversed_z,
+	const glm::vec3& clear_color, float exposure);
+// Returns the index draws refer to it by; many draws can share one
+int swraster_material(SwRaster& raster, const SwMaterial& material);
+// 'mesh' and the material's textures must outlive swraster_end
+void swraster_draw(SwRaster& raster, const SwMesh& mesh, const glm::mat4& model, int material);
+void swraster_end(SwRaster& raster);
+
+// The fragment shaders' equivalents, also used by the ray tracer. 'shadow' is the fraction
+// of the light that reaches 'pos', 1 when nothing is in the way.
+glm::vec3 swraster_shade(const SwMaterial& material, const glm::vec2& uv, const glm::vec3& normal, const glm::vec3& pos, float shadow);
+// The eclipse term: fraction of the light's disc the material's occluders leave visible
+float swraster_eclipse_visibility(const SwMaterial& material, const glm::vec3& pos);
+// shader_tonemap.frag's curve, to RGBA8
+unsigned int swraster_tonemap(const glm::vec3& hdr, float exposure);
+
+void swraster_print_stats(const SwRaster& raster);
+void swraster_reset_stats(SwRaster& raster);